@@ -27,10 +27,19 @@ www_server::www_server():
 	srv.on_create_io_handler(create_delegate(this,
 	  &www_server::on_create_io_handler));
 	srv.on_exception(create_delegate(this, &www_server::on_exception));
-	srv.on_request(create_delegate(this, &www_server::on_request));
+	// the files are served from the cache, the changed files are reloaded
+	srv.on_request(create_delegate(&files, &http_file_handler::handle));
 }
 
 void www_server::run() {
+	files.root_dir(root_dir);
+	// the files are sent by sendfile() where the kernel supports TLS
+	tls.kernel_tls(true);
+	tls.load_certificates(
+	  nullstr,
+	  "/home/dennis/development/libdcl-0.1.0/examples/web_server/cert.pem",
+	  "/home/dennis/development/libdcl-0.1.0/examples/web_server/pkey.pem",
+	  nullstr);
 	srv.start(interfaces);
 	while (srv.is_running()) {
 		sleep(1);
@@ -50,45 +59,8 @@ dbp::socket* www_server::on_create_io_handler(const dbp::socket &ls,
   const dbp::socket &ws) {
 	// is it SSL connection?
 	if (ls.port() == 8443) {
-		ssl_socket *s = new ssl_socket(ws);
-		s->load_certificates(
-		  nullstr,
-		  "/home/dennis/development/libdcl-0.1.0/examples/web_server/cert.pem",
-		  "/home/dennis/development/libdcl-0.1.0/examples/web_server/pkey.pem",
-		  nullstr);
-		return s;
+		return new ssl_socket(ws, tls);
 	}
 	// no, it's simple connection type
 	return new socket(ws);
 }
-
-http_response www_server::on_request(const http_request &req) {
-	http_response resp;
-	// we are support only HTTP GET method
-	if (req.get_method() != http_method::get) {
-		resp.set_status(http_error::method_not_allowed);
-		resp.set_allow(http_method::get);
-        resp.set_content("The POST requests are not supported yet.");
-		return resp;
-	}
-	// obtain the name of the file requested
-	url u(req.get_path_info());
-	u.normalize(root_dir);
-	// load file content to the server response
-	try {
-		ifstream in(u.path.c_str());
-		// if file can't be open, throw an error
-		if (!in)
-			throw dbp::exception(string("File not found: ") + u.path);
-		// set file content type
-		resp.set_content_type(mime(u.path));
-		// load file
-		resp.add_content(in);
-	}
-	catch (dbp::exception &e) {
-		// return error message
-		resp.set_status(http_error::not_found);
-		resp.set_content(e.what());
-	}
-	return resp;
-}
@@ -23,9 +23,10 @@ public:
 	void stop();
 private:
 	dbp::http_server srv;
-	dbp::mimetype mime;
+	dbp::http_file_handler files;
+	// the certificates and the TLS sessions shared by the connections
+	dbp::ssl_context tls;
 	dbp::socket* on_create_io_handler(const dbp::socket&, const dbp::socket&);
-	dbp::http_response on_request(const dbp::http_request&);
 	void on_exception(const dbp::exception &e);
 };
 
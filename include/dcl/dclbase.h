@@ -26,6 +26,7 @@
 #include <dcl/delegate.h>
 #include <dcl/factory.h>
 #include <dcl/pool.h>
+#include <dcl/mpmc_queue.h>
 #include <dcl/noncopyable.h>
 #include <dcl/shared_ptr.h>
 #include <dcl/mutex.h>
@@ -43,11 +44,14 @@
 #include <dcl/filefs.h>
 #include <dcl/filesystem.h>
 #include <dcl/i18n.h>
+#include <dcl/io_buffer.h>
 #include <dcl/iostream.h>
 #include <dcl/rwlock.h>
 #include <dcl/plugin.h>
 #include <dcl/strutils.h>
+#include <dcl/string_ref.h>
 #include <dcl/thread.h>
+#include <dcl/timer_wheel.h>
 #include <dcl/process.h>
 #include <dcl/url.h>
 #include <dcl/uuid.h>
@@ -23,10 +23,19 @@
 #define _DCLNET_H_
 
 #include <dcl/socket.h>
+#include <dcl/socket_stream.h>
 #include <dcl/ssl_socket.h>
+#include <dcl/reactor.h>
 #include <dcl/tcp_server.h>
+#include <dcl/http_body.h>
+#include <dcl/http_compressor.h>
+#include <dcl/http_fields.h>
+#include <dcl/http_file_handler.h>
 #include <dcl/http_header.h>
 #include <dcl/http_content_parser.h>
+#include <dcl/http_request_parser.h>
+#include <dcl/http_response_writer.h>
+#include <dcl/http_router.h>
 #include <dcl/http_server.h>
 
 #endif /*_DCLNET_H_*/
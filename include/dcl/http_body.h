@@ -0,0 +1,177 @@
+/*
+ * http_body.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HTTP_BODY_H_
+#define _HTTP_BODY_H_
+
+#include <istream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <dcl/io_buffer.h>
+
+namespace dbp {
+
+//! HTTP message body
+/*!
+	The body is kept in the memory until it grows over the spool size,
+	then it is moved to the temporary file, so the memory taken by the
+	body is bounded whatever the size of the body is. The body is read
+	the same way wherever it is stored (see read()).
+
+	The copies of the body spooled share the file until one of them is
+	changed: the file is copied then, so the copies are independent.
+	The body may refer to the data of the io_buffer as well (see
+	assign()), which is copied when the body is changed.
+*/
+class http_body {
+public:
+	//! The default spool size
+	static const size_t default_spool_size = 65536;
+	//! Constructor
+	http_body();
+	//! Copy constructor
+	http_body(const http_body &src);
+	//! Assignment operator
+	http_body& operator=(const http_body &src);
+	//! Destructor
+	~http_body();
+	//! Get the size of the body kept in the memory
+	size_t spool_size() const {
+		return _spool_size;
+	}
+	//! Set the size of the body kept in the memory
+	/*!
+		The body larger than the size given is moved to the file.
+	*/
+	http_body& spool_size(size_t value) {
+		_spool_size = value;
+		return *this;
+	}
+	//! Get the directory of the files spooled
+	const std::string& spool_dir() const {
+		return _spool_dir;
+	}
+	//! Set the directory of the files spooled
+	/*!
+		The system temporary directory is used by default.
+
+		\param value the directory, or the empty string to spool to the
+		anonymous memory file where it is supported (see
+		io_file::temporary())
+	*/
+	http_body& spool_dir(const std::string &value) {
+		_spool_dir = value;
+		return *this;
+	}
+	//! Get the body size
+	uint64_t size() const {
+		return _size;
+	}
+	//! Check for the body is empty
+	bool empty() const {
+		return _size == 0;
+	}
+	//! Reserve the memory for the body expected
+	/*!
+		No more than the spool size is reserved, so the size declared by
+		the client is not trusted.
+	*/
+	void reserve(uint64_t size);
+	//! Replace the body
+	void assign(const char *data, size_t size);
+	//! Replace the body by the data of the buffer
+	/*!
+		The data is not copied, the body shares the slabs of the buffer,
+		so the data cached is passed to the response as it is. The data
+		is copied when the body is changed, or mapped by data(). The
+		buffer should not contain the file regions.
+	*/
+	void assign(const io_buffer &data);
+	//! Append the data
+	/*!
+		Throws io_buffer_exception if the file can't be written.
+	*/
+	void append(const char *data, size_t size);
+	//! Append the data read from the stream
+	/*!
+		\param in the stream to read from
+		\param size the size of the data to read
+		\returns the size of the data read
+	*/
+	size_t append(std::istream &in, size_t size);
+	//! Remove the body
+	void clear();
+	//! Read the body
+	/*!
+		\param offset the position in the body to read from
+		\param size the size of the buffer
+		\param buffer the buffer to read into
+		\returns the number of bytes read, or -1 on error
+	*/
+	int read(uint64_t offset, size_t size, char *buffer) const;
+	//! Get the file the body is spooled to
+	/*!
+		\returns the file, or the file with negative handle if the body
+		is kept in the memory
+	*/
+	const io_file& file() const {
+		return _file;
+	}
+	//! Get the buffer the body refers to
+	/*!
+		\returns the buffer given to assign(), or the empty buffer if the
+		body owns the data
+	*/
+	const io_buffer& buffer() const {
+		return shared;
+	}
+	//! Get the whole body
+	/*!
+		The body spooled is mapped to the memory (or read, where the
+		mapping is not supported) on the first call, the read() is
+		preferred for the large bodies.
+
+		\returns the data, terminated by zero
+	*/
+	const char* data() const;
+private:
+	size_t _spool_size;
+	std::string _spool_dir;
+	uint64_t _size;
+	// the body kept in the memory, terminated by zero
+	std::vector<char> inline_data;
+	io_file _file;
+	// the data of the buffer the body refers to
+	io_buffer shared;
+	// the body spooled is mapped on demand
+	mutable char *mapped;
+	mutable size_t mapped_size;
+	void spool();
+	void detach();
+	void unshare();
+	void unmap() const;
+};
+
+} // namespace
+
+#endif /*_HTTP_BODY_H_*/
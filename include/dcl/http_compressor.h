@@ -0,0 +1,127 @@
+/*
+ * http_compressor.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HTTP_COMPRESSOR_H_
+#define _HTTP_COMPRESSOR_H_
+
+#include <ostream>
+#include <string>
+
+#include <dcl/http_header.h>
+#include <dcl/io_buffer.h>
+#include <dcl/string_ref.h>
+
+namespace dbp {
+
+//! HTTP response compressor
+/*!
+	This class is the response filter of the http_server: the content
+	of the response is compressed by the gzip or deflate coding the
+	client accepts (RFC 7231 5.3.4). The content of the types compressed
+	already, such as the images and the archives, is not compressed.
+
+	The content up to the size of the chunk is compressed at once, and
+	the compressed content is kept in the LRU cache keyed by the hash of
+	the content, so the repeated responses, such as the static files,
+	are compressed once. The larger content, and the content produced
+	by parts, is compressed by parts as it is sent.
+
+	The compressor is shared by the working threads of the server. The
+	compression is not available if the library is built without zlib.
+*/
+class http_compressor {
+public:
+	//! Content coding
+	enum coding {
+		identity,
+		deflate,
+		gzip
+	};
+	//! Content producer compressing the content by parts
+	/*!
+		The object is owned by the caller of filter() and should exist
+		until the response is sent.
+	*/
+	class stream {
+		friend class http_compressor;
+	public:
+		//! Destructor
+		~stream();
+		//! Produce the next part of the compressed content
+		bool produce(std::ostream &out);
+	private:
+		struct state;
+		state *s;
+		stream(coding c, int level);
+		stream(const stream&);
+		stream& operator=(const stream&);
+		size_t compress(const char *data, size_t size, int flush,
+		  std::ostream &out);
+		size_t compress(io_buffer &buf, std::ostream &out);
+	};
+	//! Constructor
+	/*!
+		\param level the compression level, 1 (fastest) to 9 (best)
+		\param cache_size the size of the compressed content cached
+		\param min_size the size of the smallest content to compress
+	*/
+	http_compressor(int level = 6, size_t cache_size = 16777216,
+	  size_t min_size = 256);
+	//! Destructor
+	~http_compressor();
+	//! Choose the coding
+	/*!
+		\param accept_encoding the Accept-Encoding header value
+		\returns the coding the client prefers, gzip if the client
+		prefers gzip and deflate equally, or identity
+	*/
+	static coding negotiate(const string_ref &accept_encoding);
+	//! Register the MIME type of the content compressed already
+	void register_compressed_type(const std::string &mime_type);
+	//! Check for the content of the type is compressed
+	/*!
+		\param content_type the Content-Type header value
+	*/
+	bool compressible(const std::string &content_type) const;
+	//! Compress the response
+	/*!
+		The content and the headers of the response are replaced by the
+		compressed ones, if the response should be compressed. The
+		content compressed by parts is produced by the object returned.
+
+		\param req the request
+		\param resp the response
+		\returns the producer of the content compressed by parts, or
+		NULL
+	*/
+	stream* filter(const http_request &req, http_response &resp);
+	//! Get the number of the responses found in the cache
+	size_t cache_hits() const;
+private:
+	class impl;
+	impl *pimpl;
+	http_compressor(const http_compressor&);
+	http_compressor& operator=(const http_compressor&);
+};
+
+} // namespace
+
+#endif /*_HTTP_COMPRESSOR_H_*/
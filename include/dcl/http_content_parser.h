@@ -24,7 +24,9 @@
 
 #include <vector>
 
+#include <dcl/delegate.h>
 #include <dcl/http_header.h>
+#include <dcl/io_buffer.h>
 
 namespace dbp {
 
@@ -32,6 +34,17 @@ class http_content_element {
 public:
 	std::string name;
 	std::string value;
+	//! The name of the file uploaded, if any
+	std::string filename;
+	//! The content type of the part, if any
+	std::string content_type;
+	//! The content stored in the temporary file
+	/*!
+		The large content is not kept in the memory: the value is empty
+		and the content is read from the file. The file is removed when
+		the last copy of the element is destroyed.
+	*/
+	io_file file;
 };
 
 typedef std::vector<http_content_element> http_content_elements;
@@ -46,6 +59,68 @@ private:
 	impl *pimpl;
 };
 
+//! Streaming multipart/form-data parser
+/*!
+	This class parses the multipart content (RFC 2046, RFC 7578) fed in
+	the pieces of any size, as they are received. The data given is
+	consumed entirely, only the possible beginning of the delimiter or
+	the incomplete header line is kept until the next piece comes.
+
+	The part is delivered when its delimiter is found. The content of
+	the part larger than the spool size, and all the content exceeding
+	the memory limit, is written to the temporary file instead of the
+	memory. The parts of the nested multipart/mixed content are
+	delivered as the parts of the form field enclosing them.
+*/
+class http_multipart_parser {
+public:
+	//! The state of the parsing
+	enum result {
+		//! More data expected
+		incomplete,
+		//! The closing delimiter found, the rest of the data is ignored
+		complete,
+		//! The content is malformed
+		error
+	};
+	//! The handler of the part parsed
+	typedef delegate1<http_content_element&, void> part_handler;
+	//! Constructor
+	/*!
+		\param boundary the boundary of the parts
+		\param spool_size the size of the part to store in the file
+		\param memory_limit the size of all the parts stored in the
+		memory
+	*/
+	http_multipart_parser(const std::string &boundary,
+	  size_t spool_size = 65536, size_t memory_limit = 1048576);
+	//! Destructor
+	~http_multipart_parser();
+	//! Set the handler of the parts
+	/*!
+		The parts are not collected when the handler is set, the memory
+		of the part is released after the handler returns.
+	*/
+	void on_part(part_handler handler);
+	//! Parse the piece of the content
+	/*!
+		Throws io_buffer_exception if the temporary file can't be
+		written.
+
+		\param data the data received
+		\param size the size of the data
+		\returns the state of the parsing
+	*/
+	result parse(const char *data, size_t size);
+	//! Get the parts collected
+	const http_content_elements& elements() const;
+private:
+	class impl;
+	impl *pimpl;
+	http_multipart_parser(const http_multipart_parser&);
+	http_multipart_parser& operator=(const http_multipart_parser&);
+};
+
 } // namespace
 
 #endif /*_HTTP_CONTENT_PARSER_H_*/
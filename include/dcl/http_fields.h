@@ -0,0 +1,209 @@
+/*
+ * http_fields.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HTTP_FIELDS_H_
+#define _HTTP_FIELDS_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <dcl/string_ref.h>
+
+namespace dbp {
+
+class http_fields;
+
+//! HTTP header field
+/*!
+	The name and the value of the field are accessed as the members of
+	the pair, so the field is used as the value of the map.
+*/
+class http_field {
+	friend class http_fields;
+public:
+	//! Constructor
+	http_field(): _hash(0), _id(0) { }
+	//! The field name
+	std::string first;
+	//! The field value
+	std::string second;
+	//! Get the identifier of the well-known field
+	/*!
+		\returns the identifier (see http_fields::field_id)
+	*/
+	int id() const {
+		return _id;
+	}
+private:
+	uint32_t _hash;
+	int _id;
+	void swap(http_field &f);
+};
+
+//! HTTP header fields
+/*!
+	This class is the collection of the HTTP header fields keyed by the
+	name compared case insensitive, as the map is.
+
+	The fields are stored in the array in the order they are added, the
+	first fields are stored in the object itself, so the headers of the
+	usual size do not allocate the memory for the collection. The field
+	name is hashed case-folded when the field is added, and the
+	well-known names are interned: such fields are found by the
+	identifier, with no name comparison.
+*/
+class http_fields {
+public:
+	//! The field
+	typedef http_field value_type;
+	//! Iterator
+	typedef http_field* iterator;
+	//! Constant iterator
+	typedef const http_field* const_iterator;
+	//! The identifiers of the well-known fields
+	enum field_id {
+		other = 0,
+		accept,
+		accept_encoding,
+		accept_language,
+		accept_ranges,
+		allow,
+		authorization,
+		cache_control,
+		connection,
+		content_disposition,
+		content_encoding,
+		content_length,
+		content_range,
+		content_type,
+		cookie,
+		date,
+		etag,
+		expect,
+		expires,
+		host,
+		if_match,
+		if_modified_since,
+		if_none_match,
+		if_range,
+		if_unmodified_since,
+		keep_alive,
+		last_modified,
+		location,
+		range,
+		referer,
+		server,
+		set_cookie,
+		transfer_encoding,
+		upgrade,
+		user_agent,
+		vary
+	};
+	//! Get the identifier of the field name
+	/*!
+		\param name the field name, compared case insensitive
+		\returns the identifier of the well-known field, or other
+	*/
+	static field_id id(const string_ref &name);
+	//! Constructor
+	http_fields();
+	//! Copy constructor
+	http_fields(const http_fields &src);
+	//! Assignment operator
+	http_fields& operator=(const http_fields &src);
+	//! Get the number of the fields
+	size_t size() const {
+		return count;
+	}
+	//! Check for the collection is empty
+	bool empty() const {
+		return count == 0;
+	}
+	//! Get the first field
+	iterator begin() {
+		return items;
+	}
+	//! Get the first field
+	const_iterator begin() const {
+		return items;
+	}
+	//! Get the position after the last field
+	iterator end() {
+		return items + count;
+	}
+	//! Get the position after the last field
+	const_iterator end() const {
+		return items + count;
+	}
+	//! Find the field
+	/*!
+		\param name the field name
+		\returns the field, or end() if there is no field
+	*/
+	iterator find(const string_ref &name);
+	//! Find the field
+	const_iterator find(const string_ref &name) const {
+		return const_cast<http_fields*>(this)->find(name);
+	}
+	//! Find the well-known field
+	/*!
+		\param id the field identifier
+		\returns the field, or end() if there is no field
+	*/
+	iterator find(field_id id);
+	//! Find the well-known field
+	const_iterator find(field_id id) const {
+		return const_cast<http_fields*>(this)->find(id);
+	}
+	//! Get the field value
+	/*!
+		The field is added if there is no field of the name given.
+
+		\param name the field name
+		\returns the reference to the value
+	*/
+	std::string& operator[](const string_ref &name);
+	//! Remove the field
+	/*!
+		\param name the field name
+		\returns the number of the fields removed
+	*/
+	size_t erase(const string_ref &name);
+	//! Remove the field
+	void erase(iterator i);
+	//! Remove all the fields
+	void clear();
+private:
+	// the number of the fields stored in the object
+	static const size_t fixed_size = 16;
+	http_field fixed[fixed_size];
+	// the fields are moved here when they do not fit
+	std::vector<http_field> more;
+	http_field *items;
+	size_t count;
+	static uint32_t hash(const string_ref &name);
+};
+
+} // namespace
+
+#endif /*_HTTP_FIELDS_H_*/
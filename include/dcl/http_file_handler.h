@@ -0,0 +1,106 @@
+/*
+ * http_file_handler.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HTTP_FILE_HANDLER_H_
+#define _HTTP_FILE_HANDLER_H_
+
+#include <string>
+
+#include <dcl/http_header.h>
+#include <dcl/mimetype.h>
+
+namespace dbp {
+
+//! HTTP static file handler
+/*!
+	This class is the request handler of the http_server serving the
+	files of the directory by the GET and HEAD requests:
+
+	\code
+	http_file_handler files("/var/www");
+	srv.on_request(create_delegate(&files, &http_file_handler::handle));
+	\endcode
+
+	The files are kept in the LRU cache of the size given: the content
+	of the small files is kept in the memory and shared by the
+	responses with no copying, the larger files are kept open and sent
+	from the file directly. The file cached is checked
+	for the changes by its modification time, size and inode at most
+	once per the check interval.
+
+	The responses have the strong ETag, the hash of the content, or the
+	inode, the size and the modification time of the large file, and
+	the Last-Modified header. The conditional requests (If-None-Match,
+	If-Modified-Since) are answered by 304, and the single byte range
+	requested (Range, If-Range) is answered by 206 (RFC 7232, 7233).
+	The response to HEAD is the response to GET, the content of which
+	is dropped by the server.
+
+	The handler is shared by the working threads of the server.
+*/
+class http_file_handler {
+public:
+	//! Constructor
+	/*!
+		\param root_dir the directory of the files served
+		\param cache_size the size of the files cached
+		\param max_file_size the size of the largest file kept in the
+		memory
+	*/
+	http_file_handler(const std::string &root_dir = "",
+	  size_t cache_size = 16777216, size_t max_file_size = 65536);
+	//! Destructor
+	~http_file_handler();
+	//! Get the directory of the files served
+	const std::string& root_dir() const;
+	//! Set the directory of the files served
+	/*!
+		The cache is cleared.
+	*/
+	http_file_handler& root_dir(const std::string &value);
+	//! Get the interval of the checks for the file changes, in seconds
+	int check_interval() const;
+	//! Set the interval of the checks for the file changes
+	/*!
+		\param value the interval in seconds, the file is checked by
+		every request if zero
+	*/
+	http_file_handler& check_interval(int value);
+	//! Get the MIME types of the files by the extension
+	mimetype& mime_types();
+	//! Handle the request
+	/*!
+		\param req the request
+		\returns the response with the file, or the error
+	*/
+	http_response handle(const http_request &req);
+	//! Get the number of the files found in the cache
+	size_t cache_hits() const;
+private:
+	class impl;
+	impl *pimpl;
+	http_file_handler(const http_file_handler&);
+	http_file_handler& operator=(const http_file_handler&);
+};
+
+} // namespace
+
+#endif /*_HTTP_FILE_HANDLER_H_*/
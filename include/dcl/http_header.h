@@ -28,6 +28,11 @@
 #include <iostream>
 
 #include <dcl/datetime.h>
+#include <dcl/delegate.h>
+#include <dcl/http_body.h>
+#include <dcl/http_fields.h>
+#include <dcl/io_buffer.h>
+#include <dcl/string_ref.h>
 #include <dcl/strutils.h>
 
 namespace dbp {
@@ -77,6 +82,7 @@ namespace http_error {
 		unsupported_media_type = 415,
 		requested_range_not_satisfiable = 416,
 		expectation_failed = 417,
+		request_header_fields_too_large = 431,
 		internal_server_error = 500,
 		not_implemented = 501,
 		bad_gateway = 502,
@@ -84,6 +90,13 @@ namespace http_error {
 		gateway_timeout = 504,
 		http_version_not_supported = 505
 	};
+	//! Get the reason phrase of the status
+	/*!
+		\param code the status code
+		\returns the reason phrase, or the empty string if the status is
+		unknown
+	*/
+	const char* reason(http_error code);
 }
 
 //!	HTTP method type
@@ -121,6 +134,18 @@ namespace http_method {
 		unknown = 26,
 		head = 27
 	};
+	//! Get the method by the token
+	/*!
+		\param token the method token (such as "GET")
+		\returns the method, or unknown if the token is not known
+	*/
+	http_method parse(const string_ref &token);
+	//! Get the token of the method
+	/*!
+		\param method the method
+		\returns the method token, or the empty string for unknown
+	*/
+	string_ref token(http_method method);
 }
 
 //!	HTTP cookie
@@ -183,7 +208,7 @@ public:
 	};
 
 	//! HTTP header and value pair collection
-	typedef std::map<std::string, std::string, ci_less> http_headers;
+	typedef http_fields http_headers;
 	//! Constructor
 	http_header(): _http_version("1.1") { }
 	//! Initialize a header
@@ -193,7 +218,7 @@ public:
 		\param key a header to be initialized.
 		\param value a header value.
 	*/
-	void set_header(const std::string &key, const std::string &value);
+	void set_header(const string_ref &key, const string_ref &value);
 	//! Initialize a header
 	/*!
 		Parse a given string (specified by a standard web header, where header
@@ -210,7 +235,7 @@ public:
 		\param key a value key.
 		\return a header value.
 	*/
-	const std::string& get_header(const std::string &key) const;
+	const std::string& get_header(const string_ref &key) const;
 	//! Get iterator to the all headers
 	/*!
 		Obtaining a const_iterator to the all headers added before.
@@ -231,6 +256,14 @@ public:
 		\param value a C string to set as content.
 	*/
 	void set_content(int value_size, const char *value);
+	//! Initialize the content by the data of the buffer
+	/*!
+		The data is not copied: the content shares the slabs of the
+		buffer (see http_body::assign()).
+
+		\param value the buffer holding the content
+	*/
+	void set_content(const io_buffer &value);
 	//! Append the content
 	/*!
 		Add content from the source stream.
@@ -247,24 +280,42 @@ public:
 		\param value a stream to set content from.
 	*/
 	void add_content(std::istream &value);
+	//! Append the content
+	/*!
+		\param value_size the content size.
+		\param value the data to append.
+	*/
+	void add_content(int value_size, const char *value);
 	//!	Get content
 	/*!
+		The content spooled to the file is mapped to the memory, see
+		http_body::data().
+
 		\return a pointer to the content.
 	*/
-	const char* get_content() const { return &content[0]; }
+	const char* get_content() const { return content.data(); }
 	//!	Get content size
 	/*!
 		\return content length in bytes
 	*/
 	int get_content_size() const {
-	  return content.empty() ? 0 : content.size() - 1;
+	  return content.size();
+	}
+	//! Get the content store
+	const http_body& get_body() const {
+		return content;
+	}
+	//! Get the content store
+	http_body& get_body() {
+		return content;
 	}
 	//! Get content type
 	/*!
 		\return MIME content type
 	*/
 	const std::string get_content_type() const {
-		http_headers::const_iterator i = headers.find("Content-Type");
+		http_headers::const_iterator i =
+		  headers.find(http_fields::content_type);
 		if (i == headers.end()) {
 			return "text/plain";
 		} else {
@@ -299,8 +350,7 @@ protected:
 	http_headers headers;
 	http_cookies cookies;
 private:
-	typedef std::vector<char> buffer;
-	buffer content;
+	http_body content;
 	std::string _empty_string;
 	std::string _http_version;
 };
@@ -313,8 +363,12 @@ private:
 class http_request: public http_header {
 	friend std::istream& operator>>(std::istream&, http_header&);
 	friend std::ostream& operator<<(std::ostream&, const http_request&);
+	friend class http_router;
 public:
-	http_request(): http_header(), _server_port(0), _https(false)  { }
+	//! The maximum number of the path parameters
+	static const size_t max_params = 8;
+	http_request(): http_header(), _server_port(0), _https(false),
+	  _params(0)  { }
 	const std::string& get_auth_type() const {
 		return _auth_type;
 	};
@@ -332,7 +386,37 @@ public:
 	};
 	void set_path_info(const std::string &value) {
 		_path_info = value;
+		_params = 0;
 	};
+	//! Get the number of the path parameters
+	/*!
+		The parameters are captured from the path by the http_router.
+	*/
+	size_t params_count() const {
+		return _params;
+	}
+	//! Get the name of the path parameter
+	/*!
+		The name refers to the route pattern, it is valid while the
+		router exists.
+	*/
+	string_ref param_name(size_t i) const {
+		return _param_names[i];
+	}
+	//! Get the value of the path parameter
+	/*!
+		The value refers to the path of the request, it is not decoded.
+	*/
+	string_ref param_value(size_t i) const {
+		return string_ref(_path_info.data() + _param_values[i].first,
+		  _param_values[i].second);
+	}
+	//! Get the value of the path parameter by the name
+	/*!
+		\param name the parameter name
+		\returns the value, or the empty string if there is no parameter
+	*/
+	string_ref get_param(const string_ref &name) const;
 	const std::string& get_path_translated() const {
 		return _path_translated;
 	};
@@ -396,11 +480,13 @@ public:
 	http_method::http_method get_method() const {
 		return _method;
 	};
-	const std::string method() const;
+	string_ref method() const {
+		return http_method::token(_method);
+	};
 	void set_method(http_method::http_method method) {
 		_method = method;
 	};
-	void set_method(const std::string &method);
+	void set_method(const string_ref &method);
 	const std::string& get_server_software() const {
 		return _server_software;
 	}
@@ -436,6 +522,11 @@ private:
 	http_method::http_method _method;
 	std::string _server_software;
 	bool _https;
+	// the path parameters are set by the router handling the request
+	// given as the constant, the values are the positions in the path
+	mutable string_ref _param_names[max_params];
+	mutable std::pair<size_t, size_t> _param_values[max_params];
+	mutable size_t _params;
 };
 
 //!	HTTP response
@@ -445,11 +536,59 @@ private:
 class http_response: public http_header {
 	friend std::istream& operator>>(std::istream&, http_header&);
 	friend std::ostream& operator<<(std::ostream&, const http_response&);
+	friend class http_response_writer;
+	friend class http_compressor;
 public:
-	http_response() {
+	//! Content producer
+	/*!
+		The producer writes the next part of the content into the stream
+		given and returns false when the content is over.
+	*/
+	typedef delegate1<std::ostream&, bool> content_producer;
+	http_response(): content_offset(0), content_file_size(0) {
 		set_status(http_error::ok);
 		set_content_type("text/plain; charset=utf-8");
 	};
+	using http_header::set_content;
+	//! Initialize the content from the file
+	/*!
+		The response refers to the file region instead of holding the
+		data: the server sends the region directly from the file, with
+		no copying into the memory.
+
+		\param file the file
+		\param offset the position of the content in the file
+		\param size the content size
+	*/
+	void set_content(const io_file &file, uint64_t offset, size_t size);
+	//! Initialize the content from the whole file
+	/*!
+		\param file the file
+	*/
+	void set_content(const io_file &file) {
+		set_content(file, 0, file.size());
+	};
+	//! Get the content file
+	/*!
+		\return the file set by set_content(), or the file with negative
+		handle if the content is held in memory
+	*/
+	const io_file& get_content_file() const {
+		return content_file;
+	};
+	//! Initialize the content by the producer
+	/*!
+		The content is not known in advance: the server calls the
+		producer to obtain the content by parts, as the parts produced
+		are sent, and sends them with the chunked transfer coding.
+
+		\param producer the content producer
+	*/
+	void set_content(content_producer producer);
+	//! Get the content producer
+	const content_producer& get_content_producer() const {
+		return producer;
+	};
 	http_method::http_method get_allow();
 	void set_allow(http_method::http_method method);
 	//! Get/Set individual headers
@@ -468,6 +607,10 @@ public:
 	};
 private:
 	http_error::http_error _status;
+	io_file content_file;
+	uint64_t content_offset;
+	size_t content_file_size;
+	content_producer producer;
 };
 
 }
@@ -0,0 +1,250 @@
+/*
+ * http_request_parser.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HTTP_REQUEST_PARSER_H_
+#define _HTTP_REQUEST_PARSER_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include <dcl/http_header.h>
+#include <dcl/string_ref.h>
+
+namespace dbp {
+
+//! HTTP request parser
+/*!
+	This class parses the request line and the headers of the HTTP/1.x
+	request (RFC 7230). The parser works over the received data as is:
+	the method, the request target, the version and the headers are the
+	references to the data, so nothing is copied.
+
+	The parser is resumable: when the request is received partially,
+	parse() is called again with the same data and the data received
+	after it, and the parsing continues from the position reached. The
+	data may be moved between the calls, the parser keeps the offsets
+	only.
+
+	The references returned are valid while the data passed to the last
+	parse() call is valid.
+*/
+class http_request_parser {
+public:
+	//! The result of the parsing
+	enum result {
+		//! The request is incomplete, more data is required
+		incomplete,
+		//! The request line and the headers are parsed
+		complete,
+		//! The request is malformed or exceeds the limits
+		error
+	};
+	//! Constructor
+	/*!
+		\param max_line the maximum length of the request line
+		\param max_head the maximum size of the request line and the
+		headers
+		\param max_headers the maximum number of the headers
+	*/
+	http_request_parser(size_t max_line = 8192, size_t max_head = 65536,
+	  size_t max_headers = 100);
+	//! Parse the request
+	/*!
+		\param data the request data received, from the beginning of the
+		request
+		\param size the size of the data
+		\returns the result of the parsing
+	*/
+	result parse(const char *data, size_t size);
+	//! Prepare for the next request
+	void reset();
+	//! Get the size of the request line and the headers parsed
+	/*!
+		\returns the size of the data parsed including the empty line
+		after the headers, the body begins after it
+	*/
+	size_t head_size() const {
+		return pos;
+	}
+	//! Get the maximum size of the request line and the headers
+	size_t max_head_size() const {
+		return max_head;
+	}
+	//! Get the error code
+	/*!
+		\returns the HTTP status to respond on the parsing error
+	*/
+	http_error::http_error error_code() const {
+		return _error;
+	}
+	//! Get the request method
+	string_ref method() const {
+		return ref(_method);
+	}
+	//! Get the request target
+	string_ref target() const {
+		return ref(_target);
+	}
+	//! Get the protocol version (such as "HTTP/1.1")
+	string_ref version() const {
+		return ref(_version);
+	}
+	//! Get the major protocol version number
+	int version_major() const {
+		return _major;
+	}
+	//! Get the minor protocol version number
+	int version_minor() const {
+		return _minor;
+	}
+	//! Get the number of the headers
+	size_t headers_count() const {
+		return headers.size();
+	}
+	//! Get the header name
+	string_ref header_name(size_t i) const {
+		return ref(headers[i].name);
+	}
+	//! Get the header value
+	/*!
+		The leading and trailing whitespaces are not included.
+	*/
+	string_ref header_value(size_t i) const {
+		return ref(headers[i].value);
+	}
+	//! Find the header
+	/*!
+		The header names are compared case insensitive.
+
+		\param name the header name
+		\returns the value of the first header found, or the empty value
+	*/
+	string_ref get_header(const string_ref &name) const;
+private:
+	enum states {
+		s_start,
+		s_method,
+		s_target,
+		s_version,
+		s_line_lf,
+		s_header_start,
+		s_name,
+		s_value_start,
+		s_value,
+		s_header_lf,
+		s_head_lf,
+		s_complete
+	};
+	struct field {
+		size_t offset, size;
+	};
+	struct header {
+		field name, value;
+	};
+	typedef std::vector<header> headers_list;
+	size_t max_line, max_head, max_headers;
+	states state;
+	// the data parsed, the parsing position and the token start
+	const char *base;
+	size_t pos, mark;
+	// the end of the header value without the trailing whitespaces
+	size_t value_end;
+	field _method, _target, _version;
+	int _major, _minor;
+	headers_list headers;
+	http_error::http_error _error;
+	string_ref ref(const field &f) const {
+		return string_ref(base + f.offset, f.size);
+	}
+	result fail(http_error::http_error code) {
+		_error = code;
+		return error;
+	}
+};
+
+//! HTTP chunked body parser
+/*!
+	This class decodes the body of the HTTP/1.1 request sent with the
+	chunked transfer coding (RFC 7230 4.1). The body is decoded as it is
+	received: every call returns the data consumed and the part of the
+	chunk data found in it, referring to the data passed. The chunk
+	extensions and the trailer fields are skipped.
+*/
+class http_chunked_parser {
+public:
+	//! The result of the parsing
+	enum result {
+		//! The body is incomplete, more data is required
+		incomplete,
+		//! The last chunk and the trailer are parsed
+		complete,
+		//! The body is malformed
+		error
+	};
+	//! Constructor
+	/*!
+		\param max_line the maximum length of the chunk size line and the
+		maximum size of the trailer
+	*/
+	http_chunked_parser(size_t max_line = 8192);
+	//! Parse the body
+	/*!
+		Parses the data up to the end of the first chunk data part found,
+		so the function is called until the data is consumed.
+
+		\param data the body data received, from the position the last call
+		has consumed
+		\param size the size of the data
+		\param consumed the size of the data consumed
+		\param chunk the chunk data found, or the empty reference
+		\returns the result of the parsing
+	*/
+	result parse(const char *data, size_t size, size_t &consumed,
+	  string_ref &chunk);
+	//! Prepare for the next body
+	void reset();
+private:
+	enum states {
+		s_size,
+		s_extension,
+		s_size_lf,
+		s_data,
+		s_data_cr,
+		s_data_lf,
+		s_trailer_start,
+		s_trailer,
+		s_trailer_lf,
+		s_last_lf,
+		s_complete
+	};
+	size_t max_line;
+	states state;
+	// the chunk data remaining
+	uint64_t remaining;
+	// the length of the chunk size line or the trailer
+	size_t line;
+	bool has_size;
+};
+
+} // namespace
+
+#endif /*_HTTP_REQUEST_PARSER_H_*/
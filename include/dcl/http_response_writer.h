@@ -0,0 +1,94 @@
+/*
+ * http_response_writer.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HTTP_RESPONSE_WRITER_H_
+#define _HTTP_RESPONSE_WRITER_H_
+
+#include <dcl/http_header.h>
+#include <dcl/io_buffer.h>
+#include <dcl/string_ref.h>
+
+namespace dbp {
+
+//! HTTP response writer
+/*!
+	This class serializes the HTTP/1.x response directly into the
+	io_buffer, without the intermediate strings. The status lines are
+	prepared once for all the known statuses, and the Date header is
+	formatted once per second by every thread.
+
+	The server passes the connection management and the transfer coding
+	options to the writer instead of setting the headers of the response,
+	the headers of the response these options control are not written.
+*/
+class http_response_writer {
+public:
+	//! The connection management and the transfer coding options
+	enum options {
+		//! Write "Connection: keep-alive"
+		keep_alive = 1,
+		//! Write "Connection: close"
+		close = 2,
+		//! Write "Transfer-Encoding: chunked", the content is sent by the
+		//! caller
+		chunked = 4,
+		//! Write the head only, as the response to HEAD does; the headers
+		//! describing the content are kept
+		no_content = 8
+	};
+	//! Get the status line
+	/*!
+		\param code the status code
+		\param version_minor the minor protocol version number
+		\returns the status line including CRLF
+	*/
+	static string_ref status_line(http_error::http_error code,
+	  int version_minor = 1);
+	//! Write the status line and the headers
+	/*!
+		The Date header is added unless the response has one. The
+		responses of the 1xx and 204 (No Content) statuses have no
+		Content-Length and Transfer-Encoding headers.
+
+		\param buf the buffer to write to
+		\param resp the response
+		\param version_minor the minor protocol version number
+		\param opts the options combined
+	*/
+	static void write_head(io_buffer &buf, const http_response &resp,
+	  int version_minor = 1, int opts = 0);
+	//! Write the response
+	/*!
+		Writes the head and the content. The content of the file is not
+		read, the buffer refers to the file region instead.
+
+		\param buf the buffer to write to
+		\param resp the response
+		\param version_minor the minor protocol version number
+		\param opts the options combined
+	*/
+	static void write(io_buffer &buf, const http_response &resp,
+	  int version_minor = 1, int opts = 0);
+};
+
+} // namespace
+
+#endif /*_HTTP_RESPONSE_WRITER_H_*/
@@ -0,0 +1,123 @@
+/*
+ * http_router.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HTTP_ROUTER_H_
+#define _HTTP_ROUTER_H_
+
+#include <string>
+
+#include <dcl/delegate.h>
+#include <dcl/exception.h>
+#include <dcl/http_header.h>
+
+namespace dbp {
+
+//! HTTP router exception class
+class http_router_exception: public exception {
+public:
+	//! Constructor
+	http_router_exception(const std::string &msg = "") noexcept:
+	  exception(msg) { }
+};
+
+//! HTTP request router
+//!
+//!	This class is the request handler of the http_server dispatching the
+//!	requests to the handlers by the method and the path:
+//!
+//!	\code
+//!	http_router router;
+//!	router.add(http_method::get, "/users/:id", create_delegate(this,
+//!	  &app::on_user));
+//!	router.add(http_method::get, "/static/*file", create_delegate(&files,
+//!	  &http_file_handler::handle));
+//!	srv.on_request(create_delegate(&router, &http_router::route));
+//!	\endcode
+//!
+//!	The segment of the pattern starting with ':' matches the segment of
+//!	the path, the segment starting with '*' matches the rest of the path
+//!	and should be the last one. The values matched are available by the
+//!	name from the request (http_request::get_param()). The static
+//!	segment is preferred to the parameter, and the parameter is
+//!	preferred to the rest of the path.
+//!
+//!	The patterns are kept in the radix tree, so the path is matched in
+//!	the time proportional to its length, whatever the number of the
+//!	routes is, with no memory allocated. The routes should be added
+//!	before the server is started.
+class http_router {
+public:
+	//! HTTP request handler
+	typedef delegate1<const http_request&, http_response> handler;
+	//! Constructor
+	http_router();
+	//! Destructor
+	~http_router();
+	//! Add the route
+	/*!
+		The handler of the GET request handles the HEAD request, unless
+		there is the handler of the HEAD request.
+
+		\param method the request method
+		\param pattern the path pattern
+		\param h the request handler
+		\throws http_router_exception if the pattern is not valid, or
+		conflicts with the pattern added before
+	*/
+	http_router& add(http_method::http_method method,
+	  const std::string &pattern, handler h);
+	//! Set the handler of the requests matching no route
+	/*!
+		The response to such requests is 404 (Not Found) by default.
+	*/
+	http_router& not_found(handler h);
+	//! Find the handler of the request
+	/*!
+		The path parameters of the request are set.
+
+		\param req the request
+		\param h the handler found
+		\returns the status of the request: ok if the handler is found,
+		not_found or method_not_allowed
+	*/
+	http_error::http_error find(const http_request &req, handler &h) const;
+	//! Handle the request
+	/*!
+		The request is handled by the handler of the route matching the
+		request. The response to the request of the method the path has
+		no handler for is 405 (Method Not Allowed).
+	*/
+	http_response route(const http_request &req);
+private:
+	struct node;
+	node *root;
+	handler fallback;
+	node* insert(node *n, const std::string &pattern, size_t pos);
+	bool match(const node *n, const string_ref &path, size_t pos,
+	  const http_request &req, const node *&rslt) const;
+	const node* match(const http_request &req) const;
+	http_router(const http_router&);
+	http_router& operator=(const http_router&);
+};
+
+} // namespace
+
+#endif /*_HTTP_ROUTER_H_*/
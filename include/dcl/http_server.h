@@ -22,13 +22,14 @@
 #ifndef _HTTP_SERVER_H_
 #define _HTTP_SERVER_H_
 
-#include <map>
 #include <string>
 #include <sstream>
 
 #include <dcl/delegate.h>
 #include <dcl/http_header.h>
-#include <dcl/mutex.h>
+#include <dcl/http_compressor.h>
+#include <dcl/http_request_parser.h>
+#include <dcl/http_response_writer.h>
 #include <dcl/tcp_server.h>
 
 namespace dbp {
@@ -41,6 +42,42 @@ class http_server: public tcp_server {
 public:
 	//! HTTP request handler
 	typedef delegate1<const http_request&, http_response> on_request_handler;
+	//! Deferred HTTP response
+	/*!
+		The deferred request handler completes the response by the object
+		when the response is ready, from any thread. The object is copied
+		by value, and the copies refer to the same response. If all the
+		copies are destroyed with no response completed, the 500
+		(Internal Server Error) response is sent.
+	*/
+	class deferred_response {
+		friend class http_server;
+	public:
+		//! Constructor
+		deferred_response(): s(NULL) { }
+		//! Copy constructor
+		deferred_response(const deferred_response &src);
+		//! Assignment operator
+		deferred_response& operator=(const deferred_response &src);
+		//! Destructor
+		~deferred_response();
+		//! Complete the response
+		/*!
+			The response is sent by the server. The responses after the
+			first one are ignored.
+
+			\param resp the response
+		*/
+		void complete(const http_response &resp);
+	private:
+		struct state;
+		state *s;
+		explicit deferred_response(state *value);
+		static void unref(state *value);
+	};
+	//! Deferred HTTP request handler
+	typedef delegate2<const http_request&, deferred_response, void>
+	  on_deferred_request_handler;
 	//! Constructor
 	http_server(size_t worker_threads = 2, size_t queue_size = 32768);
 	//! Destructor
@@ -49,33 +86,155 @@ public:
 	void on_request(on_request_handler handler) {
 		request_handler = handler;
 	}
+	//! Assign deferred HTTP request handler
+	/*!
+		The handler is used instead of the on_request one. It returns at
+		once, with no response, and the working thread is free to serve
+		the other connections until the response is completed (see
+		deferred_response), so the slow backends do not block the
+		server. The request given is valid until the response is
+		completed.
+	*/
+	void on_deferred_request(on_deferred_request_handler handler) {
+		deferred_handler = handler;
+	}
+	//! Get the maximum number of the requests per connection
+	size_t max_requests() {
+		return _max_requests;
+	}
+	//! Set the maximum number of the requests per connection
+	/*!
+		The persistent connection is closed after the number of the
+		requests given is served. The zero value disables the limit.
+	*/
+	http_server& max_requests(size_t value) {
+		_max_requests = value;
+		return *this;
+	}
+	//! Get the maximum size of the request body
+	uint64_t max_body_size() {
+		return _max_body_size;
+	}
+	//! Set the maximum size of the request body
+	/*!
+		The request having the larger body is rejected with the 413
+		(Request Entity Too Large) status. The zero value disables the
+		limit.
+	*/
+	http_server& max_body_size(uint64_t value) {
+		_max_body_size = value;
+		return *this;
+	}
+	//! Get the size of the request body kept in the memory
+	size_t body_spool_size() {
+		return _body_spool_size;
+	}
+	//! Set the size of the request body kept in the memory
+	/*!
+		The larger request body is moved to the temporary file as it is
+		received, see http_body.
+	*/
+	http_server& body_spool_size(size_t value) {
+		_body_spool_size = value;
+		return *this;
+	}
+	//! Get the directory of the request bodies spooled
+	const std::string& body_spool_dir() {
+		return _body_spool_dir;
+	}
+	//! Set the directory of the request bodies spooled
+	/*!
+		\param value the directory, or the empty string to spool to the
+		anonymous memory files where it is supported
+	*/
+	http_server& body_spool_dir(const std::string &value) {
+		_body_spool_dir = value;
+		return *this;
+	}
+	//! Get the response compressor
+	http_compressor* compressor() {
+		return _compressor;
+	}
+	//! Set the response compressor
+	/*!
+		The responses are compressed by the compressor given, if the
+		client accepts it. The compressor is not owned by the server
+		and should exist until the server is stopped; NULL disables the
+		compression.
+	*/
+	http_server& compressor(http_compressor *value) {
+		_compressor = value;
+		return *this;
+	}
 protected:
 	void on_process_data(on_process_data_handler handler) {
 		tcp_server::on_process_data(handler);
 	}
 private:
 	// processing requests
-	struct request {
+	struct request: public tcp_server::attachment {
 		enum states {
-			WAIT_COMMAND,
 			WAIT_HEADER,
 			RECEIVING_DATA,
+			RECEIVING_CHUNKS,
 			PROCESS_REQUEST,
-			CLOSING
+			WAIT_RESPONSE,
+			SENDING_CHUNKS,
+			RESPONSE_SENT
 		};
-		request(): state(WAIT_COMMAND), data_size(0), data_readed(0) { }
+		request(): state(WAIT_HEADER), data_size(0), data_readed(0),
+		  keep_alive(false), chunked_input(false), chunked_output(false),
+		  served(0), compression(NULL), deferred(NULL) { }
+		~request() {
+			delete compression;
+			deferred_response::unref(deferred);
+		}
+		// prepare for the next request on the same connection
+		void next() {
+			state = WAIT_HEADER;
+			data_size = data_readed = 0;
+			keep_alive = chunked_input = chunked_output = false;
+			parser.reset();
+			chunks.reset();
+			req = http_request();
+			delete compression;
+			compression = NULL;
+			deferred_response::unref(deferred);
+			deferred = NULL;
+		}
 		states state;
 		size_t data_size;
 		size_t data_readed;
+		bool keep_alive;
+		// the transfer coding of the request and the response bodies
+		bool chunked_input, chunked_output;
+		// the number of the requests served on the connection
+		size_t served;
+		http_request_parser parser;
+		http_chunked_parser chunks;
 		http_request req;
+		// the response content producer and the part it has produced
+		http_response::content_producer producer;
+		io_stream output;
+		// the producer of the content compressed by parts
+		http_compressor::stream *compression;
+		// the response the deferred handler completes
+		deferred_response::state *deferred;
 	};
-	typedef std::map<int, request*> requests;
-	requests reqs;
-	mutex lock;
+	size_t _max_requests;
+	uint64_t _max_body_size;
+	size_t _body_spool_size;
+	std::string _body_spool_dir;
+	http_compressor *_compressor;
 	// Handlers
 	on_request_handler request_handler;
+	on_deferred_request_handler deferred_handler;
 	// Custom handlers
 	bool process_data(const socket&, std::istream&, std::ostream&);
+	bool reject_request(io_stream &out, http_error::http_error code);
+	void send_response(request &req, http_response &resp, io_stream &out);
+
+	http_error::http_error parse_header(request &req, std::istream &in);
 };
 
 } // namespace
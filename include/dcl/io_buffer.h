@@ -0,0 +1,365 @@
+/*
+ * io_buffer.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _IO_BUFFER_H_
+#define _IO_BUFFER_H_
+
+#include <cstddef>
+#include <deque>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <stdint.h>
+
+#include <dcl/exception.h>
+
+namespace dbp {
+
+//! Input/output buffer exception class
+class io_buffer_exception: public exception {
+public:
+	//! Constructor
+	io_buffer_exception(const std::string &msg = "") noexcept: exception(msg) { }
+};
+
+//! Memory block for the scatter/gather input/output
+struct io_vector {
+	char *data;
+	size_t size;
+};
+
+//! File shared by the input/output buffers
+/*!
+	This class represents the file handle, shared by the copies: the
+	file is closed when the last copy is destroyed.
+*/
+class io_file {
+public:
+	//! Constructor
+	io_file(): d(NULL) { }
+	//! Constructor
+	/*!
+		\param handle the file handle to own
+	*/
+	explicit io_file(int handle);
+	//! Constructor
+	/*!
+		Opens the regular file for reading.
+
+		\param path the file name
+	*/
+	explicit io_file(const std::string &path);
+	//! Copy constructor
+	io_file(const io_file &src);
+	//! Assignment operator
+	io_file& operator=(const io_file &src);
+	//! Destructor
+	~io_file();
+	//! Get the file handle
+	int handle() const {
+		return d ? d->handle : -1;
+	}
+	//! Check for the object is the only one referring to the file
+	bool unique() const {
+		return d && __atomic_load_n(&d->refs, __ATOMIC_ACQUIRE) == 1;
+	}
+	//! Get the file size
+	uint64_t size() const;
+	//! Read the data from the file
+	/*!
+		\param offset the position in the file to read from
+		\param size the size of the buffer
+		\param buffer the buffer to read into
+		\returns the number of bytes read, or -1 on error
+	*/
+	int read(uint64_t offset, size_t size, char *buffer) const;
+	//! Write the data to the file
+	/*!
+		\param offset the position in the file to write to
+		\param size the size of the data
+		\param buffer the data to write
+		\returns the number of bytes written, or -1 on error
+	*/
+	int write(uint64_t offset, size_t size, const char *buffer);
+	//! Create the temporary file
+	/*!
+		The file is opened for reading and writing and has no name, so
+		it is removed when the last copy of the object is destroyed.
+		The anonymous memory file is created if the directory is empty
+		and the system supports such files, otherwise the file is
+		created in the temporary directory.
+
+		\param dir the directory to create the file in
+		\returns the file created
+	*/
+	static io_file temporary(const std::string &dir);
+private:
+	struct data {
+		size_t refs;
+		int handle;
+	};
+	data *d;
+	void release();
+};
+
+//! Input/output buffer
+/*!
+	This class represents the byte buffer made of the chain of memory
+	blocks (slabs) of fixed size. The slabs are reference counted, so
+	the copy of the buffer shares the data with the source, and reused
+	through the process-wide pool.
+
+	The buffer is designed to do the network input/output without
+	extra copying: the data is received directly into the free space
+	of the last slab (see prepare() and commit()) and sent from the
+	slabs by the scatter/gather write (see segments() and consume()).
+	The buffer also can refer to the file regions (see append()), which
+	are sent by the socket directly from the file.
+
+	The buffer is not thread safe.
+*/
+class io_buffer {
+public:
+	//! The size of the slab
+	static const size_t slab_size = 16384 - 3 * sizeof(size_t);
+	//! Constructor
+	io_buffer();
+	//! Copy constructor
+	/*!
+		The copy shares the slabs with the source buffer.
+	*/
+	io_buffer(const io_buffer &src);
+	//! Assignment operator
+	io_buffer& operator=(const io_buffer &src);
+	//! Destructor
+	~io_buffer();
+	//! Get the number of bytes in the buffer
+	size_t size() const {
+		return _size;
+	}
+	//! Check for the buffer is empty
+	bool empty() const {
+		return _size == 0;
+	}
+	//! Remove all the data
+	void clear();
+	//! Get the free space at the end of the buffer
+	/*!
+		Returns the memory block to write the data to. The data written
+		becomes the part of the buffer after commit() is called.
+
+		\param size the size of the memory block returned
+		\returns the pointer to the memory block
+	*/
+	char* prepare(size_t &size);
+	//! Append the data written into the memory block obtained by prepare()
+	/*!
+		\param size the number of bytes written
+	*/
+	void commit(size_t size);
+	//! Append the data to the end of the buffer
+	void append(const char *data, size_t size);
+	//! Append the data of other buffer
+	/*!
+		The data is not copied, the slabs are shared between buffers.
+	*/
+	void append(const io_buffer &src);
+	//! Append the part of the data of other buffer
+	/*!
+		The data is not copied, the slabs are shared between buffers.
+
+		\param src the buffer
+		\param offset the offset of the data in the buffer
+		\param size the size of the data
+	*/
+	void append(const io_buffer &src, size_t offset, size_t size);
+	//! Append the file region
+	/*!
+		The data is not read, the buffer refers to the file instead.
+
+		\param file the file
+		\param offset the region offset
+		\param size the region size
+	*/
+	void append(const io_file &file, uint64_t offset, size_t size);
+	//! Remove the data from the beginning of the buffer
+	/*!
+		\param size the number of bytes to remove
+	*/
+	void consume(size_t size);
+	//! Get the memory blocks containing the data
+	/*!
+		\param count the maximum number of memory blocks to return
+		\param vectors the array to store the memory blocks
+		\param offset the number of bytes from the beginning of the
+		buffer to skip
+		\returns the number of memory blocks returned, up to the first file
+		region
+	*/
+	int segments(int count, io_vector *vectors, size_t offset = 0) const;
+	//! Get the file region at the beginning of the buffer
+	/*!
+		\param file the file referred
+		\param offset the region offset
+		\param size the region size
+		\returns false if the buffer does not start with the file region
+	*/
+	bool file_region(io_file &file, uint64_t &offset, size_t &size) const;
+	//! Make the data contiguous
+	/*!
+		Moves the data into the single memory block, if it spans several
+		ones.
+
+		\param offset the offset of the data in the buffer
+		\param size the size of the data
+		\returns the pointer to the data, or NULL if the data is empty,
+		out of the buffer or includes the file region
+	*/
+	char* pullup(size_t offset, size_t size);
+private:
+	struct slab;
+	struct segment {
+		// the memory block of the slab
+		slab *owner;
+		char *begin, *end;
+		// or the file region
+		io_file file;
+		uint64_t offset;
+		size_t length;
+		size_t size() const {
+			return owner ? end - begin : length;
+		}
+	};
+	typedef std::deque<segment> segments_list;
+	segments_list segs;
+	size_t _size;
+	static slab* acquire(size_t capacity = slab_size);
+	static void release(slab *s);
+};
+
+//! Input/output buffer stream buffer
+/*!
+	The stream buffer reads the data directly from the slabs of the
+	io_buffer and writes the data directly into them. The file regions
+	of the buffer are not read by the stream.
+*/
+class io_streambuf: public std::streambuf {
+public:
+	//! Constructor
+	io_streambuf();
+	//! Get the underlying buffer
+	io_buffer& buffer() {
+		sync();
+		return buf;
+	}
+	//! Remove the data already read from the buffer
+	void compact();
+	//! Remove all the data
+	void reset();
+	//! Make the data at the read position contiguous
+	/*!
+		\param size the size of the data requested, is set to the size
+		available
+		\returns the pointer to the data, or NULL if there is no data
+	*/
+	const char* pullup(size_t &size);
+	//! Get the contiguous data at the read position
+	/*!
+		\param size is set to the size of the data
+		\returns the pointer to the data, or NULL if there is no data
+	*/
+	const char* peek(size_t &size);
+protected:
+	virtual int_type underflow();
+	virtual int_type overflow(int_type c = traits_type::eof());
+	virtual std::streamsize showmanyc();
+	virtual int sync();
+	virtual pos_type seekoff(off_type off, std::ios_base::seekdir way,
+	  std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+	virtual pos_type seekpos(pos_type pos,
+	  std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+private:
+	io_buffer buf;
+	// the position of the buffer beginning in the stream
+	size_t base;
+	// the offset of the get area in the buffer
+	size_t goff;
+	size_t read_offset() const {
+		return goff + (gptr() - eback());
+	}
+	void set_read_offset(size_t offset);
+	void commit_put();
+};
+
+//! Input/output buffer stream
+/*!
+	The stream is used to read and write the data of the io_buffer by
+	the standard stream operations.
+*/
+class io_stream: public std::iostream {
+public:
+	//! Constructor
+	io_stream(): std::iostream(&sb) { }
+	//! Get the underlying buffer
+	/*!
+		The data written into the stream is flushed into the buffer.
+	*/
+	io_buffer& buffer() {
+		return sb.buffer();
+	}
+	//! Remove the data already read from the buffer
+	void compact() {
+		sb.compact();
+	}
+	//! Remove all the data and reset the stream state
+	void reset() {
+		sb.reset();
+		clear();
+	}
+	//! Make the data at the read position contiguous
+	/*!
+		The data is not extracted from the stream.
+
+		\param size the size of the data requested, is set to the size
+		available
+		\returns the pointer to the data, or NULL if there is no data
+	*/
+	const char* pullup(size_t &size) {
+		return sb.pullup(size);
+	}
+	//! Get the contiguous data at the read position
+	/*!
+		Returns the data up to the end of the memory block it is stored
+		in. The data is not extracted from the stream.
+
+		\param size is set to the size of the data
+		\returns the pointer to the data, or NULL if there is no data
+	*/
+	const char* peek(size_t &size) {
+		return sb.peek(size);
+	}
+private:
+	io_streambuf sb;
+};
+
+} // namespace
+
+#endif /*_IO_BUFFER_H_*/
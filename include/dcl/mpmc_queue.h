@@ -0,0 +1,153 @@
+/*
+ * mpmc_queue.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _MPMC_QUEUE_H_
+#define _MPMC_QUEUE_H_
+
+#include <cstddef>
+
+#include <dcl/noncopyable.h>
+
+namespace dbp {
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+//! Bounded lock-free queue
+/*!
+	This is a fixed size multiple producers, multiple consumers queue
+	(the algorithm by Dmitry Vyukov). Neither push() nor pop() take a lock:
+	each cell holds a sequence number, and producers and consumers reserve
+	cells by the single compare-and-swap on the queue position.
+
+	The queue does not block; use it together with a semaphore to park the
+	consumers when the queue is empty.
+*/
+template <class T>
+class mpmc_queue: public noncopyable {
+public:
+	//! Constructor
+	/*!
+		\param capacity the maximum number of elements (rounded up to the
+		power of two)
+	*/
+	mpmc_queue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity)
+			size <<= 1;
+		buffer = new cell[size];
+		mask = size - 1;
+		for (size_t i = 0; i < size; i++)
+			buffer[i].sequence = i;
+		enqueue_pos = 0;
+		dequeue_pos = 0;
+	}
+	//! Destructor
+	~mpmc_queue() {
+		delete [] buffer;
+	}
+	//! Get the queue capacity
+	size_t capacity() const {
+		return mask + 1;
+	}
+	//! Append the element to the queue
+	/*!
+		\param value the element to append
+		\returns false if the queue is full
+	*/
+	bool push(const T &value) {
+		cell *c;
+		size_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		while (1) {
+			c = &buffer[pos & mask];
+			size_t seq = __atomic_load_n(&c->sequence, __ATOMIC_ACQUIRE);
+			ptrdiff_t dif = ptrdiff_t(seq) - ptrdiff_t(pos);
+			if (dif == 0) {
+				if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1,
+				  true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		}
+		c->data = value;
+		__atomic_store_n(&c->sequence, pos + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+	//! Take the element from the queue
+	/*!
+		\param value the element taken
+		\returns false if the queue is empty
+	*/
+	bool pop(T &value) {
+		cell *c;
+		size_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+		while (1) {
+			c = &buffer[pos & mask];
+			size_t seq = __atomic_load_n(&c->sequence, __ATOMIC_ACQUIRE);
+			ptrdiff_t dif = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+			if (dif == 0) {
+				if (__atomic_compare_exchange_n(&dequeue_pos, &pos, pos + 1,
+				  true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+		}
+		value = c->data;
+		__atomic_store_n(&c->sequence, pos + mask + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+	//! Check for the queue is empty
+	/*!
+		The result is a snapshot: it may be outdated by the time it is
+		returned if other threads are working with the queue.
+	*/
+	bool empty() const {
+		size_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_ACQUIRE);
+		const cell &c = buffer[pos & mask];
+		return __atomic_load_n(&c.sequence, __ATOMIC_ACQUIRE) != pos + 1;
+	}
+private:
+	struct cell {
+		size_t sequence;
+		T data;
+	};
+	// keep the positions modified by producers and consumers on the
+	// separate cache lines
+	char pad0[CACHE_LINE_SIZE];
+	cell *buffer;
+	size_t mask;
+	char pad1[CACHE_LINE_SIZE];
+	size_t enqueue_pos;
+	char pad2[CACHE_LINE_SIZE];
+	size_t dequeue_pos;
+	char pad3[CACHE_LINE_SIZE];
+};
+
+} // namespace
+
+#endif /*_MPMC_QUEUE_H_*/
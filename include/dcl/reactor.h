@@ -0,0 +1,129 @@
+/*
+ * reactor.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+#include <vector>
+
+#include <dcl/exception.h>
+#include <dcl/noncopyable.h>
+
+namespace dbp {
+
+//! Reactor exception
+/*!
+	This class is used to signal about errors in reactor class.
+*/
+class reactor_exception: public exception {
+public:
+	reactor_exception(const std::string &msg = "") noexcept: exception(msg) { }
+};
+
+//! I/O readiness event
+struct reactor_event {
+	//! The user data pointer the handle was registered with
+	void *data;
+	//! The bit mask of reactor::events raised
+	int events;
+};
+
+typedef std::vector<reactor_event> reactor_events;
+
+class reactor_int {
+public:
+	virtual ~reactor_int() { }
+	virtual void add(int handle, int events, void *data) = 0;
+	virtual void modify(int handle, int events, void *data) = 0;
+	virtual void remove(int handle) = 0;
+	virtual void rearm(int handle, int events) = 0;
+	virtual void wait(int timeout, reactor_events &events) = 0;
+	virtual void interrupt() = 0;
+};
+
+//! I/O event demultiplexer
+/*!
+	The reactor watches a set of socket handles and reports which of them
+	are ready for reading or writing. Handles are registered once and stay
+	registered until removed, so the cost of waiting does not depend on
+	the number of idle handles (for the epoll backend).
+
+	The notifications are edge-triggered: the readiness is reported once,
+	and the caller is expected to read or write the handle until the
+	operation returns socket::data_not_ready. After that, the caller calls
+	rearm() to tell the reactor that it wants to be notified again. The
+	epoll backend gets this for free from the kernel, so rearm() does
+	nothing there; the select() backend, which is used where epoll is not
+	available, emulates it by polling only the armed directions.
+*/
+class reactor: public reactor_int, public noncopyable {
+public:
+	//! I/O event types
+	enum events {
+		none = 0,
+		read = 1,
+		write = 2,
+		error = 4
+	};
+	//! Event demultiplexing backends
+	enum backend {
+		//! The best backend available on the platform
+		default_backend,
+		//! Portable select() backend, limited by FD_SETSIZE handles
+		select_backend,
+		//! Linux epoll backend (falls back to select() if not supported)
+		epoll_backend
+	};
+	//! Constructor
+	reactor(backend type = default_backend);
+	//! Destructor
+	virtual ~reactor();
+	//! Register the handle
+	/*!
+		\param handle the socket handle to watch
+		\param events the bit mask of events to watch for
+		\param data the user data pointer returned with the events
+	*/
+	virtual void add(int handle, int events, void *data);
+	//! Change the events watched for the handle
+	virtual void modify(int handle, int events, void *data);
+	//! Unregister the handle
+	virtual void remove(int handle);
+	//! Re-enable notifications after the handle was drained
+	virtual void rearm(int handle, int events);
+	//! Wait for events
+	/*!
+		Blocks until some of the registered handles are ready, the timeout
+		expires or interrupt() is called from another thread.
+
+		\param timeout the timeout in milliseconds, or -1 to wait infinitely
+		\param events the events raised (the previous content is discarded)
+	*/
+	virtual void wait(int timeout, reactor_events &events);
+	//! Wake up the thread blocked in wait()
+	virtual void interrupt();
+private:
+	reactor_int *pimpl;
+};
+
+} // namespace
+
+#endif /*_REACTOR_H_*/
@@ -26,6 +26,7 @@
 #include <string>
 
 #include <dcl/exception.h>
+#include <dcl/io_buffer.h>
 
 namespace dbp {
 
@@ -76,6 +77,11 @@ public:
 		data_not_ready = -1,
 		io_error = -2
 	} error;
+	//! The directions of the input/output
+	enum direction {
+		in = 1,
+		out = 2
+	};
 	//!	Constructor
 	socket();
 	//! Constructor
@@ -83,6 +89,9 @@ public:
 		socket_fd = src.socket_fd;
 		_port = src._port;
 		_address = src._address;
+		_zerocopy = src._zerocopy;
+		zerocopy_sends = src.zerocopy_sends;
+		zerocopy_done = src.zerocopy_done;
 		const_cast<socket&>(src).socket_fd = -1;
 	}
 	//! Copy operator
@@ -90,6 +99,9 @@ public:
 		socket_fd = src.socket_fd;
 		_port = src._port;
 		_address = src._address;
+		_zerocopy = src._zerocopy;
+		zerocopy_sends = src.zerocopy_sends;
+		zerocopy_done = src.zerocopy_done;
 		const_cast<socket&>(src).socket_fd = -1;
 		return *this;
 	}
@@ -107,8 +119,11 @@ public:
 	//!	Binding to the specified network interfaces
 	/*!
 		\param address a network address you want bind to
+		\param reuse_port allow several sockets to bind to the same
+		address and port (SO_REUSEPORT); the kernel balances the incoming
+		connections between them
 	*/
-	void bind(const socket_address &address);
+	void bind(const socket_address &address, bool reuse_port = false);
 	//!	Listening for incoming connections
 	/*!
 		Switchs a socket to a passive state for listening for connections
@@ -120,7 +135,9 @@ public:
 		Accepts the incoming connection. The socket should be in listen
 		mode to do this.
 		
-		\returns a socket to communicate
+		\returns a socket to communicate, or the socket with negative
+		handle if there are no pending connections on a non-blocking
+		socket
 	*/
 	socket accept();
 	//! Read data from the socket
@@ -131,6 +148,15 @@ public:
 		\return number of a bytes readed or -1 on error
 	*/
 	virtual int read(int bytes_to_read, char *buffer);
+	//! Read data into several memory blocks
+	/*!
+		Reads the data into the memory blocks one after another by the
+		single call (the scatter input).
+		\param count the number of memory blocks
+		\param vectors the memory blocks to fill
+		\return number of a bytes read or the error code
+	*/
+	virtual int readv(int count, const io_vector *vectors);
 	//! Write data to the socket
 	/*!
 		Writes buffer to a socket.
@@ -139,11 +165,85 @@ public:
 		\return number of a bytes written or -1 on error
 	*/
 	virtual int write(int bytes_to_write, const char *buffer);
+	//! Write several memory blocks to the socket
+	/*!
+		Writes the memory blocks to a socket by the single call (the
+		gather output).
+		\param count the number of memory blocks
+		\param vectors the memory blocks to write
+		\return number of a bytes written or the error code
+	*/
+	virtual int writev(int count, const io_vector *vectors);
+	//! Write the file region to the socket
+	/*!
+		Sends the file data directly from the file (by the sendfile call
+		where available), with no copying into the user space.
+		\param file the file to send
+		\param offset the position of the data in the file
+		\param size the size of the data
+		\return number of a bytes written or the error code
+	*/
+	virtual int sendfile(const io_file &file, uint64_t offset, size_t size);
+	//! Enable or disable the zero-copy output
+	/*!
+		The large blocks written by writev_zerocopy() are sent from the
+		memory of the process by the network card, with no copying
+		(MSG_ZEROCOPY on Linux).
+		\param enable the state of the zero-copy output
+		\return false if the zero-copy output is not supported, the data
+		is copied then
+	*/
+	bool zerocopy(bool enable);
+	//! Check for the zero-copy output is enabled
+	/*!
+		The zero-copy output is disabled when the kernel reports it
+		copies the data anyway (as it does on the loopback interface).
+	*/
+	bool zerocopy() const {
+		return _zerocopy;
+	}
+	//! Write several memory blocks with no copying
+	/*!
+		Writes the memory blocks as writev() does. If the zero-copy
+		output is enabled and the blocks are large enough, the data is
+		sent right from the memory given, so the memory should be kept
+		unchanged until zerocopy_completed() reaches the value of
+		zerocopy_sent() got after the call.
+		\param count the number of memory blocks
+		\param vectors the memory blocks to write
+		\return number of a bytes written or the error code
+	*/
+	int writev_zerocopy(int count, const io_vector *vectors);
+	//! Get the number of the zero-copy writes done
+	uint32_t zerocopy_sent() const {
+		return zerocopy_sends;
+	}
+	//! Get the number of the zero-copy writes completed
+	/*!
+		Receives the completion notifications of the kernel, with no
+		waiting.
+		\return the number of the zero-copy writes the memory of which
+		may be reused
+	*/
+	uint32_t zerocopy_completed();
 	//! Shut down the connection
 	/*!
 		Closes the connection gracefully.
 	*/
 	virtual void shutdown();
+	//! Get the direction the blocked operation waits for
+	/*!
+		The operation returned data_not_ready is retried when the socket
+		is ready for the direction returned. The reading waits for the
+		input and the writing waits for the output, unless the socket
+		exchanges its own data first (as the SSL socket does on the
+		handshake).
+		\param op the direction of the operation blocked
+		\return the direction to wait for
+	*/
+	virtual direction blocked_on(direction op) const {
+		return op;
+	}
 	//! Get the socket address
 	/*!
 		Obtains the connected socket ip address.
@@ -166,6 +266,20 @@ protected:
 	int socket_fd;
 	std::string _address;
 	int _port;
+	// the zero-copy output is enabled, the number of the writes done
+	// and completed
+	bool _zerocopy;
+	uint32_t zerocopy_sends, zerocopy_done;
+	//! Write the file data block to the socket
+	/*!
+		Reads the block of the file region into the memory and writes it
+		by the write() call.
+		\param file the file to send
+		\param offset the position of the data in the file
+		\param size the size of the data
+		\return number of a bytes written or the error code
+	*/
+	int send_file_block(const io_file &file, uint64_t offset, size_t size);
 private:
 	void set_blocked(bool state);
 };
@@ -178,8 +292,34 @@ public:
 
 class udp_socket: public socket {
 public:
+	//! Datagram of the batched input
+	struct datagram {
+		//! the buffer of the datagram
+		io_vector data;
+		//! the size of the datagram received
+		size_t size;
+	};
 	//!	Constructor
 	udp_socket();
+	//! Receive several datagrams
+	/*!
+		Receives the datagrams waiting by the single call (recvmmsg()
+		where available). The blocking socket waits for the first
+		datagram only.
+		\param count the number of the datagrams
+		\param datagrams the buffers of the datagrams
+		\return the number of the datagrams received or the error code
+	*/
+	int read_datagrams(int count, datagram *datagrams);
+	//! Send several datagrams
+	/*!
+		Sends the datagrams to the address the socket is connected to by
+		the single call (sendmmsg() where available).
+		\param count the number of the datagrams
+		\param datagrams the datagrams to send
+		\return the number of the datagrams sent or the error code
+	*/
+	int write_datagrams(int count, const io_vector *datagrams);
 };
 
 class unix_socket: public socket {
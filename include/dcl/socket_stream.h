@@ -23,26 +23,67 @@
 #define _SOCKET_STREAM_H_
 
 #include <streambuf>
+#include <vector>
 
 #include <dcl/noncopyable.h>
 #include <dcl/socket.h>
 
 namespace dbp {
 
-//!	Class description.
+//!	Socket stream buffer
 /*!
-	Detailed class description.
+	This class is the buffer of the input and the output streams over the
+	socket, so the blocking clients read and write the socket by the
+	standard streams:
+
+	\code
+	tcp_socket s;
+	s.connect("localhost", 80);
+	socket_stream buf(s);
+	std::iostream io(&buf);
+	io << "GET / HTTP/1.0\r\n" << "Host: localhost\r\n\r\n" << std::flush;
+	\endcode
+
+	The data written is collected in the output buffer and sent by the
+	single call when the buffer is full, when the stream is flushed, or
+	before the stream waits for the input. The blocks larger than the
+	buffers are read and written directly, with no copying. The
+	non-blocking socket is waited for until it's ready, so the stream
+	may be used with the SSL socket too.
 */
 class socket_stream: public std::streambuf, public noncopyable {
 public:
+	//! Constructor
+	/*!
+		\param s the socket, should be alive as long as the stream is
+		\param buf_size the size of the input buffer
+		\param put_back the number of the characters kept to put back
+		\param out_size the size of the output buffer, the zero value
+		disables the output buffering
+	*/
 	socket_stream(socket &s, std::size_t buf_size = 1500,
-	  std::size_t put_back = 8);
+	  std::size_t put_back = 8, std::size_t out_size = 4096);
+	//! Destructor
+	/*!
+		The data buffered is sent.
+	*/
+	virtual ~socket_stream();
 protected:
 	int_type underflow();
+	int_type overflow(int_type c = traits_type::eof());
+	int sync();
+	std::streamsize xsgetn(char *s, std::streamsize n);
+	std::streamsize xsputn(const char *s, std::streamsize n);
 private:
 	const std::size_t _put_back;
-	std::vector<char> _buf;
-	socket _s;
+	std::vector<char> _buf, _out;
+	socket &_s;
+	// Send the data buffered followed by the block given
+	bool send(const char *data, std::size_t size);
+	// Read the data available, waiting for it
+	int receive(char *data, std::size_t size);
+	// Wait for the socket is ready for the operation blocked
+	bool wait(socket::direction op);
 };
 
 } // namespace
@@ -30,10 +30,104 @@
 namespace dbp {
 
 class ssl_socket_impl;
+class ssl_context_impl;
+
+//!	SSL Context Class
+/*!
+	This class holds the certificates and the TLS settings shared by the
+	SSL sockets of the server. The certificates are loaded once rather
+	than by every connection accepted, and the sessions of the returning
+	clients are resumed with no full handshake, either from the session
+	cache of the server, or from the session ticket (RFC 5077) the client
+	keeps itself:
+
+	\code
+	ssl_context tls(nullstr, "cert.pem", "pkey.pem", nullstr);
+	...
+	socket* on_create_io_handler(const socket &ls, const socket &ws) {
+		return new ssl_socket(ws, tls);
+	}
+	\endcode
+
+	The certificates may be reloaded while the server is running: the
+	connections accepted after the reload use the new certificates, the
+	established ones keep the old. The session tickets issued before the
+	reload are still accepted. The context should live as long as the
+	sockets created with it.
+*/
+class ssl_context {
+	friend class ssl_socket;
+public:
+	//! Constructor
+	ssl_context();
+	//! Constructor
+	/*!
+		\see load_certificates()
+	*/
+	ssl_context(
+	  const std::string &ca,
+	  const std::string &cert, const std::string &key,
+	  const std::string &crl);
+	//! Destructor
+	~ssl_context();
+	//! Load SSL certificates
+	/*!
+		The session settings are applied to the certificates loaded, so
+		these should be set before.
+
+		\param ca the file of the CA certificates, optional
+		\param cert the file of the server certificate chain, PEM
+		\param key the file of the private key, PEM
+		\param crl the file of the certificate revocation list, optional
+		\throws socket_exception if the files can't be loaded; the
+		certificates loaded before are kept then
+	*/
+	void load_certificates(
+	  const std::string &ca,
+	  const std::string &cert, const std::string &key,
+	  const std::string &crl);
+	//! Reload SSL certificates from the same files
+	void reload();
+	//! Get the maximum number of the sessions cached
+	size_t session_cache_size() const;
+	//! Set the maximum number of the sessions cached, 0 disables the cache
+	ssl_context& session_cache_size(size_t value);
+	//! Get the session lifetime, seconds
+	int session_timeout() const;
+	//! Set the session lifetime, seconds
+	ssl_context& session_timeout(int value);
+	//! Check for the session tickets are issued
+	bool session_tickets() const;
+	//! Enable or disable the session tickets
+	ssl_context& session_tickets(bool value);
+	//! Check for the kernel TLS is enabled
+	bool kernel_tls() const;
+	//! Enable or disable the kernel TLS
+	/*!
+		The data is encrypted by the kernel (Linux kTLS) once the
+		handshake is done, when the kernel supports the cipher
+		negotiated, so the files are sent by sendfile() with no
+		copying. Otherwise the sockets fall back to the encryption in
+		the user space. Applies to OpenSSL 3.0 and newer; GnuTLS enables
+		the kernel TLS by its system configuration.
+	*/
+	ssl_context& kernel_tls(bool value);
+private:
+	ssl_context_impl *pimpl;
+	ssl_context(const ssl_context&);
+	ssl_context& operator=(const ssl_context&);
+};
 
 //!	SSL Socket Class
 /*!
 	This class represents SSL-enabled network socket.
+
+	The socket is non-blocking: the handshake is done by the first
+	read() or write(), or by handshake(), step by step as the data
+	arrives. The operation returned socket::data_not_ready waits for the
+	direction reported by blocked_on(): the reading may wait for the
+	output when the handshake data is to be sent, and the writing may
+	wait for the input.
 */
 class ssl_socket: public socket {
 public:
@@ -41,6 +135,12 @@ public:
 	ssl_socket();
 	//! Constructor
 	ssl_socket(const socket &src);
+	//! Constructor
+	/*!
+		The socket uses the certificates and the sessions of the context,
+		so load_certificates() is not called.
+	*/
+	ssl_socket(const socket &src, ssl_context &ctx);
 	//! Copy operator
 	ssl_socket& operator=(const ssl_socket &src);
 	//!	Destructor
@@ -49,11 +149,52 @@ public:
 	virtual int handle() const;
 	//! Read data from the ssl_socket
 	virtual int read(int bytes_to_read, char *buffer);
+	//! Read data into several memory blocks
+	/*!
+		The blocks are decrypted into one by one.
+	*/
+	virtual int readv(int count, const io_vector *vectors);
 	//! Write data to the ssl_socket
 	virtual int write(int bytes_to_write, const char *buffer);
+	//! Write several memory blocks to the ssl_socket
+	/*!
+		The blocks are encrypted and written one by one, or written at
+		once when the kernel encrypts them (see is_kernel_tls()).
+	*/
+	virtual int writev(int count, const io_vector *vectors);
+	//! Write the file region to the ssl_socket
+	/*!
+		The data must be encrypted, so the file is read and written by
+		blocks, unless the kernel encrypts it (see is_kernel_tls()):
+		the file is sent directly from the file then.
+	*/
+	virtual int sendfile(const io_file &file, uint64_t offset, size_t size);
 	//! Shut down the connection
 	virtual void shutdown();
+	//! Get the direction the blocked operation waits for
+	virtual direction blocked_on(direction op) const;
+	//! Do the handshake
+	/*!
+		Continues the handshake with the data available, the read() and
+		write() do this themselves.
+
+		\returns 0 when the handshake is done, socket::data_not_ready if
+		it waits for the data (see blocked_on()), or socket::io_error if
+		it's failed
+	*/
+	int handshake();
+	//! Check for the handshake is done
+	bool is_established() const;
+	//! Check for the data sent is encrypted by the kernel
+	/*!
+		\see ssl_context::kernel_tls()
+	*/
+	bool is_kernel_tls() const;
 	//! Load SSL certificates
+	/*!
+		The certificates are loaded for this socket only; the server
+		should rather share the ssl_context by its sockets.
+	*/
 	void load_certificates(
 	  const std::string &ca,
 	  const std::string &cert, const std::string &key,
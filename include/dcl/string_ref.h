@@ -0,0 +1,133 @@
+/*
+ * string_ref.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _STRING_REF_H_
+#define _STRING_REF_H_
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string.h>
+
+namespace dbp {
+
+//! Reference to the string
+/*!
+	This class refers to the characters owned by some other object, so
+	it is valid while the characters are not changed. The string_ref is
+	not null-terminated.
+*/
+class string_ref {
+public:
+	//! Constructor
+	string_ref(): _data(NULL), _size(0) { }
+	//! Constructor
+	/*!
+		\param data the characters referred
+		\param size the number of the characters
+	*/
+	string_ref(const char *data, size_t size): _data(data), _size(size) { }
+	//! Constructor
+	/*!
+		\param data the null-terminated string referred
+	*/
+	string_ref(const char *data): _data(data), _size(strlen(data)) { }
+	//! Constructor
+	/*!
+		\param s the string referred
+	*/
+	string_ref(const std::string &s): _data(s.data()), _size(s.size()) { }
+	//! Get the characters
+	const char* data() const {
+		return _data;
+	}
+	//! Get the number of the characters
+	size_t size() const {
+		return _size;
+	}
+	//! Check for the string is empty
+	bool empty() const {
+		return _size == 0;
+	}
+	//! Get the first character
+	const char* begin() const {
+		return _data;
+	}
+	//! Get the character after the last one
+	const char* end() const {
+		return _data + _size;
+	}
+	//! Get the character
+	char operator[](size_t i) const {
+		return _data[i];
+	}
+	//! Copy the characters into the string
+	std::string str() const {
+		return std::string(_data, _size);
+	}
+	//! Compare the strings
+	/*!
+		\returns the negative value, zero or the positive value if the
+		string is less, equal or greater than the string given
+	*/
+	int compare(const string_ref &s) const {
+		int rslt = memcmp(_data, s._data, _size < s._size ? _size : s._size);
+		if (rslt != 0)
+			return rslt;
+		return _size < s._size ? -1 : (_size > s._size ? 1 : 0);
+	}
+	//! Compare the strings ignoring the case of the ASCII letters
+	bool equals_nocase(const string_ref &s) const {
+		if (_size != s._size)
+			return false;
+		for (size_t i = 0; i < _size; i++) {
+			char a = _data[i], b = s._data[i];
+			if (a != b && (a | 0x20) != (b | 0x20))
+				return false;
+			if (a != b && ((a | 0x20) < 'a' || (a | 0x20) > 'z'))
+				return false;
+		}
+		return true;
+	}
+private:
+	const char *_data;
+	size_t _size;
+};
+
+inline bool operator==(const string_ref &a, const string_ref &b) {
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+inline bool operator!=(const string_ref &a, const string_ref &b) {
+	return !(a == b);
+}
+
+inline bool operator<(const string_ref &a, const string_ref &b) {
+	return a.compare(b) < 0;
+}
+
+inline std::ostream& operator<<(std::ostream &out, const string_ref &s) {
+	return out.write(s.data(), s.size());
+}
+
+} // namespace
+
+#endif /*_STRING_REF_H_*/
@@ -27,15 +27,26 @@
 #include <string>
 #include <iostream>
 
-#include <dcl/datetime.h>
 #include <dcl/delegate.h>
-#include <dcl/event.h>
+#include <dcl/io_buffer.h>
+#include <dcl/mpmc_queue.h>
 #include <dcl/mutex.h>
+#include <dcl/reactor.h>
+#include <dcl/semaphore.h>
 #include <dcl/socket.h>
+#include <dcl/strutils.h>
 #include <dcl/thread.h>
+#include <dcl/timer_wheel.h>
 
 namespace dbp {
 
+//! TCP server exception class
+class tcp_server_exception: public exception {
+public:
+	//! Constructor
+	tcp_server_exception(const std::string &msg = "") noexcept: exception(msg) { }
+};
+
 //!	TCP Server class
 /*!
 	This class provides generic TCP server features: it listens on
@@ -44,9 +55,15 @@ namespace dbp {
 	interaction with the client is doing by events.
 	
 	The server is asynchronous and multithreaded: one thread is
-	listening the port; working threads are deal with data. There
-	is the pool of incoming connections - the maximum number of
-	active clients.
+	listening the port and does all the socket input/output; working
+	threads are deal with data. There is the pool of incoming
+	connections - the maximum number of active clients.
+
+	The input/output thread waits for the socket events by the reactor
+	(epoll on Linux, select() elsewhere); every connection is registered
+	once on accept, so the idle connections cost nothing. Several
+	input/output threads can be started to scale over CPU cores, see
+	io_threads().
 */
 class tcp_server {
 public:
@@ -58,6 +75,58 @@ public:
 	typedef delegate3<const socket&, std::istream&, std::ostream&,
 	  bool> on_process_data_handler;
 	typedef delegate1<const dbp::exception&, void> on_exception_handler;
+	//! Connection attachment
+	/*!
+		The base class of the user data attached to the connection (see
+		attach()). The data is destroyed with the connection.
+	*/
+	class attachment {
+	public:
+		virtual ~attachment() { }
+	};
+	//! Completion of the connection processing suspended
+	/*!
+		The object is returned by suspend(), it is copied by value and
+		the copies refer to the same connection. The connection is
+		processed again when the completion is completed, or when all
+		the copies are destroyed.
+	*/
+	class completion {
+		friend class tcp_server;
+	public:
+		//! Constructor
+		completion(): s(NULL) { }
+		//! Copy constructor
+		completion(const completion &src);
+		//! Assignment operator
+		completion& operator=(const completion &src);
+		//! Destructor
+		~completion();
+		//! Process the connection again
+		/*!
+			May be called from any thread. Does nothing if the
+			connection is completed or closed already.
+		*/
+		void complete();
+		//! Check for the completion refers to no connection
+		bool empty() const {
+			return s == NULL;
+		}
+	private:
+		struct state;
+		state *s;
+		explicit completion(state *value);
+		void release();
+	};
+	//! The overloaded server behaviour
+	enum admission_policy {
+		//! Stop accepting the connections until some are closed; the
+		//! clients are waiting in the listen backlog
+		pause_accept,
+		//! Accept the connections and close them at once, sending the
+		//! overload_response() if any
+		reject_connections
+	};
 	//! Constructor
 	tcp_server(size_t worker_threads = 2, size_t queue_size = 32768);
 	//! Destructor
@@ -67,10 +136,114 @@ public:
 		return _timeout;
 	}
 	//! Set timeout value
+	/*!
+		Sets the time (in seconds) the idle connection is kept open. The zero
+		value disables the timeout.
+	*/
 	tcp_server& timeout(int value) {
 		_timeout = value;
 		return *this;
 	}
+	//! Get read timeout value
+	int read_timeout() {
+		return _read_timeout;
+	}
+	//! Set read timeout value
+	/*!
+		Sets the time (in seconds) the client is given to complete the
+		request, when the data received is not processed yet (for example,
+		the request headers are not received completely). The zero value
+		disables the timeout.
+	*/
+	tcp_server& read_timeout(int value) {
+		_read_timeout = value;
+		return *this;
+	}
+	//! Get write timeout value
+	int write_timeout() {
+		return _write_timeout;
+	}
+	//! Set write timeout value
+	/*!
+		Sets the time (in seconds) the client is given to receive the data
+		sent, when it does not read the data any more. The zero value
+		disables the timeout.
+	*/
+	tcp_server& write_timeout(int value) {
+		_write_timeout = value;
+		return *this;
+	}
+	//! Get input/output events backend
+	reactor::backend io_backend() {
+		return _backend;
+	}
+	//! Set input/output events backend
+	/*!
+		Selects the event demultiplexing backend. Should be called before
+		the server is started.
+	*/
+	tcp_server& io_backend(reactor::backend value) {
+		_backend = value;
+		return *this;
+	}
+	//! Get the overload admission policy
+	admission_policy admission() {
+		return _admission;
+	}
+	//! Set the overload admission policy
+	/*!
+		Selects what to do with the new connections when the maximum number
+		of active connections (the queue size) is reached.
+	*/
+	tcp_server& admission(admission_policy value) {
+		_admission = value;
+		return *this;
+	}
+	//! Get the overload response
+	const std::string& overload_response() {
+		return _overload_response;
+	}
+	//! Set the overload response
+	/*!
+		Sets the data sent to the connections rejected by the
+		reject_connections admission policy.
+	*/
+	tcp_server& overload_response(const std::string &value) {
+		_overload_response = value;
+		return *this;
+	}
+	//! Get the write buffer high-water mark
+	size_t write_high_water() {
+		return _write_high_water;
+	}
+	//! Set the write buffer high-water mark
+	/*!
+		When the data waiting to be sent to the client exceeds the size
+		given (in bytes), the server stops to read the client requests until
+		the half of the data is sent. The zero value disables the limit.
+	*/
+	tcp_server& write_high_water(size_t value) {
+		_write_high_water = value;
+		return *this;
+	}
+	//! Get the number of input/output threads
+	size_t io_threads() {
+		return _io_threads;
+	}
+	//! Set the number of input/output threads
+	/*!
+		Starts the given number of input/output loops. Each loop gets its
+		own listen socket bound to the same address (by SO_REUSEPORT, so
+		the kernel balances the incoming connections between them), its own
+		connections and its own part of the working threads. The working
+		threads are not added for the loops: the number of the loops
+		started does not exceed the number of the working threads. Should
+		be called before the server is started.
+	*/
+	tcp_server& io_threads(size_t value) {
+		_io_threads = value > 0 ? value : 1;
+		return *this;
+	}
 	//! Start the server
 	/*!
 		Starts the socket listening and processes the requests. The listening
@@ -123,9 +296,66 @@ public:
 	void on_exception(on_exception_handler handler) {
 		exception_handler = handler;
 	}
+	//! Process the connection again when the output is sent
+	/*!
+		The data processing handler calls this function to be called
+		again when the data written to the output stream is (nearly) sent
+		to the client, even if no data is received. This allows to produce
+		the large output by parts, keeping the memory used bounded.
+
+		\param out the output stream passed to the handler
+	*/
+	static void resume_on_drain(std::ostream &out);
+	//! Suspend the processing of the connection
+	/*!
+		The data processing handler calls this function to return at
+		once, without the response ready: the connection is not
+		processed, and its requests are not read, until the completion
+		returned is completed from any thread. Then the handler is
+		called again, as it is by resume_on_drain(). So the working
+		threads are not blocked by the slow backends, and the small pool
+		of them serves many requests waiting at once.
+
+		The connection suspended is not timed out, and the client closing
+		it is noticed when it is processed again.
+
+		\param in the input stream passed to the handler
+		\returns the completion of the connection
+	*/
+	static completion suspend(std::istream &in);
+	//! Attach the user data to the connection
+	/*!
+		The handlers use the attachment to keep the state of the
+		connection between the calls. The data attached before is
+		destroyed.
+
+		\param in the input stream passed to the handler
+		\param data the data to attach, owned by the connection now
+	*/
+	static void attach(std::istream &in, attachment *data);
+	//! Get the user data attached to the connection
+	/*!
+		\param in the input stream passed to the handler
+		\returns the data attached, or NULL
+	*/
+	static attachment* attached(std::istream &in);
+	//! Get the user data attached to the connection
+	/*!
+		\param in the input stream passed to the handler
+		\returns the data attached, or NULL
+	*/
+	template<class T>
+	static T* attached(std::istream &in) {
+		return static_cast<T*>(attached(in));
+	}
 private:
 	// Options
-	int _timeout;
+	int _timeout, _read_timeout, _write_timeout;
+	reactor::backend _backend;
+	size_t _io_threads;
+	admission_policy _admission;
+	std::string _overload_response;
+	size_t _write_high_water;
 	// Stop flag
 	bool is_stopped;
 	// Parameters
@@ -134,41 +364,116 @@ private:
 	// Listen sockets
 	typedef std::vector<socket> sockets;
 	sockets listen_sockets;
-	// Listen thread
-	thread lt;
 	// Requests queue
+	struct request;
+	typedef std::list<request*> active_requests;
 	struct request {
 		enum states {
 			WAIT_DATA,
-			TIME_OUT,
 			CLOSING
 		};
-		request(socket *conn): cur_state(WAIT_DATA), last_state(WAIT_DATA),
-		  connection(conn) {
-			read_buffer.setstate(std::ios::eofbit);
-			write_buffer.setstate(std::ios::eofbit);
-		}
-		~request() {
-			connection->shutdown();
-			delete connection;
+		enum deadlines {
+			NO_DEADLINE,
+			IDLE_DEADLINE,
+			READ_DEADLINE,
+			WRITE_DEADLINE
+		};
+		request(socket *conn): cur_state(WAIT_DATA), connection(conn),
+		  data(NULL), busy(false), can_read(false), can_write(false),
+		  read_wait(socket::in), write_wait(socket::out), throttled(false), resume(false), suspension(NULL),
+		  deadline(this), deadline_type(NO_DEADLINE), read_started(0) {
+			read_buffer.pword(request_index) = this;
 		}
-		states cur_state, last_state;
+		~request();
+		// release the processing suspended, so its completion does
+		// nothing
+		void release();
+		states cur_state;
 		socket *connection;
-		std::stringstream read_buffer, write_buffer;
-		datetime last_access;
+		// the user data attached
+		attachment *data;
+		io_stream read_buffer, write_buffer;
+		// the request is processing by a working thread
+		bool busy;
+		// the socket is ready to read or write (until drained)
+		bool can_read, can_write;
+		// the directions the reading and the writing wait for (the SSL
+		// socket may write to read, or read to write)
+		socket::direction read_wait, write_wait;
+		// check for the socket is ready for the direction
+		bool ready(socket::direction d) const {
+			return d == socket::in ? can_read : can_write;
+		}
+		// do not read until the output is drained
+		bool throttled;
+		// process the connection when the output is drained
+		bool resume;
+		// the processing suspended by the handler
+		completion::state *suspension;
+		// the position in the active requests list
+		active_requests::iterator pos;
+		// the idle, read or write timeout
+		timer deadline;
+		deadlines deadline_type;
+		// the time the incomplete request is started to receive
+		uint64_t read_started;
 	};
-	// Active requests
-	typedef std::list<request*> active_requests;
-	active_requests a_reqs;
-	// Processing requests
-	typedef std::queue<request*> requests;
-	requests reqs;
+	// the index of the input stream link to the request
+	static const int request_index;
+	// Requests handed over between the input/output and working threads
+	typedef mpmc_queue<request*> requests;
 	// Worker threads
 	typedef std::vector<thread> threads;
-	threads wkt;
+	// Input/output loop
+	/*
+		Every loop owns its listen sockets, the events demultiplexer,
+		the connections accepted and the working threads processing
+		them, so the loops share nothing but the handlers.
+
+		The requests are passed to the working threads and back through
+		the lock-free queues; the parked working threads are woken one by
+		one by the semaphore, one per request queued.
+	*/
+	struct io_loop {
+		io_loop(tcp_server &srv, size_t worker_threads, size_t queue_size);
+		tcp_server &server;
+		// Listen thread
+		thread lt;
+		// Worker threads
+		threads wkt;
+		// Listen sockets (owned by the server)
+		std::vector<socket*> listeners;
+		// Socket events demultiplexer
+		reactor *_reactor;
+		// Connection timeouts
+		timer_wheel timers;
+		// Active requests (owned by the input/output thread)
+		active_requests a_reqs;
+		size_t queue_size;
+		// Do not accept new connections until some are closed
+		bool accept_paused;
+		// Stop flag (accessed atomically)
+		int is_stopped;
+		// The input/output thread is waiting for events (accessed atomically)
+		int is_waiting;
+		// Requests ready to process
+		requests reqs;
+		// Processed requests to return to the input/output thread
+		requests done_reqs;
+		// The number of requests ready to process
+		semaphore ready;
+		// Thread entry points
+		void io_process(thread_int&) {
+			server.io_process(*this);
+		}
+		void working_process(thread_int&) {
+			server.working_process(*this);
+		}
+	};
+	typedef std::vector<io_loop*> io_loops;
+	io_loops loops;
 	// Synchronization
 	mutex _lock;
-	event _event;
 	// Custom handlers
 	on_io_handler create_io_handler;
 	on_connect_handler connect_handler;
@@ -176,13 +481,21 @@ private:
 	on_process_data_handler process_data_handler;
 	on_exception_handler exception_handler;
 	// Process handlers
-	void io_process(thread_int&);
-	void working_process(thread_int&);
+	void io_process(io_loop &l);
+	void working_process(io_loop &l);
 	// Utility functions
-	void connection_accept(socket &s);
-	void connection_write(request &r);
-	void connection_read(request &r);
-	void disconnect_client(request*);
+	void bind_listeners(const strings &addrs);
+	socket* listen_socket(io_loop &l, void *data);
+	void connection_accept(io_loop &l, socket &s);
+	void suspend_accept(io_loop &l, bool state);
+	void connection_process(io_loop &l, request &r);
+	bool connection_write(io_loop &l, request &r);
+	bool connection_read(io_loop &l, request &r);
+	void connection_wait(io_loop &l, request &r, socket::direction d);
+	void connection_done(io_loop &l, request *r);
+	bool connection_park(io_loop &l, request *r, bool closing);
+	void connection_timer(io_loop &l, request &r, bool progress);
+	void disconnect_client(io_loop &l, request*);
 };
 
 }
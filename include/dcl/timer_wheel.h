@@ -0,0 +1,139 @@
+/*
+ * timer_wheel.h
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include <dcl/noncopyable.h>
+
+namespace dbp {
+
+class timer_wheel;
+
+//! Timer of the timer wheel
+/*!
+	The timer is the node of the timer wheel list; the object owning the
+	timer embeds it, so arming and cancelling the timer allocates nothing.
+	The timer is cancelled on destruction.
+*/
+class timer: public noncopyable {
+	friend class timer_wheel;
+public:
+	//! Constructor
+	/*!
+		\param data the user data associated with the timer
+	*/
+	timer(void *data = NULL): data(data), wheel(NULL), next(NULL),
+	  pprev(NULL), expires(0) { }
+	//! Destructor
+	~timer();
+	//! Check for the timer is armed
+	bool is_armed() const {
+		return wheel != NULL;
+	}
+	//! The user data
+	void *data;
+private:
+	timer_wheel *wheel;
+	// the list links: the next timer and the link pointing to this one
+	timer *next, **pprev;
+	uint64_t expires;
+};
+
+//! Hierarchical timer wheel
+/*!
+	The timer wheel tracks a large number of timeouts with O(1) arming and
+	cancelling. The time is measured by the monotonic clock and counted in
+	ticks; the timers expiring far away are kept in the coarse wheels and
+	moved to the finer ones as the time goes.
+
+	The wheel is not thread safe and is intended to be driven by the event
+	loop: wait for the events no longer than next_timeout(), then call
+	expire() to obtain the timers fired.
+*/
+class timer_wheel: public noncopyable {
+public:
+	typedef std::vector<timer*> timers;
+	//! Constructor
+	/*!
+		\param resolution the tick duration in milliseconds
+	*/
+	timer_wheel(unsigned int resolution = 100);
+	//! Destructor
+	~timer_wheel();
+	//! Arm the timer
+	/*!
+		Arms (or rearms) the timer to expire after the timeout given. The
+		timeout is rounded up to the tick duration.
+
+		\param t the timer to arm
+		\param timeout the timeout in milliseconds
+	*/
+	void arm(timer &t, unsigned int timeout);
+	//! Cancel the timer
+	void cancel(timer &t);
+	//! Get the number of armed timers
+	size_t size() const {
+		return count;
+	}
+	//! Get the time to wait for the next timer expiration
+	/*!
+		\returns the time in milliseconds, or -1 if no timers are armed
+	*/
+	int next_timeout();
+	//! Obtain the timers expired
+	/*!
+		Advances the wheel to the current time and returns the timers
+		expired. The timers returned are cancelled.
+
+		\param expired the list to append the timers expired to
+	*/
+	void expire(timers &expired);
+	//! Get the monotonic clock value
+	/*!
+		\returns the time in milliseconds from some unspecified point
+	*/
+	static uint64_t now();
+private:
+	enum {
+		wheel_bits = 6,
+		wheel_size = 1 << wheel_bits,
+		wheel_mask = wheel_size - 1,
+		wheels = 4
+	};
+	// the lists of the timers
+	timer *slots[wheels][wheel_size];
+	unsigned int resolution;
+	// the current tick and its start time
+	uint64_t tick, tick_time;
+	size_t count;
+	void link(timer &t);
+	void unlink(timer &t);
+	void cascade(int wheel);
+};
+
+} // namespace
+
+#endif /*_TIMER_WHEEL_H_*/
@@ -0,0 +1,131 @@
+/*
+ * epoll_reactor.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <dcl/reactor.h>
+#include <dcl/strutils.h>
+
+namespace dbp {
+namespace local {
+
+using namespace std;
+
+// The initial and the maximum number of events fetched per wait
+#define EPOLL_EVENTS_MIN 64
+#define EPOLL_EVENTS_MAX 4096
+
+class epoll_reactor_impl: public reactor_int {
+public:
+	epoll_reactor_impl(): buf(EPOLL_EVENTS_MIN) {
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0)
+			throw reactor_exception(_("can't create the reactor"));
+		// the eventfd is used to interrupt the epoll_wait() call
+		wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (wakeup < 0) {
+			::close(epoll_fd);
+			throw reactor_exception(_("can't create the reactor"));
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = &wakeup;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup, &ev) < 0) {
+			::close(wakeup);
+			::close(epoll_fd);
+			throw reactor_exception(_("can't create the reactor"));
+		}
+	}
+	virtual ~epoll_reactor_impl() {
+		::close(wakeup);
+		::close(epoll_fd);
+	}
+	virtual void add(int handle, int events, void *data) {
+		control(EPOLL_CTL_ADD, handle, events, data);
+	}
+	virtual void modify(int handle, int events, void *data) {
+		control(EPOLL_CTL_MOD, handle, events, data);
+	}
+	virtual void remove(int handle) {
+		// the handle may be already closed; nothing to do then
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, handle, NULL);
+	}
+	virtual void rearm(int, int) {
+		// the kernel tracks readiness changes itself
+	}
+	virtual void wait(int timeout, reactor_events &events) {
+		events.clear();
+		int n = epoll_wait(epoll_fd, &buf[0], buf.size(), timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				return;
+			throw reactor_exception(_("can't wait for input/output events"));
+		}
+		for (int i = 0; i < n; i++) {
+			if (buf[i].data.ptr == &wakeup) {
+				uint64_t value;
+				while (::read(wakeup, &value, sizeof(value)) > 0) { }
+				continue;
+			}
+			reactor_event e;
+			e.data = buf[i].data.ptr;
+			e.events = reactor::none;
+			if (buf[i].events & (EPOLLIN | EPOLLRDHUP))
+				e.events |= reactor::read;
+			if (buf[i].events & EPOLLOUT)
+				e.events |= reactor::write;
+			// let the caller to detect the error by reading or writing
+			if (buf[i].events & (EPOLLERR | EPOLLHUP))
+				e.events |= reactor::read | reactor::write | reactor::error;
+			events.push_back(e);
+		}
+		// grow the events buffer under high load
+		if (size_t(n) == buf.size() && buf.size() < EPOLL_EVENTS_MAX)
+			buf.resize(buf.size() * 2);
+	}
+	virtual void interrupt() {
+		uint64_t value = 1;
+		if (::write(wakeup, &value, sizeof(value)) < 0) {
+			// the counter is overflowed, so the reactor is already interrupted
+		}
+	}
+private:
+	int epoll_fd;
+	int wakeup;
+	std::vector<struct epoll_event> buf;
+	void control(int op, int handle, int events, void *data) {
+		struct epoll_event ev;
+		ev.events = EPOLLET | EPOLLRDHUP;
+		if (events & reactor::read)
+			ev.events |= EPOLLIN;
+		if (events & reactor::write)
+			ev.events |= EPOLLOUT;
+		ev.data.ptr = data;
+		if (epoll_ctl(epoll_fd, op, handle, &ev) < 0)
+			throw reactor_exception(_("can't watch the socket events"));
+	}
+};
+
+}} // namespace
@@ -19,11 +19,19 @@
  * Boston, MA  02110-1301  USA
  */
 
+#include <list>
+#include <map>
+
+#include <dcl/i18n.h>
+#include <dcl/mutex.h>
 #include <dcl/singleton.h>
 #include <dcl/ssl_socket.h>
 
 #include <gcrypt.h>
 #include <gnutls/gnutls.h>
+#if GNUTLS_VERSION_NUMBER >= 0x030703
+#include <gnutls/socket.h>
+#endif
 
 namespace dbp {
 
@@ -50,30 +58,268 @@ private:
 	}
 };
 
+// The credentials shared by the connections, freed by the last of them
+class gnutls_credentials {
+public:
+	gnutls_credentials(): x509_cred(NULL), priority_cache(NULL),
+	  dh_params(NULL), refs(1) { }
+	void ref() {
+		__sync_add_and_fetch(&refs, 1);
+	}
+	void unref() {
+		if (__sync_sub_and_fetch(&refs, 1) == 0)
+			delete this;
+	}
+	gnutls_certificate_credentials_t x509_cred;
+	gnutls_priority_t priority_cache;
+	gnutls_dh_params_t dh_params;
+private:
+	int refs;
+	~gnutls_credentials() {
+		if (x509_cred)
+			gnutls_certificate_free_credentials(x509_cred);
+		if (priority_cache)
+			gnutls_priority_deinit(priority_cache);
+		if (dh_params)
+			gnutls_dh_params_deinit(dh_params);
+	}
+};
+
+// The sessions to be resumed, shared by the connections
+class gnutls_sessions {
+public:
+	gnutls_sessions(size_t cache_size, int timeout, bool tickets):
+	  cache_size(cache_size), timeout(timeout), tickets(tickets), refs(1) {
+		ticket_key.data = NULL;
+		ticket_key.size = 0;
+#if GNUTLS_VERSION_NUMBER >= 0x020a00
+		if (tickets)
+			gnutls_session_ticket_key_generate(&ticket_key);
+#endif
+	}
+	void ref() {
+		__sync_add_and_fetch(&refs, 1);
+	}
+	void unref() {
+		if (__sync_sub_and_fetch(&refs, 1) == 0)
+			delete this;
+	}
+	//! Set up the session to be resumed
+	void setup(gnutls_session_t session) {
+		if (cache_size > 0) {
+			gnutls_db_set_ptr(session, this);
+			gnutls_db_set_store_function(session, store);
+			gnutls_db_set_retrieve_function(session, retrieve);
+			gnutls_db_set_remove_function(session, remove);
+			gnutls_db_set_cache_expiration(session, timeout);
+		}
+#if GNUTLS_VERSION_NUMBER >= 0x020a00
+		if (ticket_key.data)
+			gnutls_session_ticket_enable_server(session, &ticket_key);
+#endif
+	}
+	const size_t cache_size;
+	const int timeout;
+	const bool tickets;
+private:
+	int refs;
+	// the key the session tickets are encrypted with
+	gnutls_datum_t ticket_key;
+	mutex lock;
+	map<string, string> sessions;
+	// the order of the sessions stored, the oldest are removed first
+	list<string> order;
+	~gnutls_sessions() {
+		if (ticket_key.data)
+			gnutls_free(ticket_key.data);
+	}
+	static int store(void *ptr, gnutls_datum_t key, gnutls_datum_t data) {
+		gnutls_sessions *s = static_cast<gnutls_sessions*>(ptr);
+		string k((const char*)key.data, key.size);
+		s->lock.enter();
+		if (s->sessions.find(k) == s->sessions.end()) {
+			while (s->sessions.size() >= s->cache_size) {
+				s->sessions.erase(s->order.front());
+				s->order.pop_front();
+			}
+			s->order.push_back(k);
+		}
+		s->sessions[k].assign((const char*)data.data, data.size);
+		s->lock.leave();
+		return 0;
+	}
+	static gnutls_datum_t retrieve(void *ptr, gnutls_datum_t key) {
+		gnutls_sessions *s = static_cast<gnutls_sessions*>(ptr);
+		gnutls_datum_t rslt = { NULL, 0 };
+		s->lock.enter();
+		map<string, string>::const_iterator i = s->sessions.find(
+		  string((const char*)key.data, key.size));
+		// the data returned is freed by GnuTLS
+		if (i != s->sessions.end()) {
+			rslt.data = (unsigned char*)gnutls_malloc(i->second.size());
+			if (rslt.data) {
+				i->second.copy((char*)rslt.data, i->second.size());
+				rslt.size = i->second.size();
+			}
+		}
+		s->lock.leave();
+		return rslt;
+	}
+	static int remove(void *ptr, gnutls_datum_t key) {
+		gnutls_sessions *s = static_cast<gnutls_sessions*>(ptr);
+		string k((const char*)key.data, key.size);
+		s->lock.enter();
+		bool found = s->sessions.erase(k) > 0;
+		if (found)
+			s->order.remove(k);
+		s->lock.leave();
+		return found ? 0 : -1;
+	}
+};
+
+class ssl_context_impl {
+public:
+	ssl_context_impl(): cache_size(SESSION_CACHE_SIZE),
+	  timeout(SESSION_TIMEOUT), tickets(true), ktls(false), creds(NULL),
+	  sessions(NULL) {
+		gnutls_init::instance();
+	}
+	~ssl_context_impl() {
+		if (creds)
+			creds->unref();
+		if (sessions)
+			sessions->unref();
+	}
+	//! Load certificates from files
+	void load_certificates(
+	  const std::string &ca,
+	  const std::string &cert, const std::string &key,
+	  const std::string &crl) {
+		loading.enter();
+		gnutls_credentials *c = new gnutls_credentials();
+		int ret = gnutls_certificate_allocate_credentials(&c->x509_cred);
+		if (ret >= 0 && !ca.empty())
+			ret = gnutls_certificate_set_x509_trust_file(c->x509_cred,
+			  ca.c_str(), GNUTLS_X509_FMT_PEM);
+		if (ret >= 0 && !crl.empty())
+			ret = gnutls_certificate_set_x509_crl_file(c->x509_cred,
+			  crl.c_str(), GNUTLS_X509_FMT_PEM);
+		if (ret >= 0)
+			ret = cert.empty() || key.empty() ? GNUTLS_E_FILE_ERROR :
+			  gnutls_certificate_set_x509_key_file(c->x509_cred,
+			  cert.c_str(), key.c_str(), GNUTLS_X509_FMT_PEM);
+		if (ret >= 0)
+			ret = gnutls_priority_init(&c->priority_cache, "NORMAL", NULL);
+		if (ret < 0) {
+			c->unref();
+			loading.leave();
+			throw socket_exception(_("can't load certificate file"));
+		}
+#if GNUTLS_VERSION_NUMBER >= 0x030506
+		gnutls_certificate_set_known_dh_params(c->x509_cred,
+		  GNUTLS_SEC_PARAM_MEDIUM);
+#else
+		gnutls_dh_params_init(&c->dh_params);
+		gnutls_dh_params_generate2(c->dh_params, DH_BITS);
+		gnutls_certificate_set_dh_params(c->x509_cred, c->dh_params);
+#endif
+		// the connections established keep the old credentials; the
+		// sessions are kept unless their settings are changed
+		lock.enter();
+		gnutls_credentials *old = creds;
+		creds = c;
+		gnutls_sessions *old_sessions = NULL;
+		if (!sessions || sessions->cache_size != cache_size ||
+		  sessions->timeout != timeout || sessions->tickets != tickets) {
+			old_sessions = sessions;
+			sessions = new gnutls_sessions(cache_size, timeout, tickets);
+		}
+		ca_file = ca;
+		cert_file = cert;
+		key_file = key;
+		crl_file = crl;
+		lock.leave();
+		loading.leave();
+		if (old)
+			old->unref();
+		if (old_sessions)
+			old_sessions->unref();
+	}
+	//! Reload certificates from the same files
+	void reload() {
+		lock.enter();
+		string ca = ca_file, cert = cert_file, key = key_file,
+		  crl = crl_file;
+		lock.leave();
+		load_certificates(ca, cert, key, crl);
+	}
+	//! Get the current credentials and sessions, referenced
+	void acquire(gnutls_credentials *&c, gnutls_sessions *&s) {
+		lock.enter();
+		c = creds;
+		s = sessions;
+		if (c) {
+			c->ref();
+			s->ref();
+		}
+		lock.leave();
+		if (!c)
+			throw socket_exception(_("can't initialize SSL context"));
+	}
+	size_t cache_size;
+	int timeout;
+	bool tickets;
+	// enabled by the system configuration of GnuTLS
+	bool ktls;
+private:
+	mutex lock, loading;
+	gnutls_credentials *creds;
+	gnutls_sessions *sessions;
+	string ca_file, cert_file, key_file, crl_file;
+};
+
 class ssl_socket_impl: public socket {
 public:
 	//! Constructor
 	ssl_socket_impl(const socket &src): socket(src), need_handshake(true),
-	  x509_cred(NULL) {
+	  x509_cred(NULL), creds(NULL), sessions(NULL) {
 		gnutls_init::instance();
 		gnutls_dh_params_init(&dh_params);
 		gnutls_dh_params_generate2(dh_params, DH_BITS);
 		gnutls_priority_init(&priority_cache, "NORMAL", NULL);
 		::gnutls_init(&session, GNUTLS_SERVER);
 		gnutls_priority_set(session, priority_cache);
-		gnutls_certificate_server_set_request(session, GNUTLS_CERT_REQUEST);
-		gnutls_session_enable_compatibility_mode(session);
-		if (socket_fd >= 0)
-			gnutls_transport_set_ptr(session,
-			  (gnutls_transport_ptr_t)socket_fd);
+		init();
+	}
+	//! Constructor
+	/*!
+		The connection refers the credentials shared, so these are not
+		freed by the reload until the connection is closed.
+	*/
+	ssl_socket_impl(const socket &src, ssl_context_impl &shared):
+	  socket(src), need_handshake(true), x509_cred(NULL),
+	  priority_cache(NULL), dh_params(NULL) {
+		shared.acquire(creds, sessions);
+		::gnutls_init(&session, GNUTLS_SERVER);
+		gnutls_priority_set(session, creds->priority_cache);
+		gnutls_credentials_set(session, GNUTLS_CRD_CERTIFICATE,
+		  creds->x509_cred);
+		sessions->setup(session);
+		init();
 	}
 	//!	Destructor
 	virtual ~ssl_socket_impl() {
 		if (x509_cred)
 			gnutls_certificate_free_credentials(x509_cred);
 		gnutls_deinit(session);
-		gnutls_priority_deinit(priority_cache);
-		gnutls_dh_params_deinit(dh_params);
+		if (priority_cache)
+			gnutls_priority_deinit(priority_cache);
+		if (dh_params)
+			gnutls_dh_params_deinit(dh_params);
+		if (creds)
+			creds->unref();
+		if (sessions)
+			sessions->unref();
 	}
 	//! Load certificates from files
 	void load_certificates(
@@ -100,43 +346,97 @@ public:
 	}
 	virtual int read(int bytes_to_read, char *buffer) {
 		if (need_handshake) {
-			int ret = gnutls_handshake(session);
-			if (ret < 0)
-				return gnutls_error_is_fatal(ret) ? socket::io_error :
-				  socket::data_not_ready;
-			need_handshake = false;
+			int rslt = handshake();
+			if (rslt < 0)
+				return rslt;
 		}
 		int nsize = gnutls_record_recv(session, buffer, bytes_to_read);
-		if (nsize == GNUTLS_E_AGAIN || nsize == GNUTLS_E_INTERRUPTED)
-			return socket::data_not_ready;
-		if (nsize >= 0)
-			return nsize;
-		return socket::io_error;
+		// the client asks for the new handshake
+		if (nsize == GNUTLS_E_REHANDSHAKE) {
+			need_handshake = true;
+			int rslt = handshake();
+			return rslt < 0 ? rslt : int(socket::data_not_ready);
+		}
+		return result(nsize);
 	}
 	virtual int write(int bytes_to_write, const char *buffer) {
 		if (need_handshake) {
-			int ret = gnutls_handshake(session);
-			if (ret < 0)
-				return gnutls_error_is_fatal(ret) ? socket::io_error :
-				  socket::data_not_ready;
-			need_handshake = false;
+			int rslt = handshake();
+			if (rslt < 0)
+				return rslt;
 		}
-		int nsize = gnutls_record_send(session, buffer, bytes_to_write);
-		if (nsize == GNUTLS_E_AGAIN || nsize == GNUTLS_E_INTERRUPTED)
-			return socket::data_not_ready;
-		if (nsize >= 0)
-			return nsize;
-		return socket::io_error;
+		if (bytes_to_write <= 0)
+			return 0;
+		return result(gnutls_record_send(session, buffer, bytes_to_write));
 	}
 	virtual void shutdown() {
-		gnutls_bye(session, GNUTLS_SHUT_WR);
+		// the close notification is sent if possible, the connection
+		// is not waited for the reply
+		if (!need_handshake)
+			gnutls_bye(session, GNUTLS_SHUT_WR);
+	}
+	virtual direction blocked_on(direction op) const {
+		return wants ? wants : op;
+	}
+	//! Do the handshake
+	int handshake() {
+		if (!need_handshake)
+			return 0;
+		// the warnings received are skipped
+		int rslt;
+		do
+			rslt = gnutls_handshake(session);
+		while (rslt < 0 && rslt != GNUTLS_E_AGAIN &&
+		  !gnutls_error_is_fatal(rslt));
+		rslt = result(rslt);
+		if (rslt < 0)
+			return rslt;
+		need_handshake = false;
+		return 0;
+	}
+	//! Check for the handshake is done
+	bool is_established() const {
+		return !need_handshake;
+	}
+	//! Check for the data sent is encrypted by the kernel
+	bool is_kernel_tls() const {
+#if GNUTLS_VERSION_NUMBER >= 0x030703
+		return !need_handshake &&
+		  (gnutls_transport_is_ktls_enabled(session) & GNUTLS_KTLS_SEND);
+#else
+		return false;
+#endif
 	}
 private:
 	bool need_handshake;
+	// the direction the blocked operation waits for, if not its own
+	direction wants;
 	gnutls_certificate_credentials_t x509_cred;
 	gnutls_session_t session;
 	gnutls_priority_t priority_cache;
 	gnutls_dh_params_t dh_params;
+	// the credentials and the sessions of the context shared
+	gnutls_credentials *creds;
+	gnutls_sessions *sessions;
+	// Get the result of the operation
+	int result(int rslt) {
+		wants = direction(0);
+		if (rslt >= 0)
+			return rslt;
+		if (rslt == GNUTLS_E_AGAIN || rslt == GNUTLS_E_INTERRUPTED) {
+			wants = gnutls_record_get_direction(session) ? out : in;
+			return socket::data_not_ready;
+		}
+		return socket::io_error;
+	}
+	void init() {
+		wants = direction(0);
+		gnutls_certificate_server_set_request(session, GNUTLS_CERT_REQUEST);
+		gnutls_session_enable_compatibility_mode(session);
+		if (socket_fd >= 0)
+			gnutls_transport_set_ptr(session,
+			  (gnutls_transport_ptr_t)socket_fd);
+	}
 };
 
 } // namespace
@@ -0,0 +1,269 @@
+/*
+ * http_body.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include <dcl/filefs.h>
+#include <dcl/http_body.h>
+#include <dcl/i18n.h>
+
+namespace dbp {
+
+using namespace std;
+
+namespace {
+
+const string& temp_dir() {
+	static const string dir = filefs().get_temp_dir();
+	return dir;
+}
+
+} // namespace
+
+http_body::http_body(): _spool_size(default_spool_size),
+  _spool_dir(temp_dir()), _size(0), mapped(NULL), mapped_size(0) { }
+
+http_body::http_body(const http_body &src): _spool_size(src._spool_size),
+  _spool_dir(src._spool_dir), _size(src._size),
+  inline_data(src.inline_data), _file(src._file), shared(src.shared),
+  mapped(NULL), mapped_size(0) { }
+
+http_body& http_body::operator=(const http_body &src) {
+	if (this != &src) {
+		unmap();
+		_spool_size = src._spool_size;
+		_spool_dir = src._spool_dir;
+		_size = src._size;
+		inline_data = src.inline_data;
+		_file = src._file;
+		shared = src.shared;
+	}
+	return *this;
+}
+
+http_body::~http_body() {
+	unmap();
+}
+
+void http_body::reserve(uint64_t size) {
+	if (_file.handle() < 0 && size <= _spool_size)
+		inline_data.reserve(size + 1);
+}
+
+void http_body::assign(const char *data, size_t size) {
+	clear();
+	append(data, size);
+}
+
+void http_body::assign(const io_buffer &data) {
+	clear();
+	shared = data;
+	_size = shared.size();
+}
+
+void http_body::append(const char *data, size_t size) {
+	if (size == 0)
+		return;
+	unmap();
+	unshare();
+	if (_file.handle() < 0 && _size + size > _spool_size)
+		spool();
+	if (_file.handle() < 0) {
+		if (inline_data.empty())
+			inline_data.push_back(0);
+		inline_data.insert(inline_data.end() - 1, data, data + size);
+		_size += size;
+		return;
+	}
+	detach();
+	while (size > 0) {
+		int rslt = _file.write(_size, min(size, size_t(1) << 30), data);
+		if (rslt <= 0)
+			throw io_buffer_exception(strerror(errno));
+		_size += rslt;
+		data += rslt;
+		size -= rslt;
+	}
+}
+
+size_t http_body::append(std::istream &in, size_t size) {
+	size_t total = 0;
+	unshare();
+	if (_file.handle() < 0 && _size + size <= _spool_size) {
+		// the data is read in place
+		unmap();
+		if (inline_data.empty())
+			inline_data.push_back(0);
+		size_t old = inline_data.size();
+		inline_data.resize(old + size);
+		in.read(&inline_data[old - 1], size);
+		total = in.gcount();
+		inline_data.resize(old + total);
+		inline_data.back() = 0;
+		_size += total;
+		return total;
+	}
+	char buf[16384];
+	while (total < size && in) {
+		in.read(buf, min(size - total, sizeof(buf)));
+		append(buf, in.gcount());
+		total += in.gcount();
+	}
+	return total;
+}
+
+void http_body::clear() {
+	unmap();
+	vector<char>().swap(inline_data);
+	_file = io_file();
+	shared.clear();
+	_size = 0;
+}
+
+int http_body::read(uint64_t offset, size_t size, char *buffer) const {
+	if (offset >= _size)
+		return 0;
+	if (size > _size - offset)
+		size = _size - offset;
+	if (size > size_t(1) << 30)
+		size = size_t(1) << 30;
+	if (_file.handle() >= 0)
+		return _file.read(offset, size, buffer);
+	if (!shared.empty()) {
+		io_vector v[16];
+		size_t done = 0;
+		while (done < size) {
+			int n = shared.segments(16, v, offset + done);
+			if (n == 0)
+				break;
+			for (int i = 0; i < n && done < size; i++) {
+				size_t part = min(v[i].size, size - done);
+				memcpy(buffer + done, v[i].data, part);
+				done += part;
+			}
+		}
+		return done;
+	}
+	memcpy(buffer, &inline_data[offset], size);
+	return size;
+}
+
+const char* http_body::data() const {
+	// the data of the buffer is not contiguous and not terminated
+	const_cast<http_body*>(this)->unshare();
+	if (_file.handle() < 0)
+		return inline_data.empty() ? "" : &inline_data[0];
+	if (mapped)
+		return mapped;
+	// the terminating zero is stored after the body, the next data
+	// appended replaces it; the data appended to the copies is not
+	const_cast<http_body*>(this)->detach();
+	if (const_cast<io_file&>(_file).write(_size, 1, "") != 1)
+		throw io_buffer_exception(strerror(errno));
+	size_t size = _size + 1;
+#ifdef HAVE_SYS_MMAN_H
+	void *p = ::mmap(NULL, size, PROT_READ, MAP_SHARED, _file.handle(), 0);
+	if (p == MAP_FAILED)
+		throw io_buffer_exception(strerror(errno));
+	mapped = static_cast<char*>(p);
+#else
+	mapped = new char[size];
+	for (size_t done = 0; done < size; ) {
+		int rslt = _file.read(done, size - done, mapped + done);
+		if (rslt <= 0) {
+			unmap();
+			throw io_buffer_exception(_("can't read the file"));
+		}
+		done += rslt;
+	}
+#endif
+	mapped_size = size;
+	return mapped;
+}
+
+void http_body::spool() {
+	// the body kept in the memory is moved to the file
+	_file = io_file::temporary(_spool_dir);
+	size_t size = _size;
+	_size = 0;
+	vector<char> data;
+	data.swap(inline_data);
+	if (size > 0)
+		append(&data[0], size);
+}
+
+void http_body::detach() {
+	// the file shared with the copies is copied before it is written
+	if (_file.handle() < 0 || _file.unique())
+		return;
+	io_file src = _file;
+	uint64_t size = _size;
+	_file = io_file::temporary(_spool_dir);
+	_size = 0;
+	char buf[16384];
+	while (_size < size) {
+		int rslt = src.read(_size, min(uint64_t(sizeof(buf)), size - _size),
+		  buf);
+		if (rslt <= 0)
+			throw io_buffer_exception(_("can't read the file"));
+		append(buf, rslt);
+	}
+}
+
+void http_body::unshare() {
+	// the data of the buffer is copied before the body is changed
+	if (shared.empty())
+		return;
+	io_buffer src;
+	src.append(shared);
+	shared.clear();
+	_size = 0;
+	io_vector v[16];
+	int n;
+	while ((n = src.segments(16, v, _size)) > 0) {
+		for (int i = 0; i < n; i++)
+			append(v[i].data, v[i].size);
+	}
+}
+
+void http_body::unmap() const {
+	if (!mapped)
+		return;
+#ifdef HAVE_SYS_MMAN_H
+	::munmap(mapped, mapped_size);
+#else
+	delete[] mapped;
+#endif
+	mapped = NULL;
+	mapped_size = 0;
+}
+
+} // namespace
@@ -0,0 +1,564 @@
+/*
+ * http_compressor.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <set>
+#include <string.h>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#else
+#define Z_NO_FLUSH 0
+#define Z_SYNC_FLUSH 2
+#define Z_FINISH 4
+#endif
+
+#include <dcl/http_compressor.h>
+#include <dcl/mimetype.h>
+#include <dcl/mutex.h>
+
+namespace dbp {
+
+using namespace std;
+
+// The size of the content compressed at once
+#define CHUNK_SIZE 1048576
+// The size of the input read by the stream at once
+#define STREAM_INPUT_SIZE 65536
+// The number of the idle compressors kept for every coding
+#define IDLE_COMPRESSORS 16
+
+namespace {
+
+// The extensions of the files compressed already, their MIME types are
+// found in the system database
+const char *compressed_extensions[] = {
+	"gz", "tgz", "bz2", "xz", "zst", "zip", "jar", "7z", "rar", "pdf",
+	"woff", "woff2", "docx", "xlsx", "pptx", "odt", "ods", "apk", "deb",
+	"rpm"
+};
+
+// The types registered under different names in the systems
+const char *compressed_types[] = {
+	"application/gzip", "application/x-gzip", "application/x-bzip2",
+	"application/x-xz", "application/zstd", "application/zip",
+	"application/x-7z-compressed", "application/x-rar-compressed",
+	"application/pdf", "application/octet-stream", "font/woff",
+	"font/woff2", "application/font-woff"
+};
+
+bool starts_with(const string &s, const char *prefix) {
+	return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Get the MIME type of the Content-Type header value, lower case
+string media_type(const string &content_type) {
+	size_t end = content_type.find(';');
+	if (end == string::npos)
+		end = content_type.size();
+	size_t begin = 0;
+	while (begin < end && (content_type[begin] == ' ' ||
+	  content_type[begin] == '\t'))
+		begin++;
+	while (end > begin && (content_type[end - 1] == ' ' ||
+	  content_type[end - 1] == '\t'))
+		end--;
+	string rslt(content_type, begin, end - begin);
+	for (string::iterator i = rslt.begin(); i != rslt.end(); ++i) {
+		if (*i >= 'A' && *i <= 'Z')
+			*i += 'a' - 'A';
+	}
+	return rslt;
+}
+
+// Get the quality value of the list element, like "gzip;q=0.5" (RFC
+// 7231 5.3.1), in thousandths
+int quality(const char *p, const char *end) {
+	while (p != end) {
+		while (p != end && (*p == ';' || *p == ' ' || *p == '\t'))
+			p++;
+		if (end - p >= 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=') {
+			p += 2;
+			if (p == end || (*p != '0' && *p != '1'))
+				return 0;
+			int q = (*p++ - '0') * 1000;
+			if (p != end && *p == '.') {
+				int scale = 100;
+				for (p++; p != end && *p >= '0' && *p <= '9' && scale > 0;
+				  p++, scale /= 10)
+					q += (*p - '0') * scale;
+			}
+			return min(q, 1000);
+		}
+		while (p != end && *p != ';')
+			p++;
+	}
+	return 1000;
+}
+
+// The key of the content cached
+struct content_key {
+	uint64_t h1, h2, size;
+	int coding;
+	bool operator<(const content_key &k) const {
+		if (h1 != k.h1)
+			return h1 < k.h1;
+		if (h2 != k.h2)
+			return h2 < k.h2;
+		if (size != k.size)
+			return size < k.size;
+		return coding < k.coding;
+	}
+};
+
+// Hash the content by the two independent functions, so the content
+// differing has the same key by the chance of 2^-128
+content_key content_hash(const char *data, size_t size, int coding) {
+	content_key k;
+	uint64_t h1 = 14695981039346656037ULL, h2 = size;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t w;
+		memcpy(&w, data + i, 8);
+		h1 = (h1 ^ w) * 1099511628211ULL;
+		h2 += w * 0x9e3779b97f4a7c15ULL;
+		h2 = ((h2 << 31) | (h2 >> 33)) * 0xc2b2ae3d27d4eb4fULL;
+	}
+	for (; i < size; i++) {
+		h1 = (h1 ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+		h2 = (h2 + static_cast<unsigned char>(data[i])) *
+		  0x9e3779b97f4a7c15ULL;
+	}
+	k.h1 = h1;
+	k.h2 = h2 ^ (h2 >> 29);
+	k.size = size;
+	k.coding = coding;
+	return k;
+}
+
+#ifdef HAVE_ZLIB
+bool init(z_stream &z, int coding, int level) {
+	memset(&z, 0, sizeof(z));
+	// the gzip wrapper is asked by the window bits over 15
+	return deflateInit2(&z, level, Z_DEFLATED,
+	  coding == http_compressor::gzip ? 31 : 15, 8,
+	  Z_DEFAULT_STRATEGY) == Z_OK;
+}
+#endif
+
+} // namespace
+
+class http_compressor::impl {
+public:
+	impl(int compression_level, size_t cache_limit, size_t min_content):
+	  level(compression_level), cache_size(cache_limit),
+	  min_size(min_content), cached(0), hits(0) {
+		mimetype types;
+		string unknown = types("");
+		for (size_t i = 0; i < sizeof(compressed_extensions) /
+		  sizeof(compressed_extensions[0]); i++) {
+			const string &type = types(compressed_extensions[i]);
+			if (type != unknown)
+				skip.insert(media_type(type));
+		}
+		for (size_t i = 0; i < sizeof(compressed_types) /
+		  sizeof(compressed_types[0]); i++)
+			skip.insert(compressed_types[i]);
+	}
+	~impl() {
+#ifdef HAVE_ZLIB
+		for (int c = 0; c < 3; c++) {
+			for (size_t i = 0; i < idle[c].size(); i++) {
+				deflateEnd(idle[c][i]);
+				delete idle[c][i];
+			}
+		}
+#endif
+	}
+	// Get the compressed content, from the cache if there is
+	bool compress(const char *data, size_t size, coding c, string &rslt) {
+		content_key key = content_hash(data, size, c);
+		if (find(key, rslt))
+			return true;
+#ifdef HAVE_ZLIB
+		z_stream *z = acquire(c);
+		if (!z)
+			return false;
+		rslt.resize(deflateBound(z, size));
+		z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		z->avail_in = size;
+		z->next_out = reinterpret_cast<Bytef*>(&rslt[0]);
+		z->avail_out = rslt.size();
+		bool done = ::deflate(z, Z_FINISH) == Z_STREAM_END;
+		rslt.resize(rslt.size() - z->avail_out);
+		release(c, z);
+		if (!done)
+			return false;
+		insert(key, rslt);
+		return true;
+#else
+		return false;
+#endif
+	}
+	int level;
+	size_t cache_size, min_size;
+	set<string> skip;
+	mutex lock;
+	size_t cached, hits;
+private:
+	typedef pair<content_key, string> entry;
+	typedef list<entry> entries;
+	// the recently used content first
+	entries lru;
+	map<content_key, entries::iterator> index;
+#ifdef HAVE_ZLIB
+	vector<z_stream*> idle[3];
+	// the compressors are reused, as their initialization costs more
+	// than the compression of the small content
+	z_stream* acquire(coding c) {
+		lock.enter();
+		z_stream *z = NULL;
+		if (!idle[c].empty()) {
+			z = idle[c].back();
+			idle[c].pop_back();
+		}
+		lock.leave();
+		if (!z) {
+			z = new z_stream;
+			if (!init(*z, c, level)) {
+				delete z;
+				return NULL;
+			}
+		}
+		return z;
+	}
+	void release(coding c, z_stream *z) {
+		deflateReset(z);
+		lock.enter();
+		if (idle[c].size() < IDLE_COMPRESSORS) {
+			idle[c].push_back(z);
+			z = NULL;
+		}
+		lock.leave();
+		if (z) {
+			deflateEnd(z);
+			delete z;
+		}
+	}
+#endif
+	bool find(const content_key &key, string &rslt) {
+		lock.enter();
+		map<content_key, entries::iterator>::iterator i = index.find(key);
+		bool found = i != index.end();
+		if (found) {
+			lru.splice(lru.begin(), lru, i->second);
+			rslt = i->second->second;
+			hits++;
+		}
+		lock.leave();
+		return found;
+	}
+	void insert(const content_key &key, const string &data) {
+		// the content taking the large part of the cache is not cached
+		if (data.size() > cache_size / 8)
+			return;
+		lock.enter();
+		if (index.find(key) == index.end()) {
+			lru.push_front(entry(key, data));
+			index[key] = lru.begin();
+			cached += data.size();
+			while (cached > cache_size) {
+				cached -= lru.back().second.size();
+				index.erase(lru.back().first);
+				lru.pop_back();
+			}
+		}
+		lock.leave();
+	}
+};
+
+// http_compressor::stream
+
+struct http_compressor::stream::state {
+#ifdef HAVE_ZLIB
+	z_stream z;
+#endif
+	bool finished;
+	// the source of the content
+	io_file file;
+	http_body body;
+	uint64_t offset, left;
+	http_response::content_producer producer;
+	io_stream part;
+};
+
+http_compressor::stream::stream(coding c, int level): s(new state) {
+	s->finished = false;
+	s->offset = s->left = 0;
+#ifdef HAVE_ZLIB
+	if (!init(s->z, c, level)) {
+		delete s;
+		throw io_buffer_exception("deflateInit2");
+	}
+#endif
+}
+
+http_compressor::stream::~stream() {
+#ifdef HAVE_ZLIB
+	deflateEnd(&s->z);
+#endif
+	delete s;
+}
+
+bool http_compressor::stream::produce(std::ostream &out) {
+	// the part is produced when the previous one is sent, the empty part
+	// is not produced since there is nothing to be sent then
+	size_t written = 0;
+	while (!s->finished && written == 0) {
+		if (s->producer) {
+			bool more = s->producer(s->part);
+			written += compress(s->part.buffer(), out);
+			s->part.reset();
+			// the parts produced are flushed to be received timely
+			written += compress(NULL, 0, more ? Z_SYNC_FLUSH : Z_FINISH, out);
+			if (!more)
+				s->finished = true;
+			continue;
+		}
+		char buf[STREAM_INPUT_SIZE];
+		size_t size = min(s->left, uint64_t(sizeof(buf)));
+		int n = size == 0 ? 0 : (s->file.handle() >= 0 ?
+		  s->file.read(s->offset, size, buf) :
+		  s->body.read(s->offset, size, buf));
+		if (n < 0 || (n == 0 && s->left > 0)) {
+			// the content can't be read, the coding is not finished
+			s->finished = true;
+			break;
+		}
+		s->offset += n;
+		s->left -= n;
+		written += compress(buf, n, s->left > 0 ? Z_NO_FLUSH : Z_FINISH, out);
+		if (s->left == 0)
+			s->finished = true;
+	}
+	return !s->finished;
+}
+
+size_t http_compressor::stream::compress(const char *data, size_t size,
+  int flush, std::ostream &out) {
+	size_t written = 0;
+#ifdef HAVE_ZLIB
+	char buf[16384];
+	s->z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	s->z.avail_in = size;
+	int rslt;
+	do {
+		s->z.next_out = reinterpret_cast<Bytef*>(buf);
+		s->z.avail_out = sizeof(buf);
+		rslt = ::deflate(&s->z, flush);
+		out.write(buf, sizeof(buf) - s->z.avail_out);
+		written += sizeof(buf) - s->z.avail_out;
+	} while (rslt == Z_OK && (s->z.avail_in > 0 || s->z.avail_out == 0 ||
+	  flush == Z_FINISH));
+#endif
+	return written;
+}
+
+size_t http_compressor::stream::compress(io_buffer &buf, std::ostream &out) {
+	size_t written = 0;
+	while (!buf.empty()) {
+		io_vector v[16];
+		int n = buf.segments(16, v);
+		if (n > 0) {
+			size_t size = 0;
+			for (int i = 0; i < n; i++) {
+				written += compress(v[i].data, v[i].size, Z_NO_FLUSH, out);
+				size += v[i].size;
+			}
+			buf.consume(size);
+			continue;
+		}
+		// the file region produced is read
+		io_file file;
+		uint64_t offset;
+		size_t size;
+		if (!buf.file_region(file, offset, size))
+			break;
+		char data[STREAM_INPUT_SIZE];
+		for (size_t done = 0; done < size; ) {
+			int r = file.read(offset + done, min(size - done, sizeof(data)),
+			  data);
+			if (r <= 0)
+				break;
+			written += compress(data, r, Z_NO_FLUSH, out);
+			done += r;
+		}
+		buf.consume(size);
+	}
+	return written;
+}
+
+// http_compressor
+
+http_compressor::http_compressor(int level, size_t cache_size,
+  size_t min_size) {
+	pimpl = new impl(level, cache_size, min_size);
+}
+
+http_compressor::~http_compressor() {
+	delete pimpl;
+}
+
+http_compressor::coding http_compressor::negotiate(
+  const string_ref &accept_encoding) {
+	// the quality values given explicitly and by the "*"
+	int gzip_q = -1, deflate_q = -1, any_q = -1;
+	const char *p = accept_encoding.begin(), *end = accept_encoding.end();
+	while (p != end) {
+		while (p != end && (*p == ' ' || *p == '\t' || *p == ','))
+			p++;
+		const char *token = p;
+		while (p != end && *p != ',' && *p != ';' && *p != ' ' &&
+		  *p != '\t')
+			p++;
+		string_ref name(token, p - token);
+		const char *params = p;
+		while (p != end && *p != ',')
+			p++;
+		int q = quality(params, p);
+		if (name.equals_nocase("gzip") || name.equals_nocase("x-gzip"))
+			gzip_q = q;
+		else if (name.equals_nocase("deflate"))
+			deflate_q = q;
+		else if (name == "*")
+			any_q = q;
+	}
+	if (gzip_q < 0)
+		gzip_q = max(any_q, 0);
+	if (deflate_q < 0)
+		deflate_q = max(any_q, 0);
+#ifdef HAVE_ZLIB
+	if (gzip_q > 0 && gzip_q >= deflate_q)
+		return gzip;
+	if (deflate_q > 0)
+		return deflate;
+#endif
+	return identity;
+}
+
+void http_compressor::register_compressed_type(const std::string &mime_type) {
+	pimpl->skip.insert(media_type(mime_type));
+}
+
+bool http_compressor::compressible(const std::string &content_type) const {
+	string type = media_type(content_type);
+	if (type.empty() || pimpl->skip.count(type))
+		return false;
+	if (starts_with(type, "image/"))
+		return type == "image/svg+xml";
+	return !starts_with(type, "audio/") && !starts_with(type, "video/");
+}
+
+http_compressor::stream* http_compressor::filter(const http_request &req,
+  http_response &resp) {
+	if (resp.get_status_code() != http_error::ok ||
+	  !resp.get_header("Content-Encoding").empty() ||
+	  resp.get_header("Cache-Control").find("no-transform") != string::npos ||
+	  !compressible(resp.get_content_type()))
+		return NULL;
+	// the content of the resource depends on the request header now
+	string &vary = resp.headers["Vary"];
+	if (vary.empty())
+		vary = "Accept-Encoding";
+	else if (vary != "*" && vary.find("Accept-Encoding") == string::npos)
+		vary += ", Accept-Encoding";
+	coding c = negotiate(req.get_header("Accept-Encoding"));
+	if (c == identity)
+		return NULL;
+	// the source of the content
+	const http_body &body = resp.get_body();
+	io_file file;
+	uint64_t offset = 0, size = 0;
+	if (resp.content_file.handle() >= 0) {
+		file = resp.content_file;
+		offset = resp.content_offset;
+		size = resp.content_file_size;
+	} else if (!resp.producer)
+		size = body.size();
+	if (!resp.producer && size < pimpl->min_size)
+		return NULL;
+	stream *rslt = NULL;
+	if (!resp.producer && size <= CHUNK_SIZE) {
+		string compressed;
+		bool done;
+		if (file.handle() >= 0) {
+			string data(size, 0);
+			done = file.read(offset, size, &data[0]) == int(size) &&
+			  pimpl->compress(data.data(), size, c, compressed);
+		} else
+			done = pimpl->compress(body.data(), size, c, compressed);
+		// the content growing is sent as it is
+		if (!done || compressed.size() >= size)
+			return NULL;
+		resp.content_file = io_file();
+		resp.content_offset = resp.content_file_size = 0;
+		resp.set_content(compressed);
+	} else {
+		rslt = new stream(c, pimpl->level);
+		if (resp.producer)
+			rslt->s->producer = resp.producer;
+		else {
+			// the content in the memory is kept by the copy of the body
+			if (file.handle() >= 0)
+				rslt->s->file = file;
+			else
+				rslt->s->body = body;
+			rslt->s->offset = offset;
+			rslt->s->left = size;
+		}
+		resp.content_file = io_file();
+		resp.content_offset = resp.content_file_size = 0;
+		resp.set_content(std::string());
+		resp.set_content(http_response::content_producer(rslt,
+		  &stream::produce));
+	}
+	resp.headers["Content-Encoding"] = c == gzip ? "gzip" : "deflate";
+	// the strong validator differs for every coding of the content
+	http_fields::iterator etag = resp.headers.find(http_fields::etag);
+	if (etag != resp.headers.end() && etag->second.size() > 1 &&
+	  etag->second[etag->second.size() - 1] == '"')
+		etag->second.insert(etag->second.size() - 1,
+		  c == gzip ? "-gzip" : "-deflate");
+	return rslt;
+}
+
+size_t http_compressor::cache_hits() const {
+	return pimpl->hits;
+}
+
+} // namespace
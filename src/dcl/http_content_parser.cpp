@@ -19,28 +19,126 @@
  * Boston, MA  02110-1301  USA
  */
 
+#include <errno.h>
 #include <memory>
+#include <string.h>
 
 #include "dcl/factory.h"
+#include "dcl/filefs.h"
 #include "dcl/http_content_parser.h"
 #include "dcl/strutils.h"
-#include "dcl/url.h"
 
 namespace dbp {
 
 using namespace std;
 
+namespace {
+
+// The maximum length of the header line of the part
+const size_t max_line = 8192;
+
+bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int hex(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Decode the urlencoded value, as url::decode() does
+void decode(const char *p, const char *end, string &rslt) {
+	rslt.clear();
+	rslt.reserve(end - p);
+	for (; p != end; ++p) {
+		int h, l;
+		if (*p == '%' && end - p > 2 && (h = hex(p[1])) >= 0 &&
+		  (l = hex(p[2])) >= 0) {
+			rslt += char(h * 16 + l);
+			p += 2;
+		} else
+			rslt += *p == '+' ? ' ' : *p;
+	}
+}
+
+// Get the parameter of the header field value, like the name of the
+// Content-Disposition or the boundary of the Content-Type
+bool parameter(const string &value, const char *key, string &rslt) {
+	const size_t size = value.size();
+	size_t i = value.find(';');
+	while (i < size) {
+		i++;
+		while (i < size && is_space(value[i]))
+			i++;
+		size_t eq = i;
+		while (eq < size && value[eq] != '=' && value[eq] != ';')
+			eq++;
+		if (eq == size || value[eq] == ';') {
+			i = eq;
+			continue;
+		}
+		size_t name_end = eq;
+		while (name_end > i && is_space(value[name_end - 1]))
+			name_end--;
+		bool found = string_ref(value.data() + i, name_end - i).
+		  equals_nocase(key);
+		string v;
+		i = eq + 1;
+		while (i < size && is_space(value[i]))
+			i++;
+		if (i < size && value[i] == '"') {
+			// the quoted string
+			for (i++; i < size && value[i] != '"'; i++) {
+				if (value[i] == '\\' && i + 1 < size)
+					i++;
+				v += value[i];
+			}
+			i = value.find(';', i);
+		} else {
+			size_t end = min(value.find(';', i), size);
+			while (end > i && is_space(value[end - 1]))
+				end--;
+			v.assign(value, i, end - i);
+			i = value.find(';', i);
+		}
+		if (found) {
+			rslt.swap(v);
+			return true;
+		}
+	}
+	return false;
+}
+
+void move_element(http_content_element &src, http_content_element &dst) {
+	dst.name.swap(src.name);
+	dst.value.swap(src.value);
+	dst.filename.swap(src.filename);
+	dst.content_type.swap(src.content_type);
+	dst.file = src.file;
+	src.file = io_file();
+}
+
+} // namespace
+
 // abstract parser interface
 class http_parser {
 public:
+	virtual ~http_parser() { }
 	virtual http_content_elements parse() = 0;
-	void set_content(const char *buffer, size_t size) {
-		buf = buffer;
-		buf_size = size;
+	void set_content(const http_body &value) {
+		body = &value;
+	}
+	void set_content_type(const string &value) {
+		content_type = value;
 	}
 protected:
-	const char *buf;
-	size_t buf_size;
+	const http_body *body;
+	string content_type;
 };
 
 // generic content parser interface (no parsing)
@@ -48,11 +146,10 @@ class http_generic_parser: public http_parser {
 public:
 	virtual http_content_elements parse() {
 		http_content_elements elements;
-		if (buf && buf_size > 0) {
+		if (!body->empty()) {
 			http_content_element element;
 			element.name = "content";
-			element.value.reserve(buf_size);
-			element.value.insert(0, buf, buf_size);
+			element.value.assign(body->data(), body->size());
 			elements.push_back(element);
 		}
 		return elements;
@@ -64,21 +161,27 @@ class http_urlencoded_parser: public http_parser {
 public:
 	virtual http_content_elements parse() {
 		http_content_elements elements;
-		if (buf) {
-			http_content_element element;
-			// split content to tokens
-			strings pairs = tokenize()(buf, "&");
-			for (strings::const_iterator i = pairs.begin();
-			  i != pairs.end(); ++i) {
-				// split each token to name and value
-				string param, value;
-				tokenize()(*i, param, value, false, "=");
-				// decode urlencoded value
-				element.name = url().decode(param);
-				element.value = url().decode(value);
-				// add to result
-				elements.push_back(element);
+		// decode the pairs in place, in one pass
+		const char *end = body->data() + body->size();
+		for (const char *p = body->data(); p < end; ) {
+			const char *amp = static_cast<const char*>(
+			  memchr(p, '&', end - p));
+			const char *next = amp ? amp : end;
+			const char *e = next;
+			while (p < e && is_space(*p))
+				p++;
+			while (e > p && is_space(e[-1]))
+				e--;
+			if (p != e) {
+				const char *eq = static_cast<const char*>(
+				  memchr(p, '=', e - p));
+				elements.push_back(http_content_element());
+				http_content_element &element = elements.back();
+				decode(p, eq ? eq : e, element.name);
+				if (eq)
+					decode(eq + 1, e, element.value);
 			}
+			p = next + 1;
 		}
 		return elements;
 	}
@@ -88,10 +191,25 @@ public:
 class http_form_data_parser: public http_parser {
 public:
 	virtual http_content_elements parse() {
-		http_content_elements elements;
-		if (buf) {
+		string boundary;
+		if (!parameter(content_type, "boundary", boundary) ||
+		  boundary.empty())
+			return http_content_elements();
+		// the parts are returned even if the content is truncated
+		http_multipart_parser p(boundary);
+		if (body->file().handle() < 0) {
+			p.parse(body->data(), body->size());
+			return p.elements();
 		}
-		return elements;
+		// the content spooled is read by pieces
+		char buf[65536];
+		for (uint64_t offset = 0; offset < body->size(); ) {
+			int n = body->read(offset, sizeof(buf), buf);
+			if (n <= 0 || p.parse(buf, n) != http_multipart_parser::incomplete)
+				break;
+			offset += n;
+		}
+		return p.elements();
 	}
 };
 
@@ -122,7 +240,8 @@ public:
 				throw;
 		}
 		// initialize the parser
-		p->set_content(header.get_content(), header.get_content_size());
+		p->set_content(header.get_body());
+		p->set_content_type(header.get_content_type());
 		return p;
 	}
 private:
@@ -145,5 +264,289 @@ http_content_elements http_content_parser::parse() const {
 	return parser->parse();
 }
 
+// http_multipart_parser
+
+class http_multipart_parser::impl {
+public:
+	impl(const string &boundary, size_t spool, size_t limit, size_t *used,
+	  bool nested_part):
+	  delim("\n--" + boundary), spool_size(spool), memory_limit(limit),
+	  memory(used ? used : &own_memory), own_memory(0), nested(nested_part),
+	  state(preamble), spooled(0), child(NULL),
+	  // the first delimiter may begin the content
+	  pending("\n") {
+		// the shifts of the Boyer-Moore-Horspool search
+		for (size_t i = 0; i < 256; i++)
+			shift[i] = delim.size();
+		for (size_t i = 0; i + 1 < delim.size(); i++)
+			shift[static_cast<unsigned char>(delim[i])] = delim.size() - 1 - i;
+	}
+	~impl() {
+		delete child;
+	}
+	result parse(const char *data, size_t size) {
+		if (state == failed)
+			return error;
+		if (state == done)
+			return complete;
+		if (!pending.empty()) {
+			// the pending data is completed by the head of the data, the
+			// data left undecided then is within the head
+			size_t old = pending.size();
+			size_t take = min(size, max_line + delim.size());
+			pending.append(data, take);
+			size_t used = process(pending.data(), pending.size());
+			if (state == failed)
+				return error;
+			if (used < old) {
+				if (take < size)
+					state = failed;
+				pending.erase(0, used);
+				return status();
+			}
+			data += used - old;
+			size -= used - old;
+			pending.clear();
+		}
+		size_t used = process(data, size);
+		if (state != failed)
+			pending.assign(data + used, size - used);
+		return status();
+	}
+	http_content_elements parts;
+	part_handler handler;
+private:
+	enum states { preamble, delimiter, headers, body, done, failed };
+	const string delim;
+	size_t shift[256];
+	const size_t spool_size, memory_limit;
+	// the memory used by the parts, shared with the nested parser
+	size_t *memory, own_memory;
+	bool nested;
+	states state;
+	http_content_element part;
+	uint64_t spooled;
+	impl *child;
+	string pending;
+
+	result status() const {
+		return state == failed ? error : (state == done ? complete :
+		  incomplete);
+	}
+	// Process the data, returns the size of the data consumed
+	size_t process(const char *p, size_t n) {
+		size_t i = 0;
+		while (i < n) {
+			switch (state) {
+			case preamble:
+			case body: {
+				const char *d = find(p + i, n - i);
+				if (!d) {
+					size_t hold = held(p + i, n - i);
+					if (state == body && !content(p + i, n - i - hold))
+						return fail(i);
+					return n - hold;
+				}
+				if (state == body) {
+					size_t end = d - p;
+					if (end > i && p[end - 1] == '\r')
+						end--;
+					if (!content(p + i, end - i) || !end_part())
+						return fail(i);
+				}
+				i = d - p + delim.size();
+				state = delimiter;
+				break;
+			}
+			case delimiter: {
+				if (p[i] == '-') {
+					if (n - i < 2)
+						return i;
+					if (p[i + 1] != '-')
+						return fail(i);
+					// the closing delimiter, the epilogue is ignored
+					state = done;
+					return n;
+				}
+				// the transport padding is allowed before the line end
+				const char *lf = static_cast<const char*>(
+				  memchr(p + i, '\n', n - i));
+				const char *e = lf ? lf : p + n;
+				for (const char *c = p + i; c != e; ++c) {
+					if (!is_space(*c))
+						return fail(i);
+				}
+				if (!lf)
+					return n - i > max_line ? fail(i) : i;
+				i = lf - p + 1;
+				begin_part();
+				state = headers;
+				break;
+			}
+			case headers: {
+				const char *lf = static_cast<const char*>(
+				  memchr(p + i, '\n', n - i));
+				size_t len = lf ? lf - p - i : n - i;
+				if (len > max_line)
+					return fail(i);
+				if (!lf)
+					return i;
+				size_t end = len;
+				if (end > 0 && p[i + end - 1] == '\r')
+					end--;
+				if (end == 0)
+					state = body;
+				else if (!header(p + i, end))
+					return fail(i);
+				i += len + 1;
+				break;
+			}
+			case done:
+				return n;
+			case failed:
+				return i;
+			}
+		}
+		return n;
+	}
+	size_t fail(size_t i) {
+		state = failed;
+		return i;
+	}
+	// Find the delimiter
+	const char* find(const char *p, size_t n) const {
+		const size_t m = delim.size();
+		const char last = delim[m - 1];
+		for (size_t i = 0; i + m <= n;
+		  i += shift[static_cast<unsigned char>(p[i + m - 1])]) {
+			if (p[i + m - 1] == last && memcmp(p + i, delim.data(), m - 1) == 0)
+				return p + i;
+		}
+		return NULL;
+	}
+	// Get the size of the end of the data which may begin the delimiter
+	size_t held(const char *p, size_t n) const {
+		size_t tail = min(n, delim.size() - 1);
+		for (const char *lf = p + n - tail; (lf = static_cast<const char*>(
+		  memchr(lf, '\n', p + n - lf))) != NULL; ++lf) {
+			if (memcmp(lf, delim.data(), p + n - lf) == 0)
+				return p + n - lf + (lf > p && lf[-1] == '\r');
+		}
+		// the line end may be split
+		return n > 0 && p[n - 1] == '\r';
+	}
+	void begin_part() {
+		part = http_content_element();
+		spooled = 0;
+		delete child;
+		child = NULL;
+	}
+	bool header(const char *p, size_t n) {
+		const char *colon = static_cast<const char*>(memchr(p, ':', n));
+		if (!colon)
+			return false;
+		string_ref name(p, colon - p);
+		const char *v = colon + 1, *e = p + n;
+		while (v < e && is_space(*v))
+			v++;
+		while (e > v && is_space(e[-1]))
+			e--;
+		string value(v, e - v);
+		if (name.equals_nocase("Content-Disposition")) {
+			parameter(value, "name", part.name);
+			parameter(value, "filename", part.filename);
+		} else if (name.equals_nocase("Content-Type")) {
+			part.content_type = value;
+			string boundary;
+			// the files of the field sent as the multipart/mixed content
+			if (!nested && value.size() >= 15 &&
+			  string_ref(value.data(), 15).equals_nocase("multipart/mixed") &&
+			  parameter(value, "boundary", boundary) && !boundary.empty())
+				child = new impl(boundary, spool_size, memory_limit, memory, true);
+		}
+		return true;
+	}
+	bool content(const char *p, size_t n) {
+		if (n == 0)
+			return true;
+		if (child)
+			return child->parse(p, n) != error;
+		if (part.file.handle() < 0) {
+			if (part.value.size() + n <= spool_size &&
+			  *memory + n <= memory_limit) {
+				part.value.append(p, n);
+				*memory += n;
+				return true;
+			}
+			// the content is moved to the file
+			part.file = io_file::temporary(filefs().get_temp_dir());
+			write(part.value.data(), part.value.size());
+			*memory -= part.value.size();
+			string().swap(part.value);
+		}
+		write(p, n);
+		return true;
+	}
+	void write(const char *p, size_t n) {
+		while (n > 0) {
+			int rslt = part.file.write(spooled, min(n, size_t(1) << 30), p);
+			if (rslt <= 0)
+				throw io_buffer_exception(strerror(errno));
+			spooled += rslt;
+			p += rslt;
+			n -= rslt;
+		}
+	}
+	bool end_part() {
+		if (!child) {
+			deliver(part);
+			return true;
+		}
+		// the nested parts belong to the field enclosing them
+		bool rslt = child->state == done;
+		for (http_content_elements::iterator i = child->parts.begin();
+		  i != child->parts.end(); ++i) {
+			if (i->name.empty())
+				i->name = part.name;
+			deliver(*i);
+		}
+		delete child;
+		child = NULL;
+		return rslt;
+	}
+	void deliver(http_content_element &e) {
+		if (handler.empty()) {
+			parts.push_back(http_content_element());
+			move_element(e, parts.back());
+			return;
+		}
+		size_t size = e.value.size();
+		handler(e);
+		*memory -= size;
+	}
+};
+
+http_multipart_parser::http_multipart_parser(const std::string &boundary,
+  size_t spool_size, size_t memory_limit) {
+	pimpl = new impl(boundary, spool_size, memory_limit, NULL, false);
+}
+
+http_multipart_parser::~http_multipart_parser() {
+	delete pimpl;
+}
+
+void http_multipart_parser::on_part(part_handler handler) {
+	pimpl->handler = handler;
+}
+
+http_multipart_parser::result http_multipart_parser::parse(const char *data,
+  size_t size) {
+	return pimpl->parse(data, size);
+}
+
+const http_content_elements& http_multipart_parser::elements() const {
+	return pimpl->parts;
+}
+
 } // namespace
 
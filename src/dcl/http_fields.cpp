@@ -0,0 +1,233 @@
+/*
+ * http_fields.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <algorithm>
+#include <string.h>
+
+#include <dcl/http_fields.h>
+
+namespace dbp {
+
+using namespace std;
+
+namespace {
+
+// The names of the well-known fields, in the order of the identifiers
+const char *well_known[] = {
+	"",
+	"Accept",
+	"Accept-Encoding",
+	"Accept-Language",
+	"Accept-Ranges",
+	"Allow",
+	"Authorization",
+	"Cache-Control",
+	"Connection",
+	"Content-Disposition",
+	"Content-Encoding",
+	"Content-Length",
+	"Content-Range",
+	"Content-Type",
+	"Cookie",
+	"Date",
+	"ETag",
+	"Expect",
+	"Expires",
+	"Host",
+	"If-Match",
+	"If-Modified-Since",
+	"If-None-Match",
+	"If-Range",
+	"If-Unmodified-Since",
+	"Keep-Alive",
+	"Last-Modified",
+	"Location",
+	"Range",
+	"Referer",
+	"Server",
+	"Set-Cookie",
+	"Transfer-Encoding",
+	"Upgrade",
+	"User-Agent",
+	"Vary"
+};
+
+// The table of the well-known names found by the case-folded hash
+class field_names {
+public:
+	field_names() {
+		memset(table, 0, sizeof(table));
+		for (size_t id = 1; id < sizeof(well_known) / sizeof(well_known[0]);
+		  id++) {
+			string_ref name(well_known[id]);
+			size_t i = hash(name) & (table_size - 1);
+			while (table[i].id != 0)
+				i = (i + 1) & (table_size - 1);
+			table[i].hash = hash(name);
+			table[i].id = id;
+		}
+	}
+	http_fields::field_id operator()(const string_ref &name,
+	  uint32_t h) const {
+		for (size_t i = h & (table_size - 1); table[i].id != 0;
+		  i = (i + 1) & (table_size - 1)) {
+			if (table[i].hash == h &&
+			  name.equals_nocase(well_known[table[i].id]))
+				return http_fields::field_id(table[i].id);
+		}
+		return http_fields::other;
+	}
+	static uint32_t hash(const string_ref &name) {
+		// the names differing in the case of the letters only have the
+		// same hash, the names are compared after all
+		uint32_t h = 2166136261u;
+		for (const char *c = name.begin(); c != name.end(); ++c)
+			h = (h ^ static_cast<unsigned char>(*c | 0x20)) * 16777619u;
+		return h;
+	}
+private:
+	static const size_t table_size = 128;
+	struct entry {
+		uint32_t hash;
+		size_t id;
+	};
+	entry table[table_size];
+};
+
+const field_names& names() {
+	static const field_names n;
+	return n;
+}
+
+} // namespace
+
+// http_field
+
+void http_field::swap(http_field &f) {
+	first.swap(f.first);
+	second.swap(f.second);
+	std::swap(_hash, f._hash);
+	std::swap(_id, f._id);
+}
+
+// http_fields
+
+http_fields::field_id http_fields::id(const string_ref &name) {
+	return names()(name, hash(name));
+}
+
+uint32_t http_fields::hash(const string_ref &name) {
+	return field_names::hash(name);
+}
+
+http_fields::http_fields(): items(fixed), count(0) { }
+
+http_fields::http_fields(const http_fields &src): items(fixed), count(0) {
+	*this = src;
+}
+
+http_fields& http_fields::operator=(const http_fields &src) {
+	if (this == &src)
+		return *this;
+	clear();
+	if (src.count > fixed_size) {
+		more.assign(src.items, src.items + src.count);
+		items = &more[0];
+	} else {
+		for (size_t i = 0; i < src.count; i++)
+			fixed[i] = src.items[i];
+	}
+	count = src.count;
+	return *this;
+}
+
+http_fields::iterator http_fields::find(const string_ref &name) {
+	uint32_t h = hash(name);
+	for (size_t i = 0; i < count; i++) {
+		if (items[i]._hash == h && name.equals_nocase(items[i].first))
+			return items + i;
+	}
+	return end();
+}
+
+http_fields::iterator http_fields::find(field_id id) {
+	for (size_t i = 0; i < count; i++) {
+		if (items[i]._id == id)
+			return items + i;
+	}
+	return end();
+}
+
+std::string& http_fields::operator[](const string_ref &name) {
+	uint32_t h = hash(name);
+	for (size_t i = 0; i < count; i++) {
+		if (items[i]._hash == h && name.equals_nocase(items[i].first))
+			return items[i].second;
+	}
+	if (count == fixed_size && items == fixed) {
+		// the fields are moved to the vector, the strings are not copied
+		more.resize(fixed_size);
+		for (size_t i = 0; i < fixed_size; i++)
+			more[i].swap(fixed[i]);
+	}
+	// the vector keeps the fields once moved, whatever their number is
+	if (count >= fixed_size || items != fixed) {
+		more.push_back(http_field());
+		items = &more[0];
+	}
+	http_field &f = items[count++];
+	f.first.assign(name.data(), name.size());
+	f._hash = h;
+	f._id = names()(name, h);
+	return f.second;
+}
+
+size_t http_fields::erase(const string_ref &name) {
+	iterator i = find(name);
+	if (i == end())
+		return 0;
+	erase(i);
+	return 1;
+}
+
+void http_fields::erase(iterator i) {
+	// the order of the fields is kept
+	for (iterator j = i + 1; j != end(); ++j)
+		(j - 1)->swap(*j);
+	count--;
+	if (items == fixed) {
+		fixed[count].first.clear();
+		fixed[count].second.clear();
+	} else
+		more.pop_back();
+}
+
+void http_fields::clear() {
+	for (size_t i = 0; i < fixed_size; i++) {
+		fixed[i].first.clear();
+		fixed[i].second.clear();
+	}
+	more.clear();
+	items = fixed;
+	count = 0;
+}
+
+} // namespace
@@ -0,0 +1,470 @@
+/*
+ * http_file_handler.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <ctype.h>
+#include <list>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <dcl/http_file_handler.h>
+#include <dcl/io_buffer.h>
+#include <dcl/mutex.h>
+#include <dcl/shared_ptr.h>
+#include <dcl/strutils.h>
+#include <dcl/url.h>
+
+namespace dbp {
+
+using namespace std;
+
+namespace {
+
+const char *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+
+const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul",
+  "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+// Format the IMF-fixdate (RFC 7231 7.1.1.1)
+string http_date(time_t t) {
+	struct tm tm;
+#ifdef _WIN32
+	gmtime_s(&tm, &t);
+#else
+	gmtime_r(&t, &tm);
+#endif
+	char s[32];
+	int n = snprintf(s, sizeof(s), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+	  days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900,
+	  tm.tm_hour, tm.tm_min, tm.tm_sec);
+	return string(s, n);
+}
+
+// Parse the IMF-fixdate, the obsolete formats are not accepted
+bool parse_http_date(const string &value, time_t &t) {
+	char month[4];
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+	if (sscanf(value.c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT",
+	  &tm.tm_mday, month, &tm.tm_year, &tm.tm_hour, &tm.tm_min,
+	  &tm.tm_sec) != 6)
+		return false;
+	tm.tm_mon = -1;
+	for (int i = 0; i < 12; i++) {
+		if (strcmp(month, months[i]) == 0)
+			tm.tm_mon = i;
+	}
+	if (tm.tm_mon < 0)
+		return false;
+	tm.tm_year -= 1900;
+#ifdef _WIN32
+	t = _mkgmtime(&tm);
+#else
+	t = timegm(&tm);
+#endif
+	return t != time_t(-1);
+}
+
+// Decode the percent-encoded path, the plus sign is kept
+bool decode_path(const string &value, string &rslt) {
+	rslt.clear();
+	rslt.reserve(value.size());
+	for (size_t i = 0; i < value.size(); i++) {
+		if (value[i] == '%' && i + 2 < value.size() &&
+		  isxdigit(static_cast<unsigned char>(value[i + 1])) &&
+		  isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+			rslt += char(strtol(value.substr(i + 1, 2).c_str(), NULL, 16));
+			i += 2;
+		} else
+			rslt += value[i];
+	}
+	// the path having the null character is not the path of the file
+	return rslt.find('\0') == string::npos;
+}
+
+// Check for the entity tag is in the list (RFC 7232 2.3.2)
+bool etag_matches(const string &list, const string &etag, bool weak) {
+	if (list.find_first_not_of(" \t") != string::npos &&
+	  list[list.find_first_not_of(" \t")] == '*')
+		return true;
+	// the tags of the content compressed by the http_compressor match
+	// the tag of the file by the weak comparison (If-None-Match) only,
+	// as the range of the content compressed is not the range of the file
+	string base(etag, 0, etag.size() - 1);
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t end = list.find(',', pos);
+		if (end == string::npos)
+			end = list.size();
+		string tag = trim()(list.substr(pos, end - pos));
+		pos = end + 1;
+		if (tag.compare(0, 2, "W/") == 0) {
+			if (!weak)
+				continue;
+			tag.erase(0, 2);
+		}
+		if (tag == etag || (weak && (tag == base + "-gzip\"" ||
+		  tag == base + "-deflate\"")))
+			return true;
+	}
+	return false;
+}
+
+// Parse the single byte range (RFC 7233 2.1)
+/*
+	Returns false if the range should be ignored, sets the first byte
+	position after the last one if the range is not satisfiable.
+*/
+bool parse_range(const string &value, uint64_t size, uint64_t &first,
+  uint64_t &last) {
+	if (value.compare(0, 6, "bytes=") != 0 ||
+	  value.find(',') != string::npos)
+		return false;
+	string spec = trim()(value.substr(6));
+	size_t dash = spec.find('-');
+	if (dash == string::npos ||
+	  spec.find_first_not_of("0123456789-") != string::npos ||
+	  spec.find('-', dash + 1) != string::npos)
+		return false;
+	string from = spec.substr(0, dash), to = spec.substr(dash + 1);
+	if (from.empty()) {
+		// the suffix range, the last bytes requested
+		if (to.empty())
+			return false;
+		uint64_t n = strtoull(to.c_str(), NULL, 10);
+		if (n == 0) {
+			first = size;
+			return true;
+		}
+		first = n < size ? size - n : 0;
+		last = size - 1;
+		return true;
+	}
+	uint64_t from_pos = strtoull(from.c_str(), NULL, 10);
+	if (from_pos >= size) {
+		first = size;
+		return true;
+	}
+	uint64_t to_pos = to.empty() ? size - 1 : strtoull(to.c_str(), NULL, 10);
+	if (to_pos < from_pos)
+		return false;
+	first = from_pos;
+	last = to_pos < size ? to_pos : size - 1;
+	return true;
+}
+
+} // namespace
+
+class http_file_handler::impl {
+public:
+	// The file cached, shared by the cache and the responses, so it
+	// is not changed after loaded except the time of the check
+	struct entry {
+		string path;
+		time_t checked;
+		uint64_t size;
+		time_t mtime;
+		long mtime_nsec;
+		uint64_t inode;
+		// the content of the small file, or the file opened
+		bool in_memory;
+		io_buffer content;
+		io_file file;
+		string etag, last_modified, content_type;
+		size_t cost;
+	};
+	typedef shared_ptr<entry> entry_ptr;
+	impl(const string &root_dir, size_t cache_size, size_t max_file_size):
+	  cache_size(cache_size), max_file_size(max_file_size), interval(1),
+	  cached(0), hits(0) {
+		set_root(root_dir);
+	}
+	void set_root(const string &value) {
+		lock.enter();
+		root = value;
+		while (root.size() > 1 && root[root.size() - 1] == '/')
+			root.erase(root.size() - 1);
+		lru.clear();
+		index.clear();
+		cached = 0;
+		lock.leave();
+	}
+	// Get the file by the path normalized
+	entry_ptr get(const string &path) {
+		time_t now = time(NULL);
+		lock.enter();
+		map<string, entries::iterator>::iterator i = index.find(path);
+		if (i != index.end() && now - i->second->second->checked < interval) {
+			lru.splice(lru.begin(), lru, i->second);
+			entry_ptr rslt = i->second->second;
+			hits++;
+			lock.leave();
+			return rslt;
+		}
+		lock.leave();
+		// the file is checked for the changes
+		struct stat st;
+		string file = root + path;
+		if (::stat(file.c_str(), &st) != 0)
+			return entry_ptr();
+		if (S_ISDIR(st.st_mode)) {
+			file += path[path.size() - 1] == '/' ? "index.html" :
+			  "/index.html";
+			if (::stat(file.c_str(), &st) != 0)
+				return entry_ptr();
+		}
+		if (!S_ISREG(st.st_mode))
+			return entry_ptr();
+		lock.enter();
+		i = index.find(path);
+		if (i != index.end()) {
+			entry_ptr e = i->second->second;
+			if (e->path == file && e->size == uint64_t(st.st_size) &&
+			  e->mtime == st.st_mtime && e->mtime_nsec == nsec(st) &&
+			  e->inode == uint64_t(st.st_ino)) {
+				e->checked = now;
+				lru.splice(lru.begin(), lru, i->second);
+				hits++;
+				lock.leave();
+				return e;
+			}
+			remove(i);
+		}
+		lock.leave();
+		entry_ptr rslt(new entry());
+		if (!load(file, *rslt))
+			return entry_ptr();
+		rslt->checked = now;
+		insert(path, rslt);
+		return rslt;
+	}
+	mimetype mime;
+	size_t cache_size, max_file_size;
+	int interval;
+	string root;
+	mutex lock;
+	size_t cached, hits;
+private:
+	typedef list<pair<string, entry_ptr> > entries;
+	// the recently used files first
+	entries lru;
+	map<string, entries::iterator> index;
+	static long nsec(const struct stat &st) {
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+		return st.st_mtim.tv_nsec;
+#else
+		return 0;
+#endif
+	}
+	bool load(const string &path, entry &e) {
+		try {
+			e.file = io_file(path);
+		}
+		catch (io_buffer_exception&) {
+			return false;
+		}
+		// the file opened is described, as the path may refer to the
+		// other file already
+		struct stat st;
+		if (::fstat(e.file.handle(), &st) != 0)
+			return false;
+		e.path = path;
+		e.size = st.st_size;
+		e.mtime = st.st_mtime;
+		e.mtime_nsec = nsec(st);
+		e.inode = st.st_ino;
+		e.in_memory = e.size <= max_file_size;
+		e.content.clear();
+		char tag[64];
+		if (e.in_memory) {
+			// FNV-1a, the tag changes with the content only
+			uint64_t h = 14695981039346656037ULL;
+			while (e.content.size() < e.size) {
+				size_t n;
+				char *p = e.content.prepare(n);
+				n = min(n, size_t(e.size - e.content.size()));
+				int rslt = e.file.read(e.content.size(), n, p);
+				if (rslt <= 0)
+					return false;
+				for (int i = 0; i < rslt; i++)
+					h = (h ^ static_cast<unsigned char>(p[i])) *
+					  1099511628211ULL;
+				e.content.commit(rslt);
+			}
+			e.file = io_file();
+			snprintf(tag, sizeof(tag), "\"%016llx\"",
+			  static_cast<unsigned long long>(h));
+		} else {
+			snprintf(tag, sizeof(tag), "\"%llx-%llx-%llx.%lx\"",
+			  static_cast<unsigned long long>(e.inode),
+			  static_cast<unsigned long long>(e.size),
+			  static_cast<unsigned long long>(e.mtime),
+			  static_cast<unsigned long>(e.mtime_nsec));
+		}
+		e.etag = tag;
+		e.last_modified = http_date(e.mtime);
+		e.content_type = mime(path);
+		// the file kept open is charged as the largest file kept in the
+		// memory, so the number of the open files is limited
+		e.cost = e.in_memory ? e.content.size() : max_file_size;
+		return true;
+	}
+	void insert(const string &path, const entry_ptr &e) {
+		if (e->cost > cache_size / 8)
+			return;
+		lock.enter();
+		map<string, entries::iterator>::iterator i = index.find(path);
+		if (i != index.end())
+			remove(i);
+		lru.push_front(make_pair(path, e));
+		index[path] = lru.begin();
+		cached += e->cost;
+		while (cached > cache_size)
+			remove(index.find(lru.back().first));
+		lock.leave();
+	}
+	void remove(map<string, entries::iterator>::iterator i) {
+		cached -= i->second->second->cost;
+		lru.erase(i->second);
+		index.erase(i);
+	}
+};
+
+http_file_handler::http_file_handler(const std::string &root_dir,
+  size_t cache_size, size_t max_file_size):
+  pimpl(new impl(root_dir, cache_size, max_file_size)) { }
+
+http_file_handler::~http_file_handler() {
+	delete pimpl;
+}
+
+const std::string& http_file_handler::root_dir() const {
+	return pimpl->root;
+}
+
+http_file_handler& http_file_handler::root_dir(const std::string &value) {
+	pimpl->set_root(value);
+	return *this;
+}
+
+int http_file_handler::check_interval() const {
+	return pimpl->interval;
+}
+
+http_file_handler& http_file_handler::check_interval(int value) {
+	pimpl->interval = value;
+	return *this;
+}
+
+mimetype& http_file_handler::mime_types() {
+	return pimpl->mime;
+}
+
+http_response http_file_handler::handle(const http_request &req) {
+	http_response resp;
+	http_method::http_method method = req.get_method();
+	if (method != http_method::get && method != http_method::head) {
+		resp.set_status(http_error::method_not_allowed);
+		resp.set_header("Allow", "GET, HEAD");
+		resp.set_content(http_error::reason(
+		  http_error::method_not_allowed));
+		return resp;
+	}
+	// the path is normalized relative to the root, so the parent
+	// directories of the root are not reached
+	url u(req.get_path_info());
+	string path;
+	bool found = decode_path(u.path, path);
+	impl::entry_ptr e;
+	if (found) {
+		u.path = path;
+		u.normalize("/");
+		if (u.path.empty())
+			u.path = "/";
+		e = pimpl->get(u.path);
+	}
+	if (!e) {
+		resp.set_status(http_error::not_found);
+		resp.set_content(http_error::reason(http_error::not_found));
+		return resp;
+	}
+	resp.set_content_type(e->content_type);
+	resp.set_header("ETag", e->etag);
+	resp.set_header("Last-Modified", e->last_modified);
+	resp.set_header("Accept-Ranges", "bytes");
+	// the conditional request (RFC 7232 6), If-Modified-Since is
+	// ignored if there is If-None-Match
+	const string &none_match = req.get_header("If-None-Match");
+	time_t since;
+	if (!none_match.empty() ? etag_matches(none_match, e->etag, true) :
+	  parse_http_date(req.get_header("If-Modified-Since"), since) &&
+	  e->mtime <= since) {
+		resp.set_status(http_error::not_modified);
+		return resp;
+	}
+	uint64_t first = 0, last = e->size - 1;
+	const string &range = req.get_header("Range");
+	const string &if_range = req.get_header("If-Range");
+	bool partial = !range.empty() && (if_range.empty() ||
+	  (if_range[0] == '"' ? etag_matches(if_range, e->etag, false) :
+	  if_range == e->last_modified)) &&
+	  parse_range(range, e->size, first, last);
+	if (partial && first >= e->size) {
+		resp.set_status(http_error::requested_range_not_satisfiable);
+		resp.set_header("Content-Range", "bytes */" +
+		  to_string<uint64_t>(e->size));
+		resp.set_content(string());
+		return resp;
+	}
+	uint64_t size = e->size;
+	if (partial) {
+		resp.set_status(http_error::partial_content);
+		resp.set_header("Content-Range", "bytes " +
+		  to_string<uint64_t>(first) + "-" + to_string<uint64_t>(last) +
+		  "/" + to_string<uint64_t>(e->size));
+		size = last - first + 1;
+	}
+	// the response to HEAD is made as the response to GET, the server
+	// drops the content only
+	if (e->in_memory && !partial) {
+		resp.set_content(e->content);
+	} else if (e->in_memory) {
+		io_buffer part;
+		part.append(e->content, first, size);
+		resp.set_content(part);
+	} else
+		resp.set_content(e->file, first, size);
+	return resp;
+}
+
+size_t http_file_handler::cache_hits() const {
+	return pimpl->hits;
+}
+
+} // namespace
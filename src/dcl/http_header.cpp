@@ -19,8 +19,6 @@
  * Boston, MA  02110-1301  USA
  */
 
-#include <map>
-
 #include "dcl/http_header.h"
 #include "dcl/strutils.h"
 
@@ -32,151 +30,174 @@ using namespace std;
 
 namespace http_error {
 
-class convert {
-public:
-	std::string operator()(http_error value) {
-		typedef pair<http_error, const char*> status_map;
-		status_map const table[] = {
-			status_map(http_error::error_continue, "Continue"),
-			status_map(http_error::switching_protocols, "Switching Protocols"),
-			status_map(http_error::ok, "OK"),
-			status_map(http_error::created, "Created"),
-			status_map(http_error::accepted, "Accepted"),
-			status_map(http_error::non_authoritative_information,
-			  "Non Authoritative Information"),
-			status_map(http_error::no_content, "No Content"),
-			status_map(http_error::reset_content, "Reset Content"),
-			status_map(http_error::partial_content, "Partial Content"),
-			status_map(http_error::multiple_choices, "Multiple Choices"),
-			status_map(http_error::moved_permanently, "Moved Permanently"),
-			status_map(http_error::found, "Found"),
-			status_map(http_error::see_other, "See Other"),
-			status_map(http_error::not_modified, "Not Modified"),
-			status_map(http_error::use_proxy, "Use Proxy"),
-			status_map(http_error::temporary_redirect, "Temporary Redirect"),
-			status_map(http_error::bad_request, "Bad Request"),
-			status_map(http_error::unauthorized, "Unauthorized"),
-			status_map(http_error::payment_required, "Payment Required"),
-			status_map(http_error::forbidden, "Forbidden"),
-			status_map(http_error::not_found, "Not Found"),
-			status_map(http_error::method_not_allowed, "Method Not Allowed"),
-			status_map(http_error::not_acceptable, "Not Acceptable"),
-			status_map(http_error::proxy_authentication_required,
-			  "Proxy Authentication Required"),
-			status_map(http_error::request_timeout, "Request Timeout"),
-			status_map(http_error::conflict, "Conflict"),
-			status_map(http_error::gone, "Gone"),
-			status_map(http_error::length_required, "Length Required"),
-			status_map(http_error::precondition_failed, "Precondition Failed"),
-			status_map(http_error::request_entity_too_large,
-			  "Request Entity Too Large"),
-			status_map(http_error::request_uri_too_long, "Request-URI Too Long"),
-			status_map(http_error::unsupported_media_type,
-			  "Unsupported Media Type"),
-			status_map(http_error::requested_range_not_satisfiable,
-			  "Requested Range Not Satisfiable"),
-			status_map(http_error::expectation_failed,
-			  "Expectation Failed"),
-			status_map(http_error::internal_server_error, "Internal Server Error"),
-			status_map(http_error::not_implemented, "Not Implemented"),
-			status_map(http_error::bad_gateway, "Bad Gateway"),
-			status_map(http_error::service_unavailable, "Service Unavailable"),
-			status_map(http_error::gateway_timeout, "Gateway Timeout"),
-			status_map(http_error::http_version_not_supported,
-			  "HTTP Version Not Supported")
-		};
-		map<http_error, const char*> _map(table,
-		  table + sizeof(table) / sizeof(table[0]));
-		return _map[value];
-	}
+namespace {
+
+// The reason phrases indexed by the status class and the status number
+// in the class, so the phrase is found with no search
+
+const char *informational[] = {
+	"Continue",
+	"Switching Protocols"
+};
+
+const char *successful[] = {
+	"OK",
+	"Created",
+	"Accepted",
+	"Non Authoritative Information",
+	"No Content",
+	"Reset Content",
+	"Partial Content"
+};
+
+const char *redirection[] = {
+	"Multiple Choices",
+	"Moved Permanently",
+	"Found",
+	"See Other",
+	"Not Modified",
+	"Use Proxy",
+	NULL,
+	"Temporary Redirect"
+};
+
+const char *client_error[] = {
+	"Bad Request",
+	"Unauthorized",
+	"Payment Required",
+	"Forbidden",
+	"Not Found",
+	"Method Not Allowed",
+	"Not Acceptable",
+	"Proxy Authentication Required",
+	"Request Timeout",
+	"Conflict",
+	"Gone",
+	"Length Required",
+	"Precondition Failed",
+	"Request Entity Too Large",
+	"Request-URI Too Long",
+	"Unsupported Media Type",
+	"Requested Range Not Satisfiable",
+	"Expectation Failed",
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL,
+	"Request Header Fields Too Large"
+};
+
+const char *server_error[] = {
+	"Internal Server Error",
+	"Not Implemented",
+	"Bad Gateway",
+	"Service Unavailable",
+	"Gateway Timeout",
+	"HTTP Version Not Supported"
+};
+
+struct status_class {
+	const char **reasons;
+	size_t size;
 };
 
+const status_class classes[] = {
+	{ informational, sizeof(informational) / sizeof(informational[0]) },
+	{ successful, sizeof(successful) / sizeof(successful[0]) },
+	{ redirection, sizeof(redirection) / sizeof(redirection[0]) },
+	{ client_error, sizeof(client_error) / sizeof(client_error[0]) },
+	{ server_error, sizeof(server_error) / sizeof(server_error[0]) }
+};
+
+} // namespace
+
+const char* reason(http_error code) {
+	int c = code / 100 - 1, n = code % 100;
+	if (c < 0 || c >= int(sizeof(classes) / sizeof(classes[0])) ||
+	  size_t(n) >= classes[c].size || !classes[c].reasons[n])
+		return "";
+	return classes[c].reasons[n];
+}
+
 } // namespace
 
 // http_method
 
 namespace http_method {
 
-class convert {
-public:
-	http_method operator()(const std::string &value) const {
-		typedef pair<std::string, http_method> status_map;
-		status_map const table[] = {
-			status_map("GET", http_method::get),
-			status_map("PUT", http_method::put),
-			status_map("POST", http_method::post),
-			status_map("DELETE", http_method::del),
-			status_map("CONNECT", http_method::connect),
-			status_map("OPTIONS", http_method::options),
-			status_map("TRACE", http_method::trace),
-			status_map("PATCH", http_method::patch),
-			status_map("PROPFIND", http_method::propfind),
-			status_map("PROPPATCH", http_method::proppatch),
-			status_map("MKCOL", http_method::mkcol),
-			status_map("COPY", http_method::copy),
-			status_map("MOVE", http_method::move),
-			status_map("LOCK", http_method::lock),
-			status_map("UNLOCK", http_method::unlock),
-			status_map("VERSION_CONTROL", http_method::version_control),
-			status_map("CHECKOUT", http_method::checkout),
-			status_map("UNCHECKOUT", http_method::uncheckout),
-			status_map("CHECKIN", http_method::checkin),
-			status_map("UPDATE", http_method::update),
-			status_map("LABEL", http_method::label),
-			status_map("REPORT", http_method::report),
-			status_map("MKWORKSPACE", http_method::mkworkspace),
-			status_map("MKACTIVITY", http_method::mkactivity),
-			status_map("BASELINE_CONTROL", http_method::baseline_control),
-			status_map("MERGE", http_method::merge),
-			status_map("HEAD", http_method::head)
-		};
-		map<std::string, http_method> _map(table,
-		  table + sizeof(table) / sizeof(table[0]));
-		if (_map.find(value) != _map.end())
-			return _map[value];
-		else
-			return http_method::unknown;
-	};
-	std::string operator()(const http_method value) const {
-	typedef pair<http_method, const char*> status_map;
-		status_map const table[] = {
-			status_map(http_method::get, "GET"),
-			status_map(http_method::put, "PUT"),
-			status_map(http_method::post, "POST"),
-			status_map(http_method::del, "DELETE"),
-			status_map(http_method::connect, "CONNECT"),
-			status_map(http_method::options, "OPTIONS"),
-			status_map(http_method::trace, "TRACE"),
-			status_map(http_method::patch, "PATCH"),
-			status_map(http_method::propfind, "PROPFIND"),
-			status_map(http_method::proppatch, "PROPPATCH"),
-			status_map(http_method::mkcol, "MKCOL"),
-			status_map(http_method::copy, "COPY"),
-			status_map(http_method::move, "MOVE"),
-			status_map(http_method::lock, "LOCK"),
-			status_map(http_method::unlock, "UNLOCK"),
-			status_map(http_method::version_control, "VERSION_CONTROL"),
-			status_map(http_method::checkout, "CHECKOUT"),
-			status_map(http_method::uncheckout, "UNCHECKOUT"),
-			status_map(http_method::checkin, "CHECKIN"),
-			status_map(http_method::update, "UPDATE"),
-			status_map(http_method::label, "LABEL"),
-			status_map(http_method::report, "REPORT"),
-			status_map(http_method::mkworkspace, "MKWORKSPACE"),
-			status_map(http_method::mkactivity, "MKACTIVITY"),
-			status_map(http_method::baseline_control, "BASELINE_CONTROL"),
-			status_map(http_method::merge, "MERGE"),
-			status_map(http_method::head, "HEAD")
-		};
-		map<http_method, const char*> _map(table,
-		  table + sizeof(table) / sizeof(table[0]));
-		if (value == http_method::unknown)
-			return "";
-		else
-			return _map[value];
-	};
+namespace {
+
+struct method_token {
+	const char *token;
+	size_t size;
+};
+
+// The tokens indexed by the method
+const method_token tokens[] = {
+	{ "GET", 3 },
+	{ "PUT", 3 },
+	{ "POST", 4 },
+	{ "DELETE", 6 },
+	{ "CONNECT", 7 },
+	{ "OPTIONS", 7 },
+	{ "TRACE", 5 },
+	{ "PATCH", 5 },
+	{ "PROPFIND", 8 },
+	{ "PROPPATCH", 9 },
+	{ "MKCOL", 5 },
+	{ "COPY", 4 },
+	{ "MOVE", 4 },
+	{ "LOCK", 4 },
+	{ "UNLOCK", 6 },
+	{ "VERSION_CONTROL", 15 },
+	{ "CHECKOUT", 8 },
+	{ "UNCHECKOUT", 10 },
+	{ "CHECKIN", 7 },
+	{ "UPDATE", 6 },
+	{ "LABEL", 5 },
+	{ "REPORT", 6 },
+	{ "MKWORKSPACE", 11 },
+	{ "MKACTIVITY", 10 },
+	{ "BASELINE_CONTROL", 16 },
+	{ "MERGE", 5 },
+	{ "", 0 },
+	{ "HEAD", 4 }
 };
 
+// The methods found by the hash of the token length and the first two
+// characters, the hash has no collisions for the tokens above
+const http_method slots[] = {
+	unknown, unknown, unknown, options, unknown, unknown, unknown, get,
+	copy, unknown, unlock, connect, head, patch, uncheckout, version_control,
+	unknown, mkcol, unknown, checkin, checkout, unknown, mkactivity, mkworkspace,
+	propfind, proppatch, update, unknown, unknown, unknown, unknown, unknown,
+	baseline_control, merge, unknown, unknown, unknown, trace, unknown, unknown,
+	unknown, unknown, unknown, put, lock, unknown, unknown, unknown,
+	move, unknown, unknown, unknown, unknown, unknown, report, unknown,
+	unknown, unknown, unknown, unknown, post, label, del, unknown
+};
+
+inline size_t hash(const string_ref &token) {
+	return (token.size() + (static_cast<unsigned char>(token[0]) << 2) +
+	  (static_cast<unsigned char>(token[1]) << 3)) & 63;
+}
+
+} // namespace
+
+http_method parse(const string_ref &token) {
+	// the method token is case sensitive (RFC 7231 4.1)
+	if (token.size() < 3)
+		return unknown;
+	http_method m = slots[hash(token)];
+	if (token != string_ref(tokens[m].token, tokens[m].size))
+		return unknown;
+	return m;
+}
+
+string_ref token(http_method method) {
+	if (method < get || method > head)
+		return string_ref("", 0);
+	return string_ref(tokens[method].token, tokens[method].size);
+}
+
 } // namespace
 
 // friend IO operators
@@ -193,7 +214,7 @@ ostream& operator<<(ostream &out, const http_request &h) {
 	{
 		http_header::http_headers::const_iterator i = h.headers.begin();
 		while (i != h.headers.end()) {
-			out << i->first + ": " + i->second << CRLF;
+			out << i->first << ": " << i->second << CRLF;
 			++i;
 		};
 	}
@@ -221,7 +242,7 @@ ostream& operator<<(ostream &out, const http_response &h) {
 	// Output headers first
 	http_header::http_headers::const_iterator i = h.headers.begin();
 	while (i != h.headers.end()) {
-		out << i->first + ": " + i->second << CRLF;
+		out << i->first << ": " << i->second << CRLF;
 		++i;
 	};
 	// Output cookies
@@ -231,11 +252,50 @@ ostream& operator<<(ostream &out, const http_response &h) {
 	}
 	// Output data
 	out << CRLF;
-	if (h.get_content_size() > 0)
+	if (h.content_file.handle() >= 0) {
+		io_stream *s = dynamic_cast<io_stream*>(&out);
+		if (s) {
+			// the file region is sent by the socket directly
+			s->buffer().append(h.content_file, h.content_offset,
+			  h.content_file_size);
+		} else {
+			char buf[16384];
+			uint64_t offset = h.content_offset;
+			size_t size = h.content_file_size;
+			while (size > 0 && out) {
+				int n = h.content_file.read(offset, size < sizeof(buf) ?
+				  size : sizeof(buf), buf);
+				if (n <= 0) {
+					out.setstate(ios::badbit);
+					break;
+				}
+				out.write(buf, n);
+				offset += n;
+				size -= n;
+			}
+		}
+	} else if (!h.get_body().buffer().empty() &&
+	  dynamic_cast<io_stream*>(&out)) {
+		// the slabs shared are sent with no copying
+		dynamic_cast<io_stream*>(&out)->buffer().append(h.get_body().buffer());
+	} else if (h.get_content_size() > 0)
 		out.write(h.get_content(), h.get_content_size());
 	return out;
 }
 
+void http_response::set_content(const io_file &file, uint64_t offset,
+  size_t size) {
+	content_file = file;
+	content_offset = offset;
+	content_file_size = size;
+	headers["Content-Length"] = to_string<size_t>(size);
+}
+
+void http_response::set_content(content_producer producer) {
+	this->producer = producer;
+	headers.erase("Content-Length");
+}
+
 // http_cookie
 
 http_cookie::http_cookie(const std::string &cookie): secure(false), http_only(false) {
@@ -293,16 +353,17 @@ std::string http_cookie::str() const {
 
 // http_header
 
-void http_header::set_header(const std::string &key, const std::string &value) {
-	if (compare()(key, "Cookie")) {
-		strings c = tokenize()(value, ";");
+void http_header::set_header(const string_ref &key, const string_ref &value) {
+	http_fields::field_id id = http_fields::id(key);
+	if (id == http_fields::cookie) {
+		strings c = tokenize()(value.str(), ";");
 		for (strings::const_iterator i = c.begin(); i != c.end(); ++i)
 			cookies.push_back(http_cookie(*i));
 	} else
-	if (compare()(key, "Set-Cookie"))
-		cookies.push_back(http_cookie(value));
+	if (id == http_fields::set_cookie)
+		cookies.push_back(http_cookie(value.str()));
 	else
-		headers[key] = value;
+		headers[key].assign(value.data(), value.size());
 }
 
 void http_header::set_header(const std::string &header) {
@@ -314,7 +375,7 @@ void http_header::set_header(const std::string &header) {
 	}
 }
 
-const std::string& http_header::get_header(const std::string &key) const {
+const std::string& http_header::get_header(const string_ref &key) const {
 	http_headers::const_iterator i = headers.find(key);
 	if (i == headers.end()) {
 		return _empty_string;
@@ -328,28 +389,19 @@ void http_header::set_content(const std::string &value) {
 }
 
 void http_header::set_content(int value_size, const char *value) {
-	if (value_size > 0) {
-		content.reserve(value_size + 1);
-		content.insert(content.begin(), value, value + value_size);
-	}
-	content.push_back(0);
+	content.assign(value, value_size > 0 ? value_size : 0);
 	headers["Content-Length"] = to_string<int>(value_size);
 }
 
+void http_header::set_content(const io_buffer &value) {
+	content.assign(value);
+	headers["Content-Length"] = to_string<size_t>(value.size());
+}
+
 void http_header::add_content(int value_size, std::istream &value) {
-	size_t oldsize = content.size();
-	if (oldsize == 0) {
-		content.push_back(0);
-		oldsize = 1;
-	}
-	if (value_size > 0) {
-		content.resize(oldsize + value_size);
-		value.read(&content[oldsize - 1], value_size);
-		content[oldsize + value_size] = 0;
-		headers["Content-Length"] = to_string<int>(oldsize + value_size - 1);
-	} else {
-		headers["Content-Length"] = "0";
-	}
+	if (value_size > 0)
+		content.append(value, value_size);
+	headers["Content-Length"] = to_string<uint64_t>(content.size());
 }
 
 void http_header::add_content(std::istream &value) {
@@ -364,6 +416,13 @@ void http_header::add_content(std::istream &value) {
 	}
 }
 
+void http_header::add_content(int value_size, const char *value) {
+	if (value_size > 0) {
+		content.append(value, value_size);
+		headers["Content-Length"] = to_string<uint64_t>(content.size());
+	}
+}
+
 const http_cookies& http_header::get_cookies() const {
 	return cookies;
 }
@@ -384,29 +443,34 @@ void http_header::add_cookie(const http_cookie &c) {
 
 // http_request
 
-const std::string http_request::method() const {
-	return http_method::convert()(_method);
+void http_request::set_method(const string_ref &method) {
+	_method = http_method::parse(method);
 }
 
-void http_request::set_method(const std::string &method) {
-	_method = http_method::convert()(method);
+string_ref http_request::get_param(const string_ref &name) const {
+	for (size_t i = 0; i < _params; i++) {
+		if (_param_names[i] == name)
+			return param_value(i);
+	}
+	return string_ref();
 }
 
 // http_response
 
 http_method::http_method http_response::get_allow() {
-	if (headers.find("Allow") == headers.end())
+	http_headers::const_iterator i = headers.find(http_fields::allow);
+	if (i == headers.end())
 		return http_method::unknown;
 	else
-		return http_method::convert()(headers["Allow"]);
+		return http_method::parse(i->second);
 }
 
 void http_response::set_allow(http_method::http_method method) {
-	headers["Allow"] = http_method::convert()(method);
+	headers["Allow"] = http_method::token(method).str();
 }
 
 std::string http_response::get_status() const {
-	return to_string<int>(_status) + " " + http_error::convert()(_status);
+	return to_string<int>(_status) + " " + http_error::reason(_status);
 }
 
 } // namespace
@@ -0,0 +1,339 @@
+/*
+ * http_request_parser.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <dcl/http_request_parser.h>
+
+namespace dbp {
+
+using namespace std;
+
+namespace {
+
+// The token characters (RFC 7230 3.2.6)
+class token_chars {
+public:
+	token_chars() {
+		for (int c = 0; c < 256; c++) {
+			table[c] = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+			  (c >= 'A' && c <= 'Z');
+		}
+		for (const char *p = "!#$%&'*+-.^_`|~"; *p; p++)
+			table[static_cast<unsigned char>(*p)] = true;
+	}
+	bool operator()(char c) const {
+		return table[static_cast<unsigned char>(c)];
+	}
+private:
+	bool table[256];
+};
+
+const token_chars is_token;
+
+inline bool is_control(char c) {
+	return static_cast<unsigned char>(c) < 0x20 || c == 0x7f;
+}
+
+} // namespace
+
+http_request_parser::http_request_parser(size_t max_line, size_t max_head,
+  size_t max_headers): max_line(max_line), max_head(max_head),
+  max_headers(max_headers), base(NULL) {
+	headers.reserve(max_headers < 32 ? max_headers : 32);
+	reset();
+}
+
+void http_request_parser::reset() {
+	state = s_start;
+	pos = mark = value_end = 0;
+	_method.offset = _method.size = 0;
+	_target = _version = _method;
+	_major = _minor = 0;
+	// the memory of the headers list is kept for the next request
+	headers.clear();
+	_error = http_error::ok;
+}
+
+http_request_parser::result http_request_parser::parse(const char *data,
+  size_t size) {
+	base = data;
+	if (state == s_complete)
+		return complete;
+	if (_error != http_error::ok)
+		return error;
+	for (; pos < size; pos++) {
+		if (pos >= max_head)
+			return fail(http_error::request_header_fields_too_large);
+		char c = data[pos];
+		switch (state) {
+			case s_start:
+				// the empty lines before the request line are ignored
+				if (c == '\r' || c == '\n')
+					break;
+				if (!is_token(c))
+					return fail(http_error::bad_request);
+				_method.offset = pos;
+				state = s_method;
+				break;
+			case s_method:
+				if (c == ' ') {
+					_method.size = pos - _method.offset;
+					mark = pos + 1;
+					state = s_target;
+				} else if (!is_token(c))
+					return fail(http_error::bad_request);
+				break;
+			case s_target:
+				if (pos - _method.offset >= max_line)
+					return fail(http_error::request_uri_too_long);
+				if (c == ' ') {
+					if (pos == mark)
+						return fail(http_error::bad_request);
+					_target.offset = mark;
+					_target.size = pos - mark;
+					mark = pos + 1;
+					state = s_version;
+				} else if (is_control(c))
+					return fail(http_error::bad_request);
+				break;
+			case s_version:
+				if (c == '\r' || c == '\n') {
+					// HTTP-version = "HTTP/" DIGIT "." DIGIT
+					const char *v = data + mark;
+					if (pos - mark != 8 || v[0] != 'H' || v[1] != 'T' ||
+					  v[2] != 'T' || v[3] != 'P' || v[4] != '/' ||
+					  v[5] < '0' || v[5] > '9' || v[6] != '.' ||
+					  v[7] < '0' || v[7] > '9')
+						return fail(http_error::bad_request);
+					_version.offset = mark;
+					_version.size = 8;
+					_major = v[5] - '0';
+					_minor = v[7] - '0';
+					if (_major != 1)
+						return fail(http_error::http_version_not_supported);
+					state = c == '\r' ? s_line_lf : s_header_start;
+				} else if (pos - mark >= 8)
+					return fail(http_error::bad_request);
+				break;
+			case s_line_lf:
+				if (c != '\n')
+					return fail(http_error::bad_request);
+				state = s_header_start;
+				break;
+			case s_header_start:
+				if (c == '\r') {
+					state = s_head_lf;
+				} else if (c == '\n') {
+					pos++;
+					state = s_complete;
+					return complete;
+				} else if (is_token(c)) {
+					if (headers.size() >= max_headers)
+						return fail(http_error::request_header_fields_too_large);
+					mark = pos;
+					state = s_name;
+				} else {
+					// the obsolete line folding is rejected as well
+					return fail(http_error::bad_request);
+				}
+				break;
+			case s_name:
+				if (c == ':') {
+					header h;
+					h.name.offset = mark;
+					h.name.size = pos - mark;
+					headers.push_back(h);
+					mark = value_end = pos + 1;
+					state = s_value_start;
+				} else if (!is_token(c))
+					return fail(http_error::bad_request);
+				break;
+			case s_value_start:
+				if (c == ' ' || c == '\t') {
+					mark = value_end = pos + 1;
+					break;
+				}
+				state = s_value;
+				// fall through - the first character of the value
+			case s_value:
+				if (c == '\r' || c == '\n') {
+					headers.back().value.offset = mark;
+					headers.back().value.size = value_end - mark;
+					state = c == '\r' ? s_header_lf : s_header_start;
+				} else if (c != ' ' && c != '\t') {
+					if (is_control(c))
+						return fail(http_error::bad_request);
+					value_end = pos + 1;
+				}
+				break;
+			case s_header_lf:
+				if (c != '\n')
+					return fail(http_error::bad_request);
+				state = s_header_start;
+				break;
+			case s_head_lf:
+				if (c != '\n')
+					return fail(http_error::bad_request);
+				pos++;
+				state = s_complete;
+				return complete;
+			case s_complete:
+				break;
+		}
+	}
+	if (pos >= max_head)
+		return fail(http_error::request_header_fields_too_large);
+	return incomplete;
+}
+
+string_ref http_request_parser::get_header(const string_ref &name) const {
+	for (headers_list::const_iterator i = headers.begin();
+	  i != headers.end(); ++i) {
+		if (ref(i->name).equals_nocase(name))
+			return ref(i->value);
+	}
+	return string_ref();
+}
+
+http_chunked_parser::http_chunked_parser(size_t max_line):
+  max_line(max_line) {
+	reset();
+}
+
+void http_chunked_parser::reset() {
+	state = s_size;
+	remaining = 0;
+	line = 0;
+	has_size = false;
+}
+
+http_chunked_parser::result http_chunked_parser::parse(const char *data,
+  size_t size, size_t &consumed, string_ref &chunk) {
+	consumed = 0;
+	chunk = string_ref();
+	if (state == s_complete)
+		return complete;
+	for (; consumed < size; consumed++) {
+		char c = data[consumed];
+		if (state != s_data && ++line > max_line)
+			return error;
+		switch (state) {
+			case s_size: {
+				// chunk-size = 1*HEXDIG
+				int digit = -1;
+				if (c >= '0' && c <= '9')
+					digit = c - '0';
+				else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+					digit = (c | 0x20) - 'a' + 10;
+				if (digit >= 0) {
+					if (remaining >> 59)
+						return error;
+					remaining = remaining * 16 + digit;
+					has_size = true;
+					break;
+				}
+				if (!has_size)
+					return error;
+				if (c == ';' || c == ' ' || c == '\t')
+					state = s_extension;
+				else if (c == '\r')
+					state = s_size_lf;
+				else if (c == '\n')
+					state = remaining > 0 ? s_data : s_trailer_start;
+				else
+					return error;
+				break;
+			}
+			case s_extension:
+				if (c == '\r')
+					state = s_size_lf;
+				else if (c == '\n')
+					state = remaining > 0 ? s_data : s_trailer_start;
+				break;
+			case s_size_lf:
+				if (c != '\n')
+					return error;
+				state = remaining > 0 ? s_data : s_trailer_start;
+				break;
+			case s_data: {
+				// the chunk data is returned as is
+				size_t n = size - consumed;
+				if (n > remaining)
+					n = remaining;
+				chunk = string_ref(data + consumed, n);
+				consumed += n;
+				remaining -= n;
+				if (remaining == 0)
+					state = s_data_cr;
+				return incomplete;
+			}
+			case s_data_cr:
+				if (c == '\r')
+					state = s_data_lf;
+				else if (c == '\n') {
+					state = s_size;
+					line = 0;
+					has_size = false;
+				} else
+					return error;
+				break;
+			case s_data_lf:
+				if (c != '\n')
+					return error;
+				state = s_size;
+				line = 0;
+				has_size = false;
+				break;
+			case s_trailer_start:
+				// the trailer fields are counted by the same limit
+				if (c == '\r')
+					state = s_last_lf;
+				else if (c == '\n') {
+					consumed++;
+					state = s_complete;
+					return complete;
+				} else
+					state = s_trailer;
+				break;
+			case s_trailer:
+				if (c == '\r')
+					state = s_trailer_lf;
+				else if (c == '\n')
+					state = s_trailer_start;
+				break;
+			case s_trailer_lf:
+				if (c != '\n')
+					return error;
+				state = s_trailer_start;
+				break;
+			case s_last_lf:
+				if (c != '\n')
+					return error;
+				consumed++;
+				state = s_complete;
+				return complete;
+			case s_complete:
+				break;
+		}
+	}
+	return incomplete;
+}
+
+} // namespace
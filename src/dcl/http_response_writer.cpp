@@ -0,0 +1,209 @@
+/*
+ * http_response_writer.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <dcl/http_response_writer.h>
+
+namespace dbp {
+
+using namespace std;
+
+namespace {
+
+// The status lines of all the three-digit statuses, for HTTP/1.0 and
+// HTTP/1.1, stored one after another
+class status_lines {
+public:
+	status_lines() {
+		size_t k = 0;
+		for (int code = 100; code < 600; code++) {
+			const char *r = http_error::reason(http_error::http_error(code));
+			for (int minor = 0; minor < 2; minor++) {
+				char line[64];
+				snprintf(line, sizeof(line), "HTTP/1.%d %d %s" CRLF, minor,
+				  code, r);
+				offsets[k++] = text.size();
+				text += line;
+			}
+		}
+		offsets[k] = text.size();
+	}
+	string_ref operator()(int code, int minor) const {
+		// the status out of range is not valid, so the server fails
+		if (code < 100 || code >= 600)
+			code = http_error::internal_server_error;
+		size_t k = (code - 100) * 2 + (minor > 0 ? 1 : 0);
+		return string_ref(text.data() + offsets[k],
+		  offsets[k + 1] - offsets[k]);
+	}
+private:
+	std::string text;
+	size_t offsets[1001];
+};
+
+const status_lines lines;
+
+// The Date header formatted by the thread and the time it is valid for
+__thread time_t date_time = 0;
+__thread char date_line[48];
+__thread size_t date_size = 0;
+
+string_ref date_header() {
+	static const char *days[] = {
+		"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+	};
+	static const char *months[] = {
+		"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+		"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+	};
+	time_t t = time(NULL);
+	if (t != date_time || date_size == 0) {
+		struct tm tm;
+#ifdef _WIN32
+		gmtime_s(&tm, &t);
+#else
+		gmtime_r(&t, &tm);
+#endif
+		// IMF-fixdate (RFC 7231 7.1.1.1), not dependent on the locale
+		date_size = snprintf(date_line, sizeof(date_line),
+		  "Date: %s, %02d %s %04d %02d:%02d:%02d GMT" CRLF,
+		  days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon],
+		  tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+		date_time = t;
+	}
+	return string_ref(date_line, date_size);
+}
+
+// Writes the data into the free space of the buffer, the data written
+// is committed when the space is over or on flush()
+class sink {
+public:
+	sink(io_buffer &buf): buf(buf), start(NULL), p(NULL), end(NULL) { }
+	void put(const string_ref &s) {
+		const char *data = s.data();
+		size_t size = s.size();
+		while (size > 0) {
+			if (p == end) {
+				flush();
+				size_t n;
+				start = p = buf.prepare(n);
+				end = p + n;
+			}
+			size_t n = end - p;
+			if (n > size)
+				n = size;
+			memcpy(p, data, n);
+			p += n;
+			data += n;
+			size -= n;
+		}
+	}
+	void flush() {
+		if (p > start)
+			buf.commit(p - start);
+		start = p;
+	}
+private:
+	io_buffer &buf;
+	char *start, *p, *end;
+};
+
+} // namespace
+
+string_ref http_response_writer::status_line(http_error::http_error code,
+  int version_minor) {
+	return lines(code, version_minor);
+}
+
+void http_response_writer::write_head(io_buffer &buf,
+  const http_response &resp, int version_minor, int opts) {
+	sink out(buf);
+	out.put(lines(resp._status, version_minor));
+	// the statuses the message length is not sent for (RFC 7230 3.3.2)
+	bool no_length = resp._status < 200 ||
+	  resp._status == http_error::no_content;
+	bool has_date = false;
+	for (http_header::http_headers::const_iterator i = resp.headers.begin();
+	  i != resp.headers.end(); ++i) {
+		bool skip = false;
+		// the headers the writer controls are found by the identifiers
+		switch (i->id()) {
+			case http_fields::connection:
+				skip = (opts & (keep_alive | close)) != 0;
+				break;
+			case http_fields::content_length:
+			case http_fields::transfer_encoding:
+				skip = (opts & chunked) != 0 || no_length;
+				break;
+			case http_fields::date:
+				has_date = true;
+				break;
+			default:
+				break;
+		}
+		if (skip)
+			continue;
+		out.put(i->first);
+		out.put(string_ref(": ", 2));
+		out.put(i->second);
+		out.put(string_ref(CRLF, 2));
+	}
+	for (http_cookies::const_iterator i = resp.cookies.begin();
+	  i != resp.cookies.end(); ++i) {
+		out.put("Set-Cookie: ");
+		out.put(i->str());
+		out.put(string_ref(CRLF, 2));
+	}
+	if (!has_date)
+		out.put(date_header());
+	if (opts & close)
+		out.put("Connection: close" CRLF);
+	else if (opts & keep_alive)
+		out.put("Connection: keep-alive" CRLF);
+	if ((opts & chunked) && !no_length)
+		out.put("Transfer-Encoding: chunked" CRLF);
+	out.put(string_ref(CRLF, 2));
+	out.flush();
+}
+
+void http_response_writer::write(io_buffer &buf, const http_response &resp,
+  int version_minor, int opts) {
+	write_head(buf, resp, version_minor, opts);
+	if (opts & (chunked | no_content))
+		return;
+	if (resp.content_file.handle() >= 0) {
+		// the file region is sent by the socket directly
+		buf.append(resp.content_file, resp.content_offset,
+		  resp.content_file_size);
+	} else if (resp.get_body().file().handle() >= 0) {
+		// so is the content spooled
+		buf.append(resp.get_body().file(), 0, resp.get_body().size());
+	} else if (!resp.get_body().buffer().empty()) {
+		// the slabs shared (the data cached) are sent with no copying
+		buf.append(resp.get_body().buffer());
+	} else if (resp.get_content_size() > 0)
+		buf.append(resp.get_content(), resp.get_content_size());
+}
+
+} // namespace
@@ -0,0 +1,266 @@
+/*
+ * http_router.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <vector>
+
+#include <dcl/http_router.h>
+#include <dcl/i18n.h>
+
+namespace dbp {
+
+using namespace std;
+
+namespace {
+
+// The number of the methods, the handlers are indexed by the method
+const size_t methods = http_method::head + 1;
+
+// Check for the parameter or the rest of the path starts at the position
+bool special(const string &pattern, size_t pos) {
+	return (pattern[pos] == ':' || pattern[pos] == '*') && pos > 0 &&
+	  pattern[pos - 1] == '/';
+}
+
+} // namespace
+
+// The node of the radix tree
+struct http_router::node {
+	node(const string &prefix): prefix(prefix), param(NULL), rest(NULL),
+	  routed(false) { }
+	~node() {
+		for (size_t i = 0; i < children.size(); i++)
+			delete children[i];
+		delete param;
+		delete rest;
+	}
+	// Split the node at the position of the prefix
+	void split(size_t pos) {
+		node *n = new node(prefix.substr(pos));
+		n->indices.swap(indices);
+		n->children.swap(children);
+		n->param = param;
+		n->param_name.swap(param_name);
+		n->rest = rest;
+		n->rest_name.swap(rest_name);
+		for (size_t i = 0; i < methods; i++) {
+			n->handlers[i] = handlers[i];
+			handlers[i] = handler();
+		}
+		n->routed = routed;
+		prefix.resize(pos);
+		param = rest = NULL;
+		routed = false;
+		indices = n->prefix[0];
+		children.push_back(n);
+	}
+	// the static part of the path
+	string prefix;
+	// the first characters of the prefixes of the children
+	string indices;
+	vector<node*> children;
+	// the node following the parameter, and the name of the parameter
+	node *param;
+	string param_name;
+	// the node matching the rest of the path
+	node *rest;
+	string rest_name;
+	handler handlers[methods];
+	bool routed;
+};
+
+http_router::http_router(): root(new node("")) { }
+
+http_router::~http_router() {
+	delete root;
+}
+
+http_router& http_router::add(http_method::http_method method,
+  const std::string &pattern, handler h) {
+	if (pattern.empty() || pattern[0] != '/')
+		throw http_router_exception(_("the route should start with '/'"));
+	if (method == http_method::unknown)
+		throw http_router_exception(_("unknown method of the route"));
+	size_t params = 0;
+	for (size_t i = 0; i < pattern.size(); i++)
+		params += special(pattern, i);
+	if (params > http_request::max_params)
+		throw http_router_exception(_("too many parameters of the route"));
+	node *n = insert(root, pattern, 0);
+	n->handlers[method] = h;
+	n->routed = true;
+	return *this;
+}
+
+http_router& http_router::not_found(handler h) {
+	fallback = h;
+	return *this;
+}
+
+http_router::node* http_router::insert(node *n, const std::string &pattern,
+  size_t pos) {
+	if (pos == pattern.size())
+		return n;
+	if (special(pattern, pos)) {
+		size_t end = pattern.find('/', pos);
+		if (end == string::npos)
+			end = pattern.size();
+		string name = pattern.substr(pos + 1, end - pos - 1);
+		if (name.empty())
+			throw http_router_exception(_("the route parameter has no name"));
+		bool rest = pattern[pos] == '*';
+		if (rest && end != pattern.size())
+			throw http_router_exception(_("the rest of the path should be "
+			  "matched by the last segment of the route"));
+		node *&child = rest ? n->rest : n->param;
+		string &child_name = rest ? n->rest_name : n->param_name;
+		if (!child) {
+			child = new node("");
+			child_name = name;
+		} else if (child_name != name)
+			throw http_router_exception(_("the route parameter conflicts with "
+			  "the parameter ") + child_name);
+		return rest ? child : insert(child, pattern, end);
+	}
+	size_t end = pos;
+	while (end < pattern.size() && !special(pattern, end))
+		end++;
+	size_t i = n->indices.find(pattern[pos]);
+	if (i == string::npos) {
+		node *child = new node(pattern.substr(pos, end - pos));
+		n->indices += pattern[pos];
+		n->children.push_back(child);
+		return insert(child, pattern, end);
+	}
+	// the common prefix of the child and the pattern
+	node *child = n->children[i];
+	size_t len = 0;
+	while (len < child->prefix.size() && pos + len < end &&
+	  child->prefix[len] == pattern[pos + len])
+		len++;
+	if (len < child->prefix.size())
+		child->split(len);
+	return insert(child, pattern, pos + len);
+}
+
+bool http_router::match(const node *n, const string_ref &path, size_t pos,
+  const http_request &req, const node *&rslt) const {
+	if (pos == path.size()) {
+		if (n->routed) {
+			rslt = n;
+			return true;
+		}
+	} else {
+		const void *c = memchr(n->indices.data(), path[pos],
+		  n->indices.size());
+		if (c) {
+			const node *child = n->children[static_cast<const char*>(c) -
+			  n->indices.data()];
+			size_t len = child->prefix.size();
+			if (path.size() - pos >= len &&
+			  memcmp(path.data() + pos, child->prefix.data(), len) == 0 &&
+			  match(child, path, pos + len, req, rslt))
+				return true;
+		}
+		if (n->param && req._params < http_request::max_params) {
+			size_t end = pos;
+			while (end < path.size() && path[end] != '/')
+				end++;
+			if (end > pos) {
+				req._param_names[req._params] = n->param_name;
+				req._param_values[req._params] = make_pair(pos, end - pos);
+				req._params++;
+				if (match(n->param, path, end, req, rslt))
+					return true;
+				req._params--;
+			}
+		}
+	}
+	// the rest of the path matched may be empty
+	if (n->rest && req._params < http_request::max_params) {
+		req._param_names[req._params] = n->rest_name;
+		req._param_values[req._params] = make_pair(pos, path.size() - pos);
+		req._params++;
+		rslt = n->rest;
+		return true;
+	}
+	return false;
+}
+
+const http_router::node* http_router::match(const http_request &req) const {
+	req._params = 0;
+	// the query is not matched
+	const string &target = req.get_path_info();
+	size_t size = target.find('?');
+	const node *rslt = NULL;
+	if (match(root, string_ref(target.data(),
+	  size == string::npos ? target.size() : size), 0, req, rslt))
+		return rslt;
+	return NULL;
+}
+
+http_error::http_error http_router::find(const http_request &req,
+  handler &h) const {
+	const node *n = match(req);
+	if (!n)
+		return http_error::not_found;
+	http_method::http_method method = req.get_method();
+	if (method == http_method::head && n->handlers[method].empty())
+		method = http_method::get;
+	if (method == http_method::unknown || n->handlers[method].empty())
+		return http_error::method_not_allowed;
+	h = n->handlers[method];
+	return http_error::ok;
+}
+
+http_response http_router::route(const http_request &req) {
+	handler h;
+	http_error::http_error status = find(req, h);
+	if (status == http_error::ok)
+		return h(req);
+	if (status == http_error::not_found && !fallback.empty())
+		return fallback(req);
+	http_response resp;
+	resp.set_status(status);
+	resp.set_content(http_error::reason(status));
+	if (status == http_error::method_not_allowed) {
+		// the methods the path has the handlers for
+		const node *n = match(req);
+		string allow;
+		for (size_t i = 0; i < methods; i++) {
+			bool head = i == http_method::head &&
+			  !n->handlers[http_method::get].empty();
+			if (n->handlers[i].empty() && !head)
+				continue;
+			if (!allow.empty())
+				allow += ", ";
+			allow += http_method::token(http_method::http_method(i)).str();
+		}
+		resp.set_header("Allow", allow);
+	}
+	return resp;
+}
+
+} // namespace
@@ -20,6 +20,7 @@
  */
 
 #include <algorithm>
+#include <stdio.h>
 #include <iterator>
 
 #include <dcl/delegate.h>
@@ -29,130 +30,369 @@
 namespace dbp {
 
 #define IO_BUF_SIZE 1500
+// The default maximum number of the requests served per connection
+#define MAX_REQUESTS 1000
+// The default maximum size of the request body
+#define MAX_BODY_SIZE (1024 * 1048576ULL)
 
 using namespace std;
 
+namespace {
+
+// Check for the comma-separated list contains the token given (such as
+// the Connection header options)
+bool has_token(const string_ref &list, const string_ref &token) {
+	const char *p = list.begin();
+	while (p != list.end()) {
+		while (p != list.end() && (*p == ' ' || *p == '\t' || *p == ','))
+			++p;
+		const char *start = p;
+		while (p != list.end() && *p != ',')
+			++p;
+		const char *end = p;
+		while (end != start && (end[-1] == ' ' || end[-1] == '\t'))
+			--end;
+		if (string_ref(start, end - start).equals_nocase(token))
+			return true;
+	}
+	return false;
+}
+
+} // namespace
+
+// The response completed by the deferred request handler
+struct http_server::deferred_response::state {
+	state(const tcp_server::completion &c): refs(1), copies(0), done(false),
+	  resume(c) { }
+	// the references of the responses and of the connection
+	int refs;
+	// the number of the responses
+	int copies;
+	mutex lock;
+	bool done;
+	http_response resp;
+	// the connection waiting for the response
+	tcp_server::completion resume;
+};
+
+// http_server::deferred_response
+
+http_server::deferred_response::deferred_response(state *value): s(value) {
+	__sync_add_and_fetch(&s->refs, 1);
+	__sync_add_and_fetch(&s->copies, 1);
+}
+
+http_server::deferred_response::deferred_response(
+  const deferred_response &src): s(src.s) {
+	if (s) {
+		__sync_add_and_fetch(&s->refs, 1);
+		__sync_add_and_fetch(&s->copies, 1);
+	}
+}
+
+http_server::deferred_response& http_server::deferred_response::operator=(
+  const deferred_response &src) {
+	if (s != src.s) {
+		deferred_response tmp(src);
+		std::swap(s, tmp.s);
+	}
+	return *this;
+}
+
+http_server::deferred_response::~deferred_response() {
+	if (!s)
+		return;
+	// the connection is processed again when the last response is gone,
+	// to answer with the error if it is not completed
+	if (__sync_sub_and_fetch(&s->copies, 1) == 0)
+		s->resume.complete();
+	unref(s);
+}
+
+void http_server::deferred_response::complete(const http_response &resp) {
+	if (!s)
+		return;
+	s->lock.enter();
+	bool first = !s->done;
+	if (first) {
+		s->resp = resp;
+		s->done = true;
+	}
+	s->lock.leave();
+	if (first)
+		s->resume.complete();
+}
+
+void http_server::deferred_response::unref(state *value) {
+	if (value && __sync_sub_and_fetch(&value->refs, 1) == 0)
+		delete value;
+}
+
 http_server::http_server(size_t worker_threads, size_t queue_size):
-  tcp_server::tcp_server(worker_threads, queue_size) {
+  tcp_server::tcp_server(worker_threads, queue_size),
+  _max_requests(MAX_REQUESTS), _max_body_size(MAX_BODY_SIZE),
+  _body_spool_size(http_body::default_spool_size),
+  _body_spool_dir(http_body().spool_dir()), _compressor(NULL) {
 	on_process_data(create_delegate(this, &http_server::process_data));
+	// the response to the connections rejected on overload
+	overload_response("HTTP/1.1 503 Service Unavailable\r\n"
+	  "Content-Length: 0\r\nConnection: close\r\n\r\n");
 }
 
 bool http_server::process_data(const socket &connection,
   std::istream &in, std::ostream &out) {
 	// if there is no on_request event handler assigned, exit
-	if (!request_handler)
+	if (!request_handler && !deferred_handler)
 		return false;
-	// obtain the request related to socket handle
-	request *req = NULL;
-	{
-		mutex_guard m(lock);
-		requests::iterator it = reqs.find(connection.handle());
-		if (it != reqs.end())
-			req = it->second;
-		else
-			req = new request();
+	// the requests are parsed in place in the receive buffer and the
+	// responses are appended to the send buffer, which the tcp_server
+	// provides as the io_streams
+	io_stream *input = dynamic_cast<io_stream*>(&in);
+	io_stream *output = dynamic_cast<io_stream*>(&out);
+	if (!input || !output)
+		return false;
+	// the request state is attached to the connection
+	request *req = tcp_server::attached<request>(in);
+	if (!req) {
+		req = new request();
+		tcp_server::attach(in, req);
 	}
 	// state machine
 	while (1) {
 		// construct the http request
 		switch (req->state) {
-			case request::WAIT_COMMAND: {
-				// read full line into the buffer
-				string buf;
-				size_t pos = in.tellg();
-				getline(in, buf);
-				if (in.eof()) {
-					in.seekg(pos);
-					{
-						mutex_guard m(lock);
-						reqs[connection.handle()] = req;
-					}
-					return true;
-				}
-				// parse the HTTP command
-				pos = buf.find_first_of(' ');
-				// Cut out method name
-				if (pos != string::npos) {
-					req->req.set_method(trim()(buf.substr(0, pos + 1)));
-					buf.erase(0, pos + 1);
-				}
-				// Cut out protocol version
-				pos = buf.find_last_of(' ');
-				if (pos != string::npos) {
-					req->req.http_version(trim()(buf.substr(pos + 1)));
-					buf.erase(pos);
-				}
-				// The remaining is a path_info
-				req->req.set_path_info(buf);
-				// Next data chunk should be http header
-				req->state = request::WAIT_HEADER;
-				break;
-			}
 			case request::WAIT_HEADER: {
-				// read full line into the buffer
-				string buf;
-				int pos = in.tellg();
-				getline(in, buf);
-				if (in.eof()) {
-					in.seekg(pos);
-					{
-						mutex_guard m(lock);
-						reqs[connection.handle()] = req;
-					}
+				size_t size = req->parser.max_head_size();
+				const char *data = input->pullup(size);
+				http_request_parser::result rslt = data ?
+				  req->parser.parse(data, size) :
+				  http_request_parser::incomplete;
+				if (rslt == http_request_parser::incomplete)
 					return true;
-				}
-				req->req.set_header(trim()(buf));
-				// when blank line - headers end
-				if (trim()(buf).empty()) {
-					if (!req->req.get_header("Content-Length").empty()) {
-						req->data_size = from_string<size_t>(
-						  req->req.get_header("Content-Length"));
-					}
-					req->state = request::RECEIVING_DATA;
-				}
+				http_error::http_error code =
+				  rslt == http_request_parser::error ?
+				  req->parser.error_code() : parse_header(*req, in);
+				if (code != http_error::ok)
+					return reject_request(*output, code);
+				req->state = req->chunked_input ? request::RECEIVING_CHUNKS :
+				  request::RECEIVING_DATA;
 				break;
 			}
 			case request::RECEIVING_DATA: {
 				// if there are data available
-				if (req->data_size > 0) {
-					if (in.eof()) {
-						mutex_guard m(lock);
-						reqs[connection.handle()] = req;
+				if (req->data_readed < req->data_size) {
+					streamsize avail = in.rdbuf()->in_avail();
+					if (avail <= 0)
 						return true;
-					}
-					size_t pos = in.tellg();
-					req->req.add_content(in);
-					req->data_readed += in.tellg();
-					req->data_readed -= pos;
-					if (req->data_readed >= req->data_size)
-						req->state = request::PROCESS_REQUEST;
+					// the data after the body belongs to the next request
+					size_t size = req->data_size - req->data_readed;
+					if (size > size_t(avail))
+						size = avail;
+					req->req.add_content(size, in);
+					req->data_readed += size;
 				} else
 					req->state = request::PROCESS_REQUEST;
 				break;
 			}
+			case request::RECEIVING_CHUNKS: {
+				// the chunks are decoded as they are received
+				size_t size;
+				const char *data = input->peek(size);
+				if (!data)
+					return true;
+				size_t consumed;
+				string_ref chunk;
+				http_chunked_parser::result rslt =
+				  req->chunks.parse(data, size, consumed, chunk);
+				if (_max_body_size > 0 && chunk.size() >
+				  _max_body_size - req->req.get_body().size())
+					return reject_request(*output,
+					  http_error::request_entity_too_large);
+				if (!chunk.empty())
+					req->req.add_content(chunk.size(), chunk.data());
+				in.seekg(consumed, ios::cur);
+				if (rslt == http_chunked_parser::error) {
+					return reject_request(*output, http_error::bad_request);
+				}
+				if (rslt == http_chunked_parser::complete)
+					req->state = request::PROCESS_REQUEST;
+				break;
+			}
 			case request::PROCESS_REQUEST: {
-				if (request_handler) {
-					http_response resp = request_handler(req->req);
-					out << req->req.http_version() << " " <<
-					  resp.get_status() << endl << resp << flush;
+				if (deferred_handler) {
+					// the working thread is not waiting for the response,
+					// the connection is processed again when it is ready
+					req->state = request::WAIT_RESPONSE;
+					req->deferred = new deferred_response::state(
+					  tcp_server::suspend(in));
+					deferred_handler(req->req,
+					  deferred_response(req->deferred));
+					return true;
 				}
-				req->state = request::CLOSING;
+				http_response resp = request_handler(req->req);
+				send_response(*req, resp, *output);
 				break;
 			}
-			case request::CLOSING: {
-				bool keep_alive = (req->req.get_header("Connection") ==
-				  "keep-alive");
-				{
-					mutex_guard m(lock);
-					delete req;
-					reqs.erase(connection.handle());
+			case request::WAIT_RESPONSE: {
+				// the response is not completed if all the deferred
+				// responses are destroyed
+				deferred_response::state *d = req->deferred;
+				d->lock.enter();
+				http_response resp;
+				if (d->done)
+					resp = d->resp;
+				else {
+					resp.set_status(http_error::internal_server_error);
+					resp.set_content(resp.get_status());
 				}
-				// keep connection on keep-alive
-				return keep_alive;
+				d->lock.leave();
+				send_response(*req, resp, *output);
+				break;
+			}
+			case request::SENDING_CHUNKS: {
+				// the part is produced when the previous one is sent, so
+				// the output buffered is bounded
+				bool more = req->producer(req->output);
+				io_buffer &part = req->output.buffer();
+				if (!part.empty()) {
+					if (req->chunked_output) {
+						char size[32];
+						snprintf(size, sizeof(size), "%lx" CRLF,
+						  static_cast<unsigned long>(part.size()));
+						out << size;
+					}
+					output->buffer().append(part);
+					if (req->chunked_output)
+						out << CRLF;
+				}
+				req->output.reset();
+				if (more) {
+					tcp_server::resume_on_drain(out);
+					return true;
+				}
+				// the last chunk, with no trailer
+				if (req->chunked_output)
+					out << "0" CRLF CRLF;
+				out << flush;
+				req->producer = http_response::content_producer();
+				req->state = request::RESPONSE_SENT;
+				break;
+			}
+			case request::RESPONSE_SENT: {
+				if (!req->keep_alive)
+					return false;
+				// the next request may be received already (pipelined),
+				// it is processed in order
+				req->next();
 				break;
 			}
 		} // switch
 	} // while
 }
 
+void http_server::send_response(request &req, http_response &resp,
+  io_stream &out) {
+	if (_compressor) {
+		delete req.compression;
+		req.compression = _compressor->filter(req.req, resp);
+	}
+	int minor = req.parser.version_minor();
+	// the connection is kept if both sides agree and the limit of the
+	// requests is not reached
+	req.served++;
+	req.keep_alive = req.keep_alive &&
+	  !has_token(resp.get_connection(), "close") &&
+	  (_max_requests == 0 || req.served < _max_requests);
+	// the response to HEAD has the headers of the response to GET, and
+	// the responses of some statuses have no content at all (RFC 7230
+	// 3.3.3); the content is not sent, or the framing would be broken
+	http_error::http_error code = resp.get_status_code();
+	bool no_content = code < 200 || code == http_error::no_content ||
+	  code == http_error::not_modified;
+	bool head_only = no_content ||
+	  req.req.get_method() == http_method::head;
+	// the content produced by parts is sent by chunks, or up to the
+	// connection close to HTTP/1.0 clients
+	bool produced = resp.get_content_producer() && !no_content;
+	req.chunked_output = produced && minor > 0;
+	if (produced && !req.chunked_output)
+		req.keep_alive = false;
+	req.producer = head_only ? http_response::content_producer() :
+	  resp.get_content_producer();
+	// the connection management headers are written by the writer, the
+	// response is not changed for them
+	int opts = 0;
+	if (req.chunked_output)
+		opts |= http_response_writer::chunked;
+	if (!req.keep_alive)
+		opts |= http_response_writer::close;
+	else if (minor == 0)
+		opts |= http_response_writer::keep_alive;
+	if (head_only)
+		opts |= http_response_writer::no_content;
+	http_response_writer::write(out.buffer(), resp, minor, opts);
+	req.state = req.producer ? request::SENDING_CHUNKS :
+	  request::RESPONSE_SENT;
+}
+
+bool http_server::reject_request(io_stream &out,
+  http_error::http_error code) {
+	// the malformed request is answered, then the connection is closed
+	http_response resp;
+	resp.set_status(code);
+	resp.set_content(resp.get_status());
+	http_response_writer::write(out.buffer(), resp, 1,
+	  http_response_writer::close);
+	return false;
+}
+
+http_error::http_error http_server::parse_header(request &req,
+  std::istream &in) {
+	const http_request_parser &p = req.parser;
+	req.req.set_method(p.method());
+	req.req.http_version(p.version().str());
+	req.req.set_path_info(p.target().str());
+	for (size_t i = 0; i < p.headers_count(); i++)
+		req.req.set_header(p.header_name(i), p.header_value(i));
+	// HTTP/1.1 connections are persistent by default, HTTP/1.0 ones
+	// should be asked to be kept
+	string_ref connection = p.get_header("Connection");
+	if (p.version_minor() == 0)
+		req.keep_alive = has_token(connection, "keep-alive");
+	else
+		req.keep_alive = !has_token(connection, "close");
+	string_ref length = p.get_header("Content-Length");
+	// only the chunked transfer coding is supported; the message having
+	// the length as well can't be trusted (RFC 7230 3.3.3)
+	string_ref coding = p.get_header("Transfer-Encoding");
+	if (!coding.empty()) {
+		if (!coding.equals_nocase("chunked"))
+			return http_error::not_implemented;
+		if (!length.empty())
+			return http_error::bad_request;
+		req.chunked_input = true;
+	}
+	// Content-Length = 1*DIGIT
+	if (!length.empty()) {
+		size_t size = 0;
+		for (const char *c = length.begin(); c != length.end(); ++c) {
+			if (*c < '0' || *c > '9')
+				return http_error::bad_request;
+			if (size > (size_t(-1) - 9) / 10)
+				return http_error::request_entity_too_large;
+			size = size * 10 + (*c - '0');
+		}
+		if (_max_body_size > 0 && size > _max_body_size)
+			return http_error::request_entity_too_large;
+		req.data_size = size;
+	}
+	// the body is received into the store, no more than the spool size
+	// is allocated in advance
+	req.req.get_body().spool_size(_body_spool_size).
+	  spool_dir(_body_spool_dir).reserve(req.data_size);
+	// the body follows the headers
+	in.seekg(p.head_size(), ios::cur);
+	return http_error::ok;
+}
+
 } // namespace
@@ -0,0 +1,566 @@
+/*
+ * io_buffer.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
+
+#include <dcl/filefs.h>
+#include <dcl/i18n.h>
+#include <dcl/io_buffer.h>
+#include <dcl/mpmc_queue.h>
+
+namespace dbp {
+
+// The maximum number of free slabs kept for reuse
+#define IO_SLAB_POOL_SIZE 1024
+
+using namespace std;
+
+const size_t io_buffer::slab_size;
+
+struct io_buffer::slab {
+	size_t refs;
+	size_t used;
+	size_t capacity;
+	char data[slab_size];
+};
+
+namespace {
+
+// The pool is never destroyed, since the buffers owned by the static
+// objects may be released after it
+mpmc_queue<void*>& pool() {
+	static mpmc_queue<void*> *p = new mpmc_queue<void*>(IO_SLAB_POOL_SIZE);
+	return *p;
+}
+
+} // namespace
+
+io_file::io_file(int handle): d(new data) {
+	d->refs = 1;
+	d->handle = handle;
+}
+
+io_file::io_file(const std::string &path): d(NULL) {
+#ifdef _WIN32
+	int handle = ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	int handle = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+	if (handle < 0)
+		throw io_buffer_exception(strerror(errno));
+	struct stat st;
+	if (::fstat(handle, &st) != 0 || !S_ISREG(st.st_mode)) {
+		::close(handle);
+		throw io_buffer_exception(_("not a regular file"));
+	}
+	d = new data;
+	d->refs = 1;
+	d->handle = handle;
+}
+
+io_file::io_file(const io_file &src): d(src.d) {
+	if (d)
+		__sync_add_and_fetch(&d->refs, 1);
+}
+
+io_file& io_file::operator=(const io_file &src) {
+	if (d != src.d) {
+		release();
+		d = src.d;
+		if (d)
+			__sync_add_and_fetch(&d->refs, 1);
+	}
+	return *this;
+}
+
+io_file::~io_file() {
+	release();
+}
+
+void io_file::release() {
+	if (d && __sync_sub_and_fetch(&d->refs, 1) == 0) {
+		if (d->handle >= 0)
+			::close(d->handle);
+		delete d;
+	}
+	d = NULL;
+}
+
+uint64_t io_file::size() const {
+	struct stat st;
+	if (!d || ::fstat(d->handle, &st) != 0)
+		return 0;
+	return st.st_size;
+}
+
+int io_file::read(uint64_t offset, size_t size, char *buffer) const {
+	if (!d)
+		return -1;
+#ifdef _WIN32
+	if (::_lseeki64(d->handle, offset, SEEK_SET) < 0)
+		return -1;
+	return ::_read(d->handle, buffer, size);
+#else
+	ssize_t rslt;
+	do {
+		rslt = ::pread(d->handle, buffer, size, offset);
+	} while (rslt < 0 && errno == EINTR);
+	return rslt;
+#endif
+}
+
+int io_file::write(uint64_t offset, size_t size, const char *buffer) {
+	if (!d)
+		return -1;
+#ifdef _WIN32
+	if (::_lseeki64(d->handle, offset, SEEK_SET) < 0)
+		return -1;
+	return ::_write(d->handle, buffer, size);
+#else
+	ssize_t rslt;
+	do {
+		rslt = ::pwrite(d->handle, buffer, size, offset);
+	} while (rslt < 0 && errno == EINTR);
+	return rslt;
+#endif
+}
+
+io_file io_file::temporary(const std::string &dir) {
+#ifdef _WIN32
+	char *name = ::_tempnam(dir.empty() ? filefs().get_temp_dir().c_str() :
+	  dir.c_str(), "dcl");
+	int handle = name ? ::_open(name, _O_CREAT | _O_EXCL | _O_RDWR |
+	  _O_BINARY | _O_TEMPORARY, _S_IREAD | _S_IWRITE) : -1;
+	free(name);
+#else
+	int handle = -1;
+#ifdef HAVE_MEMFD_CREATE
+	if (dir.empty())
+		handle = ::memfd_create("dcl", MFD_CLOEXEC);
+#endif
+	std::string path = dir.empty() ? filefs().get_temp_dir() : dir;
+#ifdef O_TMPFILE
+	if (handle < 0)
+		handle = ::open(path.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+	if (handle < 0) {
+		// the file system does not support the unnamed files
+		std::string name = path + "/dclXXXXXX";
+		handle = ::mkstemp(&name[0]);
+		if (handle >= 0) {
+			::unlink(name.c_str());
+			::fcntl(handle, F_SETFD, FD_CLOEXEC);
+		}
+	}
+#endif
+	if (handle < 0)
+		throw io_buffer_exception(strerror(errno));
+	return io_file(handle);
+}
+
+io_buffer::slab* io_buffer::acquire(size_t capacity) {
+	void *p;
+	// only the slabs of the standard size are reused
+	if (capacity <= slab_size) {
+		capacity = slab_size;
+		if (!pool().pop(p))
+			p = ::operator new(sizeof(slab));
+	} else
+		p = ::operator new(offsetof(slab, data) + capacity);
+	slab *s = static_cast<slab*>(p);
+	s->refs = 1;
+	s->used = 0;
+	s->capacity = capacity;
+	return s;
+}
+
+void io_buffer::release(slab *s) {
+	if (__sync_sub_and_fetch(&s->refs, 1) > 0)
+		return;
+	if (s->capacity != slab_size || !pool().push(s))
+		::operator delete(s);
+}
+
+io_buffer::io_buffer(): _size(0) {
+}
+
+io_buffer::io_buffer(const io_buffer &src): _size(0) {
+	append(src);
+}
+
+io_buffer& io_buffer::operator=(const io_buffer &src) {
+	if (this != &src) {
+		clear();
+		append(src);
+	}
+	return *this;
+}
+
+io_buffer::~io_buffer() {
+	clear();
+}
+
+void io_buffer::clear() {
+	for (segments_list::iterator i = segs.begin(); i != segs.end(); ++i) {
+		if (i->owner)
+			release(i->owner);
+	}
+	segs.clear();
+	_size = 0;
+}
+
+char* io_buffer::prepare(size_t &size) {
+	// write to the last slab if it has a room and is not shared
+	if (!segs.empty()) {
+		segment &t = segs.back();
+		if (t.owner && __atomic_load_n(&t.owner->refs, __ATOMIC_ACQUIRE) == 1 &&
+		  t.end == t.owner->data + t.owner->used &&
+		  t.owner->used < t.owner->capacity) {
+			size = t.owner->capacity - t.owner->used;
+			return t.end;
+		}
+	}
+	segment s;
+	s.owner = acquire();
+	s.begin = s.end = s.owner->data;
+	segs.push_back(s);
+	size = slab_size;
+	return s.end;
+}
+
+void io_buffer::commit(size_t size) {
+	if (size == 0)
+		return;
+	segment &t = segs.back();
+	t.end += size;
+	t.owner->used += size;
+	_size += size;
+}
+
+void io_buffer::append(const char *data, size_t size) {
+	while (size > 0) {
+		size_t n;
+		char *p = prepare(n);
+		if (n > size)
+			n = size;
+		memcpy(p, data, n);
+		commit(n);
+		data += n;
+		size -= n;
+	}
+}
+
+void io_buffer::append(const io_buffer &src) {
+	append(src, 0, src._size);
+}
+
+void io_buffer::append(const io_buffer &src, size_t offset, size_t size) {
+	for (segments_list::const_iterator i = src.segs.begin();
+	  i != src.segs.end() && size > 0; ++i) {
+		size_t n = i->size();
+		if (offset >= n) {
+			offset -= n;
+			continue;
+		}
+		// the segment is cut to the part requested
+		segment s = *i;
+		n -= offset;
+		if (n > size)
+			n = size;
+		if (s.owner) {
+			__sync_add_and_fetch(&s.owner->refs, 1);
+			s.begin += offset;
+			s.end = s.begin + n;
+		} else {
+			s.offset += offset;
+			s.length = n;
+		}
+		segs.push_back(s);
+		_size += n;
+		size -= n;
+		offset = 0;
+	}
+}
+
+void io_buffer::append(const io_file &file, uint64_t offset, size_t size) {
+	if (size == 0)
+		return;
+	segment s;
+	s.owner = NULL;
+	s.begin = s.end = NULL;
+	s.file = file;
+	s.offset = offset;
+	s.length = size;
+	segs.push_back(s);
+	_size += size;
+}
+
+void io_buffer::consume(size_t size) {
+	if (size > _size)
+		size = _size;
+	_size -= size;
+	while (!segs.empty()) {
+		segment &s = segs.front();
+		size_t n = s.size();
+		if (size < n || (size == 0 && segs.size() == 1 && s.owner)) {
+			if (s.owner) {
+				s.begin += size;
+			} else {
+				s.offset += size;
+				s.length -= size;
+			}
+			break;
+		}
+		size -= n;
+		if (s.owner)
+			release(s.owner);
+		segs.pop_front();
+	}
+}
+
+int io_buffer::segments(int count, io_vector *vectors, size_t offset) const {
+	int n = 0;
+	for (segments_list::const_iterator i = segs.begin();
+	  i != segs.end() && n < count; ++i) {
+		// the file region is not accessible as the memory
+		if (!i->owner)
+			break;
+		size_t size = i->end - i->begin;
+		if (offset >= size) {
+			offset -= size;
+			continue;
+		}
+		vectors[n].data = i->begin + offset;
+		vectors[n].size = size - offset;
+		offset = 0;
+		n++;
+	}
+	return n;
+}
+
+bool io_buffer::file_region(io_file &file, uint64_t &offset,
+  size_t &size) const {
+	for (segments_list::const_iterator i = segs.begin(); i != segs.end(); ++i) {
+		if (i->owner) {
+			if (i->begin != i->end)
+				return false;
+			continue;
+		}
+		file = i->file;
+		offset = i->offset;
+		size = i->length;
+		return true;
+	}
+	return false;
+}
+
+char* io_buffer::pullup(size_t offset, size_t size) {
+	if (size == 0 || offset + size > _size)
+		return NULL;
+	// the segment the data begins in
+	size_t first = 0;
+	while (offset >= segs[first].size()) {
+		offset -= segs[first].size();
+		first++;
+	}
+	segment &f = segs[first];
+	if (!f.owner)
+		return NULL;
+	if (offset + size <= f.size())
+		return f.begin + offset;
+	// the segment the data ends in, and the size of the data in it
+	size_t last = first;
+	size_t tail = offset + size - f.size();
+	while (tail > segs[++last].size() || !segs[last].owner) {
+		if (!segs[last].owner)
+			return NULL;
+		tail -= segs[last].size();
+	}
+	// copy the data into the new slab, the free space of which will be
+	// used by the data appended
+	segment s;
+	s.owner = acquire(size);
+	s.begin = s.end = s.owner->data;
+	memcpy(s.end, f.begin + offset, f.size() - offset);
+	s.end += f.size() - offset;
+	for (size_t i = first + 1; i < last; i++) {
+		memcpy(s.end, segs[i].begin, segs[i].size());
+		s.end += segs[i].size();
+	}
+	memcpy(s.end, segs[last].begin, tail);
+	s.end += tail;
+	s.owner->used = size;
+	// the beginning of the first segment and the end of the last one
+	// remain, the segments between are replaced
+	segs[last].begin += tail;
+	if (segs[last].begin == segs[last].end) {
+		release(segs[last].owner);
+		last++;
+	}
+	if (offset > 0) {
+		f.end = f.begin + offset;
+		first++;
+	}
+	for (size_t i = first; i < last; i++)
+		release(segs[i].owner);
+	segs.erase(segs.begin() + first, segs.begin() + last);
+	segs.insert(segs.begin() + first, s);
+	return s.begin;
+}
+
+io_streambuf::io_streambuf(): base(0), goff(0) {
+}
+
+void io_streambuf::commit_put() {
+	if (pptr() > pbase()) {
+		buf.commit(pptr() - pbase());
+		setp(pptr(), epptr());
+	}
+}
+
+void io_streambuf::set_read_offset(size_t offset) {
+	io_vector v;
+	goff = offset;
+	if (buf.segments(1, &v, offset) > 0)
+		setg(v.data, v.data, v.data + v.size);
+	else
+		setg(NULL, NULL, NULL);
+}
+
+void io_streambuf::compact() {
+	commit_put();
+	size_t offset = read_offset();
+	buf.consume(offset);
+	base = buf.empty() ? 0 : base + offset;
+	set_read_offset(0);
+}
+
+void io_streambuf::reset() {
+	setp(NULL, NULL);
+	buf.clear();
+	base = 0;
+	set_read_offset(0);
+}
+
+const char* io_streambuf::pullup(size_t &size) {
+	commit_put();
+	size_t offset = read_offset();
+	if (size > buf.size() - offset)
+		size = buf.size() - offset;
+	const char *p = buf.pullup(offset, size);
+	// the get area may refer to the memory moved
+	set_read_offset(offset);
+	return p;
+}
+
+const char* io_streambuf::peek(size_t &size) {
+	commit_put();
+	// the get area is the part of the segment, and some data may be
+	// appended to it
+	set_read_offset(read_offset());
+	size = egptr() - gptr();
+	return size > 0 ? gptr() : NULL;
+}
+
+io_streambuf::int_type io_streambuf::underflow() {
+	commit_put();
+	// the get area is the part of the segment, and some data may be
+	// appended to it
+	set_read_offset(read_offset());
+	if (gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+	return traits_type::eof();
+}
+
+io_streambuf::int_type io_streambuf::overflow(int_type c) {
+	commit_put();
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+	size_t size;
+	char *p = buf.prepare(size);
+	setp(p, p + size);
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+std::streamsize io_streambuf::showmanyc() {
+	commit_put();
+	size_t offset = read_offset();
+	return offset < buf.size() ? buf.size() - offset : -1;
+}
+
+int io_streambuf::sync() {
+	commit_put();
+	// the buffer may be drained by the caller, so do not keep the pointer
+	setp(NULL, NULL);
+	return 0;
+}
+
+io_streambuf::pos_type io_streambuf::seekoff(off_type off,
+  std::ios_base::seekdir way, std::ios_base::openmode which) {
+	commit_put();
+	off_type pos;
+	if (which & std::ios_base::in) {
+		if (way == std::ios_base::beg)
+			pos = off;
+		else if (way == std::ios_base::cur)
+			pos = base + read_offset() + off;
+		else
+			pos = base + buf.size() + off;
+		return seekpos(pos, which);
+	}
+	// only the current output position can be obtained
+	if ((which & std::ios_base::out) && off == 0 && way != std::ios_base::beg)
+		return pos_type(off_type(base + buf.size()));
+	return pos_type(off_type(-1));
+}
+
+io_streambuf::pos_type io_streambuf::seekpos(pos_type pos,
+  std::ios_base::openmode which) {
+	commit_put();
+	off_type p = pos;
+	if (!(which & std::ios_base::in) || p < off_type(base) ||
+	  p > off_type(base + buf.size()))
+		return pos_type(off_type(-1));
+	set_read_offset(p - base);
+	return pos;
+}
+
+} // namespace
@@ -19,12 +19,16 @@
  * Boston, MA  02110-1301  USA
  */
 
+#include <vector>
+
+#include <dcl/mutex.h>
 #include <dcl/singleton.h>
 #include <dcl/ssl_socket.h>
 #include <dcl/strutils.h>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/x509.h>
 
 namespace dbp {
 
@@ -47,6 +51,141 @@ private:
 	}
 };
 
+class ssl_context_impl {
+public:
+	ssl_context_impl(): cache_size(SESSION_CACHE_SIZE),
+	  timeout(SESSION_TIMEOUT), tickets(true), ktls(false), ctx(NULL) {
+		openssl_init::instance();
+	}
+	~ssl_context_impl() {
+		SSL_CTX_free(ctx);
+	}
+	//! Load certificates from files
+	void load_certificates(
+	  const std::string &ca,
+	  const std::string &cert, const std::string &key,
+	  const std::string &crl) {
+		loading.enter();
+		SSL_CTX *c = NULL;
+		try {
+			c = create(ca, cert, key, crl);
+		}
+		catch (...) {
+			SSL_CTX_free(c);
+			loading.leave();
+			throw;
+		}
+		// the connections established keep the old context, it is
+		// freed by the last of them
+		lock.enter();
+		SSL_CTX *old = ctx;
+		ctx = c;
+		ca_file = ca;
+		cert_file = cert;
+		key_file = key;
+		crl_file = crl;
+		lock.leave();
+		loading.leave();
+		SSL_CTX_free(old);
+	}
+	//! Reload certificates from the same files
+	void reload() {
+		lock.enter();
+		string ca = ca_file, cert = cert_file, key = key_file,
+		  crl = crl_file;
+		lock.leave();
+		load_certificates(ca, cert, key, crl);
+	}
+	//! Create the connection of the current context
+	SSL* create_ssl() {
+		lock.enter();
+		SSL *ssl = ctx ? SSL_new(ctx) : NULL;
+		lock.leave();
+		if (!ssl)
+			throw socket_exception(_("can't initialize SSL context"));
+		return ssl;
+	}
+	size_t cache_size;
+	int timeout;
+	bool tickets;
+	bool ktls;
+private:
+	mutex lock, loading;
+	SSL_CTX *ctx;
+	string ca_file, cert_file, key_file, crl_file;
+	// the keys the session tickets are encrypted with
+	vector<unsigned char> ticket_keys;
+	SSL_CTX* create(
+	  const std::string &ca,
+	  const std::string &cert, const std::string &key,
+	  const std::string &crl) {
+		SSL_CTX *c = SSL_CTX_new(SSLv23_server_method());
+		if (!c)
+			throw socket_exception(_("can't initialize SSL context"));
+		if (!ca.empty() &&
+		  SSL_CTX_load_verify_locations(c, ca.c_str(), NULL) != 1) {
+			SSL_CTX_free(c);
+			throw socket_exception(_("invalid CA certificate"));
+		}
+		if (!crl.empty()) {
+			X509_STORE *store = SSL_CTX_get_cert_store(c);
+			X509_LOOKUP *lookup = X509_STORE_add_lookup(store,
+			  X509_LOOKUP_file());
+			if (!lookup || X509_load_crl_file(lookup, crl.c_str(),
+			  X509_FILETYPE_PEM) <= 0) {
+				SSL_CTX_free(c);
+				throw socket_exception(_("can't load CRL file"));
+			}
+			X509_STORE_set_flags(store, X509_V_FLAG_CRL_CHECK |
+			  X509_V_FLAG_CRL_CHECK_ALL);
+		}
+		if (cert.empty() ||
+		  SSL_CTX_use_certificate_chain_file(c, cert.c_str()) <= 0) {
+			SSL_CTX_free(c);
+			throw socket_exception(_("can't load certificate file"));
+		}
+		if (key.empty() || SSL_CTX_use_PrivateKey_file(c, key.c_str(),
+		  SSL_FILETYPE_PEM) <= 0) {
+			SSL_CTX_free(c);
+			throw socket_exception(_("can't load private key file"));
+		}
+		if (!SSL_CTX_check_private_key(c)) {
+			SSL_CTX_free(c);
+			throw socket_exception(_("private key is invalid"));
+		}
+		SSL_CTX_set_mode(c, SSL_MODE_AUTO_RETRY |
+		  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+		// the sessions are resumed by their identifiers from the cache...
+		static const unsigned char id[] = "dcl";
+		SSL_CTX_set_session_id_context(c, id, sizeof(id) - 1);
+		if (cache_size > 0) {
+			SSL_CTX_set_session_cache_mode(c, SSL_SESS_CACHE_SERVER);
+			SSL_CTX_sess_set_cache_size(c, cache_size);
+		} else
+			SSL_CTX_set_session_cache_mode(c, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_timeout(c, timeout);
+		// ...or by the tickets kept by the clients; the keys are kept
+		// on reload, so the tickets issued before are accepted
+		if (tickets) {
+			long size = SSL_CTX_get_tlsext_ticket_keys(c, NULL, 0);
+			if (ticket_keys.empty()) {
+				ticket_keys.resize(size);
+				SSL_CTX_get_tlsext_ticket_keys(c, &ticket_keys[0], size);
+			} else
+				SSL_CTX_set_tlsext_ticket_keys(c, &ticket_keys[0],
+				  ticket_keys.size());
+		} else
+			SSL_CTX_set_options(c, SSL_OP_NO_TICKET);
+#ifdef SSL_OP_ENABLE_KTLS
+		// the records are encrypted by the kernel, if it supports the
+		// cipher negotiated
+		if (ktls)
+			SSL_CTX_set_options(c, SSL_OP_ENABLE_KTLS);
+#endif
+		return c;
+	}
+};
+
 class ssl_socket_impl: public socket {
 public:
 	//! Constructor
@@ -63,9 +202,16 @@ public:
 		ssl = SSL_new(ctx);
 		if (!ssl)
 			throw socket_exception(_("can't initialize SSL context"));
-		SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY);
-		SSL_set_accept_state(ssl);
-		SSL_set_fd(ssl, socket_fd);
+		init();
+	}
+	//! Constructor
+	/*!
+		The connection refers the context shared, so the context is not
+		freed by the reload until the connection is closed.
+	*/
+	ssl_socket_impl(const socket &src, ssl_context_impl &shared):
+	  socket(src), ctx(NULL), ssl(shared.create_ssl()) {
+		init();
 	}
 	~ssl_socket_impl() {
 		SSL_free(ssl);
@@ -77,7 +223,8 @@ public:
 	  const std::string &cert, const std::string &key,
 	  const std::string &crl) {
 	  	// Load CA certificate
-		if (!ca.empty() && SSL_CTX_load_verify_locations(ctx, ca.c_str(), NULL))
+		if (!ca.empty() &&
+		  SSL_CTX_load_verify_locations(ctx, ca.c_str(), NULL) != 1)
 			throw socket_exception(_("invalid CA certificate"));
 		// TODO: load CRL file too
 		// Load certificate file
@@ -92,27 +239,111 @@ public:
 			throw socket_exception(_("private key is invalid"));
 	}
 	virtual int read(int bytes_to_read, char *buffer) {
+		if (!established) {
+			int rslt = handshake();
+			if (rslt < 0)
+				return rslt;
+		}
+		ERR_clear_error();
 		int nsize = SSL_read(ssl, buffer, bytes_to_read);
-		if (nsize < 0 && SSL_get_error(ssl, nsize) == SSL_ERROR_WANT_READ)
-			return socket::data_not_ready;
-		if (nsize >= 0)
+		if (nsize > 0)
 			return nsize;
-		return socket::io_error;
+		return failure(nsize, in);
 	}
 	virtual int write(int bytes_to_write, const char *buffer) {
+		if (!established) {
+			int rslt = handshake();
+			if (rslt < 0)
+				return rslt;
+		}
+		if (bytes_to_write <= 0)
+			return 0;
+		if (kernel_send) {
+			wants = direction(0);
+			return socket::write(bytes_to_write, buffer);
+		}
+		ERR_clear_error();
 		int nsize = SSL_write(ssl, buffer, bytes_to_write);
-		if (nsize < 0 && SSL_get_error(ssl, nsize) == SSL_ERROR_WANT_WRITE)
-			return socket::data_not_ready;
-		if (nsize >= 0)
+		if (nsize > 0)
 			return nsize;
-		return socket::io_error;
+		return failure(nsize, out);
 	}
 	virtual void shutdown() {
-		SSL_shutdown(ssl);
+		// the close notification is sent if possible, the connection
+		// is not waited for the reply
+		if (established) {
+			ERR_clear_error();
+			SSL_shutdown(ssl);
+		}
+	}
+	virtual direction blocked_on(direction op) const {
+		return wants ? wants : op;
+	}
+	//! Do the handshake
+	int handshake() {
+		if (established)
+			return 0;
+		ERR_clear_error();
+		int rslt = SSL_do_handshake(ssl);
+		if (rslt == 1) {
+			established = true;
+			wants = direction(0);
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+			// the data written to the socket is encrypted by the kernel
+			kernel_send = BIO_get_ktls_send(SSL_get_wbio(ssl));
+#endif
+			return 0;
+		}
+		rslt = failure(rslt, in);
+		return rslt == 0 ? int(socket::io_error) : rslt;
+	}
+	//! Check for the handshake is done
+	bool is_established() const {
+		return established;
+	}
+	//! Check for the data sent is encrypted by the kernel
+	bool is_kernel_tls() const {
+		return kernel_send;
 	}
 private:
 	SSL_CTX *ctx;
 	SSL *ssl;
+	// the handshake is done
+	bool established;
+	// the data is sent by the kernel TLS
+	bool kernel_send;
+	// the direction the blocked operation waits for, if not its own
+	direction wants;
+	// Get the result of the operation failed
+	int failure(int rslt, direction op) {
+		wants = direction(0);
+		switch (SSL_get_error(ssl, rslt)) {
+			case SSL_ERROR_WANT_READ:
+				wants = in;
+				return socket::data_not_ready;
+			case SSL_ERROR_WANT_WRITE:
+				wants = out;
+				return socket::data_not_ready;
+			case SSL_ERROR_ZERO_RETURN:
+				// the connection is closed by the client
+				return op == in ? 0 : int(socket::io_error);
+			default:
+				return socket::io_error;
+		}
+	}
+	void init() {
+		established = false;
+		kernel_send = false;
+		wants = direction(0);
+		// the blocked write is retried with the same data, but the buffer
+		// may be moved (see ssl_socket::sendfile()); the read is retried
+		// after the records of no data are processed, so WANT_READ means
+		// the socket is drained, as the edge-triggered reactor expects
+		SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY |
+		  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+		SSL_set_accept_state(ssl);
+		SSL_set_fd(ssl, socket_fd);
+	}
 };
 
 } // namespace
@@ -0,0 +1,74 @@
+/*
+ * reactor.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <dcl/reactor.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "select_reactor.cpp"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include "epoll_reactor.cpp"
+#endif
+
+namespace dbp {
+
+reactor::reactor(backend type): pimpl(NULL) {
+#ifdef HAVE_SYS_EPOLL_H
+	if (type != select_backend) {
+		pimpl = new local::epoll_reactor_impl();
+		return;
+	}
+#endif
+	pimpl = new local::select_reactor_impl();
+}
+
+reactor::~reactor() {
+	delete pimpl;
+}
+
+void reactor::add(int handle, int events, void *data) {
+	pimpl->add(handle, events, data);
+}
+
+void reactor::modify(int handle, int events, void *data) {
+	pimpl->modify(handle, events, data);
+}
+
+void reactor::remove(int handle) {
+	pimpl->remove(handle);
+}
+
+void reactor::rearm(int handle, int events) {
+	pimpl->rearm(handle, events);
+}
+
+void reactor::wait(int timeout, reactor_events &events) {
+	pimpl->wait(timeout, events);
+}
+
+void reactor::interrupt() {
+	pimpl->interrupt();
+}
+
+} // namespace
@@ -0,0 +1,166 @@
+/*
+ * select_reactor.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winsock2.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#endif
+
+#include <map>
+
+#include <dcl/reactor.h>
+#include <dcl/strutils.h>
+
+namespace dbp {
+namespace local {
+
+using namespace std;
+
+// The select() timeout used when the waiting can't be interrupted
+#define SELECT_POLL_TIMEOUT 10
+
+class select_reactor_impl: public reactor_int {
+public:
+	select_reactor_impl() {
+#ifndef _WIN32
+		// the pipe is used to interrupt the select() call
+		if (::pipe(wakeup) < 0)
+			throw reactor_exception(_("can't create the reactor"));
+		for (int i = 0; i < 2; i++) {
+			fcntl(wakeup[i], F_SETFL, fcntl(wakeup[i], F_GETFL) | O_NONBLOCK);
+			fcntl(wakeup[i], F_SETFD, FD_CLOEXEC);
+		}
+#endif
+	}
+	virtual ~select_reactor_impl() {
+#ifndef _WIN32
+		::close(wakeup[0]);
+		::close(wakeup[1]);
+#endif
+	}
+	virtual void add(int handle, int events, void *data) {
+#ifndef _WIN32
+		if (handle >= FD_SETSIZE)
+			throw reactor_exception(_("too many handles to watch by select()"));
+#endif
+		entry &e = handles[handle];
+		e.events = events;
+		e.armed = events;
+		e.data = data;
+	}
+	virtual void modify(int handle, int events, void *data) {
+		add(handle, events, data);
+	}
+	virtual void remove(int handle) {
+		handles.erase(handle);
+	}
+	virtual void rearm(int handle, int events) {
+		entries::iterator i = handles.find(handle);
+		if (i != handles.end())
+			i->second.armed |= (events & i->second.events);
+	}
+	virtual void wait(int timeout, reactor_events &events) {
+		events.clear();
+		fd_set rfds, wfds;
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		int n = -1;
+#ifndef _WIN32
+		FD_SET(wakeup[0], &rfds);
+		n = wakeup[0];
+#else
+		// there is no way to interrupt the select() on win32, so poll
+		if (timeout < 0 || timeout > SELECT_POLL_TIMEOUT)
+			timeout = SELECT_POLL_TIMEOUT;
+#endif
+		for (entries::const_iterator i = handles.begin();
+		  i != handles.end(); ++i) {
+			if (i->second.armed & reactor::read)
+				FD_SET(i->first, &rfds);
+			if (i->second.armed & reactor::write)
+				FD_SET(i->first, &wfds);
+			if (i->second.armed)
+				n = std::max(i->first, n);
+		}
+		struct timeval tv;
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = (timeout % 1000) * 1000;
+		int r = ::select(n + 1, &rfds, &wfds, NULL, timeout < 0 ? NULL : &tv);
+		if (r < 0) {
+#ifndef _WIN32
+			if (errno == EINTR)
+				return;
+#endif
+			throw reactor_exception(_("can't wait for input/output events"));
+		}
+		if (r == 0)
+			return;
+#ifndef _WIN32
+		// drain the wake up pipe
+		if (FD_ISSET(wakeup[0], &rfds)) {
+			char buf[64];
+			while (::read(wakeup[0], buf, sizeof(buf)) > 0) { }
+		}
+#endif
+		// report ready handles and disarm them until drained by the caller
+		for (entries::iterator i = handles.begin(); i != handles.end(); ++i) {
+			reactor_event e;
+			e.data = i->second.data;
+			e.events = reactor::none;
+			if (FD_ISSET(i->first, &rfds))
+				e.events |= reactor::read;
+			if (FD_ISSET(i->first, &wfds))
+				e.events |= reactor::write;
+			if (e.events != reactor::none) {
+				i->second.armed &= ~e.events;
+				events.push_back(e);
+			}
+		}
+	}
+	virtual void interrupt() {
+#ifndef _WIN32
+		char c = 0;
+		if (::write(wakeup[1], &c, 1) < 0) {
+			// the pipe is full, so the reactor is already interrupted
+		}
+#endif
+	}
+private:
+	struct entry {
+		int events;
+		int armed;
+		void *data;
+	};
+	typedef std::map<int, entry> entries;
+	entries handles;
+#ifndef _WIN32
+	int wakeup[2];
+#endif
+};
+
+}} // namespace
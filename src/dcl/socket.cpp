@@ -19,6 +19,10 @@
  * Boston, MA  02110-1301  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #ifdef _WIN32
 #define _WIN32_WINNT 0x0501
 #include <windows.h>
@@ -30,11 +34,20 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#ifdef HAVE_LINUX_ERRQUEUE_H
+#include <linux/errqueue.h>
+#endif
+
 #include <unistd.h>
 #include <string.h>
 #include <strings.h>
@@ -44,6 +57,19 @@
 
 namespace dbp {
 
+// The maximum number of memory blocks written by the single call
+#define IO_VECTORS_MAX 64
+// The size of the file block sent when the sendfile call is not available
+#define IO_FILE_BLOCK_SIZE 16384
+// The minimum size of the data sent with no copying; the smaller data is
+// copied faster than the zero-copy send is completed
+#define ZEROCOPY_MIN_SIZE 16384
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && \
+  defined(SO_EE_ORIGIN_ZEROCOPY)
+#define ZEROCOPY_SUPPORTED 1
+#endif
+
 using namespace std;
 
 #ifdef _WIN32
@@ -91,7 +117,8 @@ int inet_pton(int af, const char *src, void *dst) {
 #endif
 #endif
 
-socket::socket(): socket_fd(-1), _port(0) {
+socket::socket(): socket_fd(-1), _port(0), _zerocopy(false),
+  zerocopy_sends(0), zerocopy_done(0) {
 #ifdef _WIN32
 	local::winsock2_init::instance();
 #endif
@@ -158,7 +185,7 @@ bool socket::connect(const string &address, int port) {
 	return true;
 }
 
-void socket::bind(const socket_address &address) {
+void socket::bind(const socket_address &address, bool reuse_port) {
 	struct sockaddr_in s;
 	// Convert given addresses to desired format
 	memset(&s, 0, sizeof(s));
@@ -184,6 +211,13 @@ void socket::bind(const socket_address &address) {
 #endif
 	  sizeof(reuseaddr)) < 0)
 		throw socket_exception(_("can't setup socket options"));
+	if (reuse_port) {
+#ifdef SO_REUSEPORT
+		if (::setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT,
+		  (const void*)&reuseaddr, sizeof(reuseaddr)) < 0)
+#endif
+			throw socket_exception(_("can't setup socket options"));
+	}
 	// set non-blocking
 	set_blocked(false);
 	// try to bind
@@ -191,6 +225,12 @@ void socket::bind(const socket_address &address) {
 		socket_fd = -1;
 		throw socket_exception(_("can't bind to the address or port"));
 	}
+	// obtain the port number selected by OS
+	if (_port == 0) {
+		socklen_t size = sizeof(s);
+		if (::getsockname(socket_fd, (struct sockaddr*)&s, &size) == 0)
+			_port = ntohs(s.sin_port);
+	}
 }
 
 void socket::listen() {
@@ -206,8 +246,16 @@ socket socket::accept() {
 	int client_socket_fd;
 	// accept the connection
 	if ((client_socket_fd = ::accept(socket_fd,
-	  (struct sockaddr*)&s, &sockaddr_in_size)) < 0)
+	  (struct sockaddr*)&s, &sockaddr_in_size)) < 0) {
+		// no pending connections on the non-blocking socket
+#ifdef _WIN32
+		if (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+#endif
+			return rslt;
 		throw socket_exception(_("can't accept incoming connection"));
+	}
 	// initialize result
 	rslt._address = inet_ntoa(s.sin_addr);
 	rslt._port = ntohs(s.sin_port);
@@ -240,6 +288,39 @@ int socket::read(int bytes_to_read, char *buffer) {
 	return nread;
 }
 
+int socket::readv(int count, const io_vector *vectors) {
+	if (count > IO_VECTORS_MAX)
+		count = IO_VECTORS_MAX;
+#ifdef _WIN32
+	WSABUF bufs[IO_VECTORS_MAX];
+	for (int i = 0; i < count; i++) {
+		bufs[i].buf = vectors[i].data;
+		bufs[i].len = vectors[i].size;
+	}
+	DWORD nread, flags = 0;
+	if (WSARecv(socket_fd, bufs, count, &nread, &flags, NULL, NULL) != 0) {
+		if (WSAGetLastError() == WSAEWOULDBLOCK)
+			return data_not_ready;
+		return io_error;
+	}
+	return nread;
+#else
+	struct iovec iov[IO_VECTORS_MAX];
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = vectors[i].data;
+		iov[i].iov_len = vectors[i].size;
+	}
+	int nread;
+	if ((nread = ::readv(socket_fd, iov, count)) < 0) {
+		if (errno == EAGAIN)
+			nread = data_not_ready;
+		else
+			return io_error;
+	}
+	return nread;
+#endif
+}
+
 int socket::write(int bytes_to_write, const char *buffer) {
 	int nwritten;
 	if ((nwritten = ::send(socket_fd, buffer, bytes_to_write, 0)) < 0) {
@@ -255,6 +336,145 @@ int socket::write(int bytes_to_write, const char *buffer) {
 	return nwritten;
 }
 
+int socket::writev(int count, const io_vector *vectors) {
+	if (count > IO_VECTORS_MAX)
+		count = IO_VECTORS_MAX;
+#ifdef _WIN32
+	WSABUF bufs[IO_VECTORS_MAX];
+	for (int i = 0; i < count; i++) {
+		bufs[i].buf = vectors[i].data;
+		bufs[i].len = vectors[i].size;
+	}
+	DWORD nwritten;
+	if (WSASend(socket_fd, bufs, count, &nwritten, 0, NULL, NULL) != 0) {
+		if (WSAGetLastError() == WSAEWOULDBLOCK)
+			return data_not_ready;
+		return io_error;
+	}
+	return nwritten;
+#else
+	struct iovec iov[IO_VECTORS_MAX];
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = vectors[i].data;
+		iov[i].iov_len = vectors[i].size;
+	}
+	int nwritten;
+	if ((nwritten = ::writev(socket_fd, iov, count)) < 0) {
+		if (errno == EAGAIN)
+			nwritten = data_not_ready;
+		else
+			return io_error;
+	}
+	return nwritten;
+#endif
+}
+
+int socket::sendfile(const io_file &file, uint64_t offset, size_t size) {
+#ifdef HAVE_SYS_SENDFILE_H
+	off_t off = offset;
+	ssize_t nwritten = ::sendfile(socket_fd, file.handle(), &off, size);
+	if (nwritten < 0) {
+		if (errno == EAGAIN)
+			return data_not_ready;
+		return io_error;
+	}
+	// the file is truncated
+	if (nwritten == 0 && size > 0)
+		return io_error;
+	return nwritten;
+#else
+	return send_file_block(file, offset, size);
+#endif
+}
+
+bool socket::zerocopy(bool enable) {
+#ifdef ZEROCOPY_SUPPORTED
+	int value = enable;
+	if (::setsockopt(socket_fd, SOL_SOCKET, SO_ZEROCOPY, &value,
+	  sizeof(value)) < 0)
+		enable = false;
+#else
+	enable = false;
+#endif
+	_zerocopy = enable;
+	return enable;
+}
+
+int socket::writev_zerocopy(int count, const io_vector *vectors) {
+#ifdef ZEROCOPY_SUPPORTED
+	if (count > IO_VECTORS_MAX)
+		count = IO_VECTORS_MAX;
+	size_t size = 0;
+	for (int i = 0; i < count; i++)
+		size += vectors[i].size;
+	if (!_zerocopy || size < ZEROCOPY_MIN_SIZE)
+		return writev(count, vectors);
+	struct iovec iov[IO_VECTORS_MAX];
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = vectors[i].data;
+		iov[i].iov_len = vectors[i].size;
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	int nwritten;
+	if ((nwritten = ::sendmsg(socket_fd, &msg, MSG_ZEROCOPY)) < 0) {
+		// the kernel is out of the memory locked, the data is copied
+		if (errno == ENOBUFS)
+			return writev(count, vectors);
+		if (errno == EAGAIN)
+			return data_not_ready;
+		return io_error;
+	}
+	// the writes are numbered by the kernel in the same order
+	zerocopy_sends++;
+	return nwritten;
+#else
+	return writev(count, vectors);
+#endif
+}
+
+uint32_t socket::zerocopy_completed() {
+#ifdef ZEROCOPY_SUPPORTED
+	while (zerocopy_done != zerocopy_sends) {
+		char control[128];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (::recvmsg(socket_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+		for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+		  cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *err =
+			  (struct sock_extended_err*)CMSG_DATA(cm);
+			if (err->ee_errno != 0 ||
+			  err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			// the writes from ee_info to ee_data are completed
+			if (int32_t(err->ee_data + 1 - zerocopy_done) > 0)
+				zerocopy_done = err->ee_data + 1;
+			// the data is copied anyway, so it's faster to copy it
+			if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				_zerocopy = false;
+		}
+	}
+#endif
+	return zerocopy_done;
+}
+
+int socket::send_file_block(const io_file &file, uint64_t offset,
+  size_t size) {
+	char buffer[IO_FILE_BLOCK_SIZE];
+	if (size > sizeof(buffer))
+		size = sizeof(buffer);
+	int nread = file.read(offset, size, buffer);
+	if (nread <= 0)
+		return io_error;
+	return write(nread, buffer);
+}
+
 void socket::set_blocked(bool state) {
 #ifdef _WIN32
 	u_long opts = state;
@@ -285,6 +505,80 @@ udp_socket::udp_socket(): socket() {
 		throw socket_exception(_("can't create socket"));
 }
 
+int udp_socket::read_datagrams(int count, datagram *datagrams) {
+	if (count > IO_VECTORS_MAX)
+		count = IO_VECTORS_MAX;
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[IO_VECTORS_MAX];
+	struct iovec iov[IO_VECTORS_MAX];
+	memset(msgs, 0, sizeof(msgs[0]) * count);
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = datagrams[i].data.data;
+		iov[i].iov_len = datagrams[i].data.size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int rslt = ::recvmmsg(socket_fd, msgs, count, MSG_WAITFORONE, NULL);
+	if (rslt < 0)
+		return errno == EAGAIN ? data_not_ready : io_error;
+	for (int i = 0; i < rslt; i++)
+		datagrams[i].size = msgs[i].msg_len;
+	return rslt;
+#else
+	// the datagrams are received one by one
+	int rslt = 0;
+	for (; rslt < count; rslt++) {
+		int size = read(datagrams[rslt].data.size, datagrams[rslt].data.data);
+		if (size < 0) {
+			if (rslt > 0)
+				break;
+			return size;
+		}
+		datagrams[rslt].size = size;
+#ifdef MSG_DONTWAIT
+		// the blocking socket waits for the first datagram only
+		char c;
+		if (::recv(socket_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0) {
+			rslt++;
+			break;
+		}
+#else
+		rslt++;
+		break;
+#endif
+	}
+	return rslt;
+#endif
+}
+
+int udp_socket::write_datagrams(int count, const io_vector *datagrams) {
+	if (count > IO_VECTORS_MAX)
+		count = IO_VECTORS_MAX;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[IO_VECTORS_MAX];
+	struct iovec iov[IO_VECTORS_MAX];
+	memset(msgs, 0, sizeof(msgs[0]) * count);
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = datagrams[i].data;
+		iov[i].iov_len = datagrams[i].size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int rslt = ::sendmmsg(socket_fd, msgs, count, 0);
+	if (rslt < 0)
+		return errno == EAGAIN ? data_not_ready : io_error;
+	return rslt;
+#else
+	// the datagrams are sent one by one
+	for (int i = 0; i < count; i++) {
+		int rslt = write(datagrams[i].size, datagrams[i].data);
+		if (rslt < 0)
+			return i > 0 ? i : rslt;
+	}
+	return count;
+#endif
+}
+
 unix_socket::unix_socket(): socket() {
 #ifdef _WIN32
 	socket_fd = ::socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
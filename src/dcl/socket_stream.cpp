@@ -19,6 +19,19 @@
  * Boston, MA  02110-1301  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#endif
+
+#include <algorithm>
+#include <climits>
 #include <cstring>
 
 #include <dcl/socket_stream.h>
@@ -27,34 +40,166 @@ namespace dbp {
 
 using namespace std;
 
-socket_stream::socket_stream(socket &s, size_t buf_size, size_t put_back):
-  _put_back(max(put_back, size_t(1))),
-  _buf(max(buf_size, _put_back) + _put_back), _s(s) {
+socket_stream::socket_stream(socket &s, size_t buf_size, size_t put_back,
+  size_t out_size): _put_back(max(put_back, size_t(1))),
+  _buf(max(buf_size, _put_back) + _put_back), _out(out_size), _s(s) {
 	char *end = &_buf.front() + _buf.size();
 	setg(end, end, end);
+	if (!_out.empty())
+		setp(&_out.front(), &_out.front() + _out.size());
+}
+
+socket_stream::~socket_stream() {
+	sync();
 }
 
 std::streambuf::int_type socket_stream::underflow() {
 	// is buffer not exhausted?
 	if (gptr() < egptr())
 		return traits_type::to_int_type(*gptr());
+	// make arrangements for putback characters
+	char *base = &_buf.front();
+	size_t keep = min(_put_back, size_t(egptr() - eback()));
+	memmove(base, egptr() - keep, keep);
+	char *start = base + keep;
+	// the data buffered is sent before waiting for the reply
+	if (sync() < 0)
+		return traits_type::eof();
+	int n = receive(start, _buf.size() - keep);
+	if (n <= 0)
+		return traits_type::eof();
+	setg(base, start, start + n);
+	return traits_type::to_int_type(*gptr());
+}
+
+std::streambuf::int_type socket_stream::overflow(int_type c) {
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return sync() == 0 ? traits_type::not_eof(c) : traits_type::eof();
+	// the buffer is full, it's sent with the character by the single call
+	char ch = traits_type::to_char_type(c);
+	return send(&ch, 1) ? c : traits_type::eof();
+}
+
+int socket_stream::sync() {
+	return pptr() == pbase() || send(NULL, 0) ? 0 : -1;
+}
+
+std::streamsize socket_stream::xsgetn(char *s, std::streamsize n) {
+	// the data buffered
+	streamsize rslt = min(n, streamsize(egptr() - gptr()));
+	memcpy(s, gptr(), rslt);
+	gbump(rslt);
+	// the rest of the large block is read directly
+	if (size_t(n - rslt) < _buf.size())
+		return rslt + std::streambuf::xsgetn(s + rslt, n - rslt);
+	if (sync() < 0)
+		return rslt;
+	while (rslt < n) {
+		int size = receive(s + rslt, n - rslt);
+		if (size <= 0)
+			break;
+		rslt += size;
+	}
+	// the characters read are kept to put back
+	size_t keep = min(_put_back, size_t(rslt));
 	char *base = &_buf.front();
-	char *start = base;
-	if (eback() == base) {
-		// Make arrangements for putback characters
-		// when this isn't the first fill
-		memmove(base, egptr() - _put_back, _put_back);
-		start += _put_back;
+	memcpy(base, s + rslt - keep, keep);
+	setg(base, base + keep, base + keep);
+	return rslt;
+}
+
+std::streamsize socket_stream::xsputn(const char *s, std::streamsize n) {
+	if (n <= 0)
+		return 0;
+	// the block fits the buffer
+	size_t free_size = epptr() - pptr();
+	if (size_t(n) <= free_size) {
+		memcpy(pptr(), s, n);
+		pbump(n);
+		return n;
+	}
+	// the large block is sent directly, with the data buffered
+	if (size_t(n) >= _out.size())
+		return send(s, n) ? n : 0;
+	// or fills the buffer sent
+	memcpy(pptr(), s, free_size);
+	pbump(free_size);
+	if (!send(NULL, 0))
+		return free_size;
+	memcpy(pptr(), s + free_size, n - free_size);
+	pbump(n - free_size);
+	return n;
+}
+
+bool socket_stream::send(const char *data, size_t size) {
+	io_vector v[2];
+	int count = 0;
+	if (pptr() > pbase()) {
+		v[count].data = pbase();
+		v[count++].size = pptr() - pbase();
+	}
+	if (size > 0) {
+		v[count].data = const_cast<char*>(data);
+		v[count++].size = size;
 	}
-	// start is now the start of the buffer, proper
-	// read from socket into the provided buffer
-/*	size_t n = std::fread(start, 1, _buf.size() - (start - base), fptr_);
-    if (n == 0)
-        return traits_type::eof();
-    // Set buffer pointers
-    setg(base, start, start + n);
-*/
-    return traits_type::to_int_type(*gptr());
+	// the buffer is emptied, even if the data is not sent
+	if (!_out.empty())
+		setp(&_out.front(), &_out.front() + _out.size());
+	io_vector *p = v;
+	while (count > 0) {
+		int rslt = _s.writev(count, p);
+		if (rslt == socket::data_not_ready) {
+			if (!wait(socket::out))
+				return false;
+			continue;
+		}
+		if (rslt < 0)
+			return false;
+		// skip the blocks sent
+		size_t written = rslt;
+		while (count > 0 && written >= p->size) {
+			written -= p->size;
+			p++;
+			count--;
+		}
+		if (count > 0) {
+			p->data += written;
+			p->size -= written;
+		}
+	}
+	return true;
+}
+
+int socket_stream::receive(char *data, size_t size) {
+	while (1) {
+		int rslt = _s.read(min(size, size_t(INT_MAX)), data);
+		if (rslt != socket::data_not_ready)
+			return rslt;
+		if (!wait(socket::in))
+			return socket::io_error;
+	}
+}
+
+bool socket_stream::wait(socket::direction op) {
+	// the SSL socket may wait for the other direction
+	bool in = _s.blocked_on(op) == socket::in;
+	int rslt;
+#ifdef _WIN32
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(_s.handle(), &fds);
+	rslt = ::select(_s.handle() + 1, in ? &fds : NULL, in ? NULL : &fds,
+	  NULL, NULL);
+#else
+	struct pollfd p;
+	p.fd = _s.handle();
+	p.events = in ? POLLIN : POLLOUT;
+	p.revents = 0;
+	do
+		rslt = ::poll(&p, 1, -1);
+	while (rslt < 0 && errno == EINTR);
+#endif
+	return rslt > 0;
 }
 
 } // namespace
@@ -25,6 +25,10 @@
 #include "config.h"
 #endif
 
+// the default number of the sessions cached and their lifetime, seconds
+#define SESSION_CACHE_SIZE 20480
+#define SESSION_TIMEOUT 300
+
 #ifdef HAVE_OPENSSL
 #include "openssl_socket.cpp"
 #else
@@ -45,6 +49,10 @@ ssl_socket::ssl_socket(const socket &src): socket(src) {
 	pimpl = new ssl_socket_impl(*this);
 }
 
+ssl_socket::ssl_socket(const socket &src, ssl_context &ctx): socket(src) {
+	pimpl = new ssl_socket_impl(*this, *ctx.pimpl);
+}
+
 ssl_socket& ssl_socket::operator=(const ssl_socket &src) {
     delete pimpl;
 	pimpl = new ssl_socket_impl(*src.pimpl);
@@ -70,12 +78,131 @@ int ssl_socket::read(int bytes_to_read, char *buffer) {
 	return pimpl->read(bytes_to_read, buffer);
 }
 
+int ssl_socket::readv(int count, const io_vector *vectors) {
+	int nread = 0;
+	for (int i = 0; i < count; i++) {
+		int rslt = pimpl->read(vectors[i].size, vectors[i].data);
+		// report the data read before the error, if any
+		if (rslt < 0)
+			return nread > 0 ? nread : rslt;
+		nread += rslt;
+		if (size_t(rslt) < vectors[i].size)
+			break;
+	}
+	return nread;
+}
+
 int ssl_socket::write(int bytes_to_write, const char *buffer) {
 	return pimpl->write(bytes_to_write, buffer);
 }
 
+int ssl_socket::writev(int count, const io_vector *vectors) {
+	// the kernel encrypts the data written to the socket
+	if (pimpl->is_kernel_tls())
+		return pimpl->socket::writev(count, vectors);
+	int written = 0;
+	for (int i = 0; i < count; i++) {
+		int rslt = pimpl->write(vectors[i].size, vectors[i].data);
+		// report the data written before the error, if any
+		if (rslt < 0)
+			return written > 0 ? written : rslt;
+		written += rslt;
+		if (size_t(rslt) < vectors[i].size)
+			break;
+	}
+	return written;
+}
+
+int ssl_socket::sendfile(const io_file &file, uint64_t offset, size_t size) {
+	if (pimpl->is_kernel_tls())
+		return pimpl->socket::sendfile(file, offset, size);
+	return send_file_block(file, offset, size);
+}
+
 void ssl_socket::shutdown() {
 	pimpl->shutdown();
 }
+
+socket::direction ssl_socket::blocked_on(direction op) const {
+	return pimpl->blocked_on(op);
+}
+
+int ssl_socket::handshake() {
+	return pimpl->handshake();
+}
+
+bool ssl_socket::is_established() const {
+	return pimpl->is_established();
+}
+
+bool ssl_socket::is_kernel_tls() const {
+	return pimpl->is_kernel_tls();
+}
+
+ssl_context::ssl_context(): pimpl(new ssl_context_impl()) { }
+
+ssl_context::ssl_context(
+  const std::string &ca,
+  const std::string &cert, const std::string &key,
+  const std::string &crl): pimpl(new ssl_context_impl()) {
+	try {
+		pimpl->load_certificates(ca, cert, key, crl);
+	}
+	catch (...) {
+		delete pimpl;
+		throw;
+	}
+}
+
+ssl_context::~ssl_context() {
+	delete pimpl;
+}
+
+void ssl_context::load_certificates(
+  const std::string &ca,
+  const std::string &cert, const std::string &key,
+  const std::string &crl) {
+	pimpl->load_certificates(ca, cert, key, crl);
+}
+
+void ssl_context::reload() {
+	pimpl->reload();
+}
+
+size_t ssl_context::session_cache_size() const {
+	return pimpl->cache_size;
+}
+
+ssl_context& ssl_context::session_cache_size(size_t value) {
+	pimpl->cache_size = value;
+	return *this;
+}
+
+int ssl_context::session_timeout() const {
+	return pimpl->timeout;
+}
+
+ssl_context& ssl_context::session_timeout(int value) {
+	pimpl->timeout = value;
+	return *this;
+}
+
+bool ssl_context::session_tickets() const {
+	return pimpl->tickets;
+}
+
+ssl_context& ssl_context::session_tickets(bool value) {
+	pimpl->tickets = value;
+	return *this;
+}
+
+bool ssl_context::kernel_tls() const {
+	return pimpl->ktls;
+}
+
+ssl_context& ssl_context::kernel_tls(bool value) {
+	pimpl->ktls = value;
+	return *this;
+}
 
 } // namespace
@@ -27,6 +27,7 @@
 #include <ws2tcpip.h>
 #else
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #endif
@@ -39,22 +40,164 @@
 
 namespace dbp {
 
-#define IO_BUF_SIZE 1500
+// The default timeouts (in seconds)
 #define TIMEOUT 300
+#define READ_TIMEOUT 30
+#define WRITE_TIMEOUT 60
+// The default size of the output the client may not receive before the
+// server stops reading its requests
+#define WRITE_HIGH_WATER 1048576
+// The size of the output pending below which the connection asked to be
+// resumed is processed again
+#define RESUME_LOW_WATER 65536
+// The maximum number of memory blocks written by the single call
+#define IO_VECTORS 16
+// The maximum time (in milliseconds) the input/output thread sleeps
+#define IO_WAIT_TIMEOUT 1000
 
 using namespace std;
 
-tcp_server::tcp_server(size_t worker_threads, size_t queue_size):
-  _timeout(TIMEOUT), is_stopped(true), _worker_threads(worker_threads),
-  _queue_size(queue_size), _event(_lock) {
+namespace {
+
+// The output stream flag set by resume_on_drain()
+const int resume_flag = std::ios_base::xalloc();
+
+} // namespace
+
+// The input stream link to the connection
+const int tcp_server::request_index = std::ios_base::xalloc();
+
+// The connection processing suspended
+struct tcp_server::completion::state {
+	enum statuses {
+		// the handler suspended the processing is running
+		running,
+		// completed before the handler returned
+		completed,
+		// waiting for the completion
+		parked,
+		// processed again, or closed
+		done
+	};
+	state(request *r): refs(1), copies(0), status(running), rq(r),
+	  loop(NULL) { }
+	void unref() {
+		if (__sync_sub_and_fetch(&refs, 1) == 0)
+			delete this;
+	}
+	// the references of the completions and of the connection
+	int refs;
+	// the number of the completions
+	int copies;
+	statuses status;
+	mutex lock;
+	request *rq;
+	io_loop *loop;
+};
+
+// tcp_server::completion
+
+tcp_server::completion::completion(state *value): s(value) {
+	__sync_add_and_fetch(&s->refs, 1);
+	__sync_add_and_fetch(&s->copies, 1);
+}
+
+tcp_server::completion::completion(const completion &src): s(src.s) {
+	if (s) {
+		__sync_add_and_fetch(&s->refs, 1);
+		__sync_add_and_fetch(&s->copies, 1);
+	}
+}
+
+tcp_server::completion& tcp_server::completion::operator=(
+  const completion &src) {
+	if (s != src.s) {
+		release();
+		s = src.s;
+		if (s) {
+			__sync_add_and_fetch(&s->refs, 1);
+			__sync_add_and_fetch(&s->copies, 1);
+		}
+	}
+	return *this;
+}
+
+tcp_server::completion::~completion() {
+	release();
+}
+
+void tcp_server::completion::release() {
+	if (!s)
+		return;
+	// the connection is not left suspended forever
+	if (__sync_sub_and_fetch(&s->copies, 1) == 0)
+		complete();
+	s->unref();
+	s = NULL;
+}
+
+void tcp_server::completion::complete() {
+	if (!s)
+		return;
+	s->lock.enter();
+	if (s->status == state::running)
+		s->status = state::completed;
+	else if (s->status == state::parked) {
+		// the connection is returned to the input/output thread to be
+		// processed again, as the drained one is; it keeps the state
+		// until taken back, so the connection is not closed by stop()
+		// until returned
+		request *rq = s->rq;
+		s->status = state::done;
+		s->rq = NULL;
+		rq->resume = true;
+		s->loop->server.connection_done(*s->loop, rq);
+	}
+	s->lock.leave();
+}
+
+// tcp_server::request
+
+tcp_server::request::~request() {
+	// the completion of the connection closed does nothing
+	release();
+	delete data;
+	connection->shutdown();
+	delete connection;
+}
+
+void tcp_server::request::release() {
+	if (!suspension)
+		return;
+	// wait for the completion running, if any
+	suspension->lock.enter();
+	suspension->status = completion::state::done;
+	suspension->rq = NULL;
+	suspension->lock.leave();
+	suspension->unref();
+	suspension = NULL;
+}
+
+tcp_server::io_loop::io_loop(tcp_server &srv, size_t worker_threads,
+  size_t queue_size): server(srv), _reactor(NULL), queue_size(queue_size),
+  accept_paused(false), is_stopped(0), is_waiting(0),
+  reqs(queue_size + 1), done_reqs(queue_size + 1) {
 	// setup listening thread
-	lt.on_execute(create_delegate(this, &tcp_server::io_process));
+	lt.on_execute(create_delegate(this, &io_loop::io_process));
 	// pre-create working threads
 	thread t;
-	t.on_execute(create_delegate(this, &tcp_server::working_process));
+	t.on_execute(create_delegate(this, &io_loop::working_process));
 	wkt.resize(worker_threads, t);
 }
 
+tcp_server::tcp_server(size_t worker_threads, size_t queue_size):
+  _timeout(TIMEOUT), _read_timeout(READ_TIMEOUT),
+  _write_timeout(WRITE_TIMEOUT), _backend(reactor::default_backend),
+  _io_threads(1), _admission(pause_accept), _write_high_water(WRITE_HIGH_WATER),
+  is_stopped(true), _worker_threads(worker_threads),
+  _queue_size(queue_size) {
+}
+
 tcp_server::~tcp_server() {
 	stop();
 }
@@ -67,19 +210,73 @@ void tcp_server::start(const std::string &bind) {
 			return;
 		is_stopped = false;
 	}
-	// parse bind parameter
-	strings addrs = tokenize()(bind, ",;");
+	// create input/output loops; the working threads are shared
+	// between them equally, and every loop needs one at least, so
+	// there are no more loops than the working threads
+	size_t workers = std::max(_worker_threads, size_t(1));
+	size_t count = std::min(_io_threads, workers);
+	for (size_t i = 0; i < count; i++) {
+		size_t n = workers / count + (i < workers % count ? 1 : 0);
+		// every active connection has at most one request in the queues,
+		// so they never overflow
+		io_loop *l = new io_loop(*this, n,
+		  std::max(_queue_size / count, size_t(1)));
+		l->_reactor = new reactor(_backend);
+		loops.push_back(l);
+	}
+	// parse bind parameter and start listening
+	try {
+		bind_listeners(tokenize()(bind, ",;"));
+	}
+	catch (...) {
+		for (io_loops::iterator l = loops.begin(); l != loops.end(); ++l) {
+			delete (*l)->_reactor;
+			delete *l;
+		}
+		loops.clear();
+		listen_sockets.clear();
+		mutex_guard m(_lock);
+		is_stopped = true;
+		throw;
+	}
+	// start the threads
+	for (io_loops::iterator l = loops.begin(); l != loops.end(); ++l) {
+		for (threads::iterator it = (*l)->wkt.begin();
+		  it != (*l)->wkt.end(); ++it)
+			it->start();
+		(*l)->lt.start();
+	}
+}
+
+void tcp_server::bind_listeners(const strings &addrs) {
 	listen_sockets.clear();
+	// when the port can be shared, every loop listens on its own socket,
+	// otherwise all loops are waiting for connections on the same socket
+#ifdef SO_REUSEPORT
+	size_t sharded = loops.size() > 1 ? loops.size() : 0;
+#else
+	size_t sharded = 0;
+#endif
 	for (strings::const_iterator i = addrs.begin(); i != addrs.end(); ++i) {
-		tcp_socket s;
-		s.bind(*i);
-		listen_sockets.push_back(s);
+		socket_address addr(*i);
+		for (size_t n = 0; n < std::max(sharded, size_t(1)); n++) {
+			tcp_socket s;
+			s.bind(addr, sharded > 0);
+			// the random port is selected by the first socket bound
+			addr.port = s.port();
+			s.listen();
+			listen_sockets.push_back(s);
+		}
+	}
+	// distribute the sockets between the loops
+	for (size_t i = 0; i < listen_sockets.size(); i++) {
+		if (sharded > 0)
+			loops[i % sharded]->listeners.push_back(&listen_sockets[i]);
+		else {
+			for (io_loops::iterator l = loops.begin(); l != loops.end(); ++l)
+				(*l)->listeners.push_back(&listen_sockets[i]);
+		}
 	}
-	// start working threads
-	for (threads::iterator it = wkt.begin(); it != wkt.end(); ++it)
-		it->start();
-	// start listening thread
-	lt.start();
 }
 
 void tcp_server::stop() {
@@ -91,13 +288,28 @@ void tcp_server::stop() {
 		// set flag to stop threads
 		is_stopped = true;
 	}
-	// notify threads to stop
-	_event.raise();
-	// wait for listen thread terminates
-	lt.wait_for();
-	// wait for worker threads terminate
-	for (threads::iterator it = wkt.begin(); it != wkt.end(); ++it)
-		it->wait_for();
+	for (io_loops::iterator l = loops.begin(); l != loops.end(); ++l) {
+		// notify threads to stop
+		__atomic_store_n(&(*l)->is_stopped, 1, __ATOMIC_RELEASE);
+		for (size_t i = 0; i < (*l)->wkt.size(); i++)
+			(*l)->ready.unlock();
+		(*l)->_reactor->interrupt();
+	}
+	for (io_loops::iterator l = loops.begin(); l != loops.end(); ++l) {
+		// wait for listen thread terminates
+		(*l)->lt.wait_for();
+		// wait for worker threads terminate
+		for (threads::iterator it = (*l)->wkt.begin();
+		  it != (*l)->wkt.end(); ++it)
+			it->wait_for();
+		// close all the client connections
+		(*l)->accept_paused = false;
+		while (!(*l)->a_reqs.empty())
+			disconnect_client(**l, (*l)->a_reqs.front());
+		delete (*l)->_reactor;
+		delete *l;
+	}
+	loops.clear();
 	// close all listen sockets
 	listen_sockets.clear();
 }
@@ -107,108 +319,80 @@ bool tcp_server::is_running() {
 	return !is_stopped;
 }
 
-void tcp_server::disconnect_client(request *rq) {
+void tcp_server::disconnect_client(io_loop &l, request *rq) {
 	if (disconnect_handler)
 		disconnect_handler(*rq->connection);
+	l._reactor->remove(rq->connection->handle());
+	l.a_reqs.erase(rq->pos);
 	delete rq;
+	// there is a room for the new connections now
+	if (l.accept_paused && l.a_reqs.size() <= l.queue_size) {
+		suspend_accept(l, false);
+		for (std::vector<socket*>::iterator i = l.listeners.begin();
+		  i != l.listeners.end(); ++i)
+			connection_accept(l, **i);
+	}
 }
 
-void tcp_server::io_process(thread_int&) {
-	// turn socket to a listen state
-	for (sockets::iterator i = listen_sockets.begin();
-	  i != listen_sockets.end(); ++i)
-		i->listen();
-	while (1) {
-		// check for stopping flag
-		{
-			mutex_guard m(_lock);
-			if (is_stopped)
-				break;
-		}
-		// prepare for socket event
-		fd_set rfds, wfds;
-		FD_ZERO(&rfds);
-		FD_ZERO(&wfds);
-		// the max socket's handle value for polling
-		int n = -1;
-		// add listening sockets as event source
-		for (sockets::const_iterator i = listen_sockets.begin();
-		  i != listen_sockets.end(); ++i) {
-		  	// subscribe into 'connect' event
-			FD_SET(i->handle(), &rfds);
-			n = std::max(i->handle(), n);
-		}
-		// add active sockets as event source
-		{
-			mutex_guard m(_lock);
-			active_requests::iterator i = a_reqs.begin();
-			while (i != a_reqs.end()) {
-				// check for client disconnection
-				if (((*i)->cur_state == request::CLOSING) &&
-				  (*i)->write_buffer.eof()) {
-					disconnect_client(*i);
-					i = a_reqs.erase(i);
-					continue;
-				}
-				// subscribe into 'ready to read' event
-				FD_SET((*i)->connection->handle(), &rfds);
-				// subscribe into 'ready to write' event if needed
-				if (!(*i)->write_buffer.eof())
-					FD_SET((*i)->connection->handle(), &wfds);
-				n = std::max((*i)->connection->handle(), n);
-				++i;
-			}
-		}
-		// set timeout
-		struct timeval tv;
-		tv.tv_sec = 0;
-		tv.tv_usec = 10000;
-		// poll of socket events
-		int r = ::select(n + 1, &rfds, &wfds, NULL, &tv);
-		// in case of error
-		if (r < 0)
-			throw socket_exception(_("can't initialize input/output thread"));
+socket* tcp_server::listen_socket(io_loop &l, void *data) {
+	for (std::vector<socket*>::iterator i = l.listeners.begin();
+	  i != l.listeners.end(); ++i) {
+		if (*i == data)
+			return *i;
+	}
+	return NULL;
+}
+
+void tcp_server::io_process(io_loop &l) {
+	// subscribe into 'connect' event
+	for (std::vector<socket*>::iterator i = l.listeners.begin();
+	  i != l.listeners.end(); ++i)
+		l._reactor->add((*i)->handle(), reactor::read, *i);
+	reactor_events events;
+	timer_wheel::timers expired;
+	while (!__atomic_load_n(&l.is_stopped, __ATOMIC_ACQUIRE)) {
 		try {
-			// repeat when no more events (timeout)
-			if (r == 0)
-				continue;
-			// check for the event is raised on the listening sockets
-			for (sockets::iterator i = listen_sockets.begin();
-			  i != listen_sockets.end(); ++i) {
-				if (FD_ISSET(i->handle(), &rfds)) {
-					FD_CLR(i->handle(), &rfds);
-					connection_accept(*i);
+			// let the working threads know they should wake us up; do not
+			// sleep if some request is returned meanwhile
+			__atomic_store_n(&l.is_waiting, 1, __ATOMIC_SEQ_CST);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			int timeout = l.done_reqs.empty() ? IO_WAIT_TIMEOUT : 0;
+			int next_timer = l.timers.next_timeout();
+			if (next_timer >= 0 && next_timer < timeout)
+				timeout = next_timer;
+			// poll of socket events
+			l._reactor->wait(timeout, events);
+			__atomic_store_n(&l.is_waiting, 0, __ATOMIC_RELAXED);
+			for (reactor_events::const_iterator e = events.begin();
+			  e != events.end(); ++e) {
+				// check for the event is raised on the listening sockets
+				socket *ls = listen_socket(l, e->data);
+				if (ls) {
+					connection_accept(l, *ls);
+					continue;
 				}
+				// the event is raised on the active socket
+				request *rq = static_cast<request*>(e->data);
+				if (e->events & reactor::read)
+					rq->can_read = true;
+				if (e->events & reactor::write)
+					rq->can_write = true;
+				connection_process(l, *rq);
 			}
-			// check for the event is raised on the active sockets
-			{
-				mutex_guard m(_lock);
-				active_requests::iterator i = a_reqs.begin();
-				while (i != a_reqs.end()) {
-					bool was_events = false;
-					// on 'ready to write' event
-					if (FD_ISSET((*i)->connection->handle(), &wfds)) {
-						FD_CLR((*i)->connection->handle(), &wfds);
-						connection_write(**i);
-						was_events = true;
-					}
-				  	// on 'ready to read' event
-					if (FD_ISSET((*i)->connection->handle(), &rfds)) {
-						FD_CLR((*i)->connection->handle(), &rfds);
-						connection_read(**i);
-						was_events = true;
-					}
-					if (was_events && ((*i)->cur_state != request::CLOSING)) {
-						// add the request to the processing queue
-						reqs.push(*i);
-						i = a_reqs.erase(i);
-						// wake up the processing thread
-						_event.raise();
-					} else {
-						++i;
-					}
-				} // while
+			// take back the requests processed by working threads
+			request *rq;
+			while (l.done_reqs.pop(rq)) {
+				rq->busy = false;
+				// the connection completed is not suspended anymore
+				rq->release();
+				connection_process(l, *rq);
 			}
+			// close the connections timed out
+			l.timers.expire(expired);
+			for (timer_wheel::timers::const_iterator i = expired.begin();
+			  i != expired.end(); ++i)
+				disconnect_client(l, static_cast<request*>((*i)->data));
+			expired.clear();
 		}
 		catch(dbp::exception &e) {
 			// when custom exception handler is assigned, raise the event
@@ -220,155 +404,331 @@ void tcp_server::io_process(thread_int&) {
 	} // while
 }
 
-void tcp_server::connection_accept(socket &ls) {
-	// check for maximum stack size; do not accept new
-	// connections on overload
-	{
-		mutex_guard m(_lock);
-		if (a_reqs.size() > _queue_size)
+void tcp_server::connection_accept(io_loop &l, socket &ls) {
+	while (1) {
+		// check for maximum stack size; on overload, stop listening
+		// for the new connections until some are closed
+		bool overloaded = l.a_reqs.size() > l.queue_size;
+		if (overloaded && _admission == pause_accept) {
+			suspend_accept(l, true);
 			return;
+		}
+		// accept the connection
+		socket s = ls.accept();
+		if (s.handle() < 0) {
+			// no more pending connections
+			l._reactor->rearm(ls.handle(), reactor::read);
+			return;
+		}
+		// or close it at once, notifying the client if possible
+		if (overloaded) {
+			if (!_overload_response.empty()) {
+				s.write(_overload_response.size(),
+				  _overload_response.data());
+			}
+			continue;
+		}
+		request *rq = NULL;
+		if (!create_io_handler)
+			rq = new request(new socket(s));
+		else {
+			socket *rs = create_io_handler(ls, s);
+			rq = new request(rs);
+		}
+		// put the connection into the active connections list
+		l.a_reqs.push_back(rq);
+		rq->pos = --l.a_reqs.end();
+		// raise 'on_connect' event
+		if (connect_handler) {
+			connect_handler(*rq->connection, rq->read_buffer,
+			  rq->write_buffer);
+			rq->write_buffer.flush();
+		}
+		// subscribe into 'ready to read' and 'ready to write' events
+		l._reactor->add(rq->connection->handle(),
+		  reactor::read | reactor::write, rq);
+		connection_timer(l, *rq, false);
 	}
-	// accept the connection
-	socket s = ls.accept();
-	request *rq = NULL;
-	if (!create_io_handler)
-		rq = new request(new socket(s));
-	else {
-		socket *rs = create_io_handler(ls, s);
-		rq = new request(rs);
+}
+
+void tcp_server::suspend_accept(io_loop &l, bool state) {
+	l.accept_paused = state;
+	for (std::vector<socket*>::iterator i = l.listeners.begin();
+	  i != l.listeners.end(); ++i) {
+		l._reactor->modify((*i)->handle(),
+		  state ? reactor::none : reactor::read, *i);
 	}
-	// raise 'on_connect' event
-	if (connect_handler) {
-		connect_handler(*rq->connection, rq->read_buffer,
-		  rq->write_buffer);
+}
+
+void tcp_server::connection_process(io_loop &l, request &rq) {
+	// the request is owned by the working thread now
+	if (rq.busy)
+		return;
+	// flush the output buffer
+	bool progress = connection_write(l, rq);
+	// do not read the requests of the client which does not receive
+	// the output, until the half of it is sent
+	size_t pending = rq.write_buffer.buffer().size();
+	if (_write_high_water == 0 || pending <= _write_high_water / 2)
+		rq.throttled = false;
+	else if (pending > _write_high_water)
+		rq.throttled = true;
+	// read the input and pass it to the working threads, with the
+	// connections waiting for the output to be drained; the data
+	// received with the end of the input is processed as well, the
+	// client half-closed the connection waits for the output
+	bool received = rq.cur_state != request::CLOSING && !rq.throttled &&
+	  connection_read(l, rq);
+	bool drained = rq.resume && pending <= RESUME_LOW_WATER &&
+	  !rq.write_buffer.bad();
+	if (received || drained) {
+		rq.resume = false;
+		rq.busy = true;
+		l.timers.cancel(rq.deadline);
+		l.reqs.push(&rq);
+		// wake up one of the processing threads
+		l.ready.unlock();
+		return;
 	}
-	// put the connection into the queue
-	{
-		mutex_guard m(_lock);
-		a_reqs.push_back(rq);
+	// disconnect the client when all data is sent
+	if (rq.cur_state == request::CLOSING && rq.write_buffer.buffer().empty()) {
+		disconnect_client(l, &rq);
+		return;
 	}
+	connection_timer(l, rq, progress);
 }
 
-void tcp_server::connection_read(request &rq) {
-	// exit when no custom event handler assigned
-	if (!process_data_handler)
+void tcp_server::connection_timer(io_loop &l, request &rq, bool progress) {
+	request::deadlines type;
+	int timeout;
+	uint64_t elapsed = 0;
+	if (!rq.write_buffer.buffer().empty()) {
+		// the client does not receive the data sent
+		type = request::WRITE_DEADLINE;
+		if (type == rq.deadline_type && !progress && rq.deadline.is_armed())
+			return;
+		timeout = _write_timeout;
+	}
+	else if (!rq.read_buffer.buffer().empty()) {
+		// the request is not received completely; the time is counted
+		// from the first part, so the slow client can't prolong it
+		type = request::READ_DEADLINE;
+		if (type != rq.deadline_type)
+			rq.read_started = timer_wheel::now();
+		else if (rq.deadline.is_armed())
+			return;
+		elapsed = timer_wheel::now() - rq.read_started;
+		timeout = _read_timeout;
+	}
+	else {
+		// the connection is idle
+		type = request::IDLE_DEADLINE;
+		if (type == rq.deadline_type && rq.deadline.is_armed())
+			return;
+		timeout = _timeout;
+	}
+	rq.deadline_type = type;
+	if (timeout <= 0) {
+		l.timers.cancel(rq.deadline);
 		return;
-	//read some data and place into a buffer
-	char tmp[IO_BUF_SIZE];
-	int size = rq.connection->read(sizeof(tmp), tmp);
-	if (size == socket::io_error) {
-		rq.read_buffer.setstate(ios::badbit);
-		rq.cur_state = request::CLOSING;
-	}
-	else if (size > 0) {
-		// initialize buffers
-		rq.write_buffer.clear();
-		rq.read_buffer.clear();
-		rq.read_buffer.write(tmp, size);
-		// raise 'on_process_data' event
-		if (!process_data_handler(*rq.connection,
-		  rq.read_buffer, rq.write_buffer))
+	}
+	uint64_t ms = uint64_t(timeout) * 1000;
+	l.timers.arm(rq.deadline, ms > elapsed ? ms - elapsed : 1);
+}
+
+bool tcp_server::connection_read(io_loop &l, request &rq) {
+	bool received = false;
+	io_buffer &buf = rq.read_buffer.buffer();
+	// read all the data available directly into the buffer
+	while (rq.ready(rq.read_wait)) {
+		size_t free_size;
+		char *p = buf.prepare(free_size);
+		int size = rq.connection->read(free_size, p);
+		rq.read_wait = socket::in;
+		if (size == socket::data_not_ready) {
+			rq.read_wait = rq.connection->blocked_on(socket::in);
+			connection_wait(l, rq, rq.read_wait);
+		}
+		else if (size == socket::io_error || size == 0) {
+			// the connection is broken or closed by the client
+			if (!received)
+				rq.read_buffer.setstate(ios::badbit);
+			rq.can_read = false;
 			rq.cur_state = request::CLOSING;
-		// discard the read buffer
-		if (rq.read_buffer.tellg() ==
-		  rq.read_buffer.tellp())
-			rq.read_buffer.str(string());
+		}
+		else {
+			// initialize buffers
+			if (!received) {
+				rq.write_buffer.clear();
+				rq.read_buffer.clear();
+			}
+			buf.commit(size);
+			received = true;
+		}
 	}
+	// discard the data if nobody is interested in
+	if (received && !process_data_handler) {
+		rq.read_buffer.reset();
+		return false;
+	}
+	return received;
 }
 
-void tcp_server::connection_write(request &rq) {
-	// exit on empty buffer
-	if (rq.write_buffer.eof())
-		return;
-	// get data size
-	int pos = rq.write_buffer.tellg();
-	rq.write_buffer.seekg(0, ios::end);
-	int size = int(rq.write_buffer.tellg()) - pos;
-	if (size == 0) {
-		rq.write_buffer.setstate(ios::eofbit);
-	} else {
-		rq.write_buffer.seekg(pos);
-		// allocate buffer and read data
-		char tmp[size];
-		rq.write_buffer.read(tmp, size);
-		rq.write_buffer.seekg(pos);
-		// write buffer to the socket
-		int rsize = rq.connection->write(size, tmp);
-		if (rsize == socket::io_error)
+bool tcp_server::connection_write(io_loop &l, request &rq) {
+	bool written = false;
+	io_buffer &buf = rq.write_buffer.buffer();
+	while (rq.ready(rq.write_wait) && !buf.empty()) {
+		// write the buffer slabs to the socket, or send the file region
+		// directly from the file
+		int rsize;
+		io_file file;
+		uint64_t offset;
+		size_t size;
+		if (buf.file_region(file, offset, size)) {
+			rsize = rq.connection->sendfile(file, offset, size);
+		} else {
+			io_vector v[IO_VECTORS];
+			rsize = rq.connection->writev(buf.segments(IO_VECTORS, v), v);
+		}
+		rq.write_wait = socket::out;
+		if (rsize == socket::data_not_ready) {
+			rq.write_wait = rq.connection->blocked_on(socket::out);
+			connection_wait(l, rq, rq.write_wait);
+		}
+		else if (rsize == socket::io_error) {
+			// the connection is broken, drop the output
+			rq.write_buffer.reset();
 			rq.write_buffer.setstate(ios::badbit);
+			rq.cur_state = request::CLOSING;
+		}
 		else if (rsize > 0) {
-			// if the buffer is empty, all data is written,
-			// discard the buffer
-			if (size == rsize)
-				rq.write_buffer.str(string());
-			else {
-				rq.write_buffer.clear();
-				rq.write_buffer.seekg(rsize, ios_base::cur);
-			}
+			buf.consume(rsize);
+			written = true;
 		}
 	}
+	return written;
 }
 
-/*
-void tcp_server::working_process(thread_int&) {
-			if (r == 0) {
-				if (rq->cur_state != request::TIME_OUT) {
-					// update last access time counter
-					rq->last_access = datetime().now();
-					rq->last_state = rq->cur_state;
-					rq->cur_state = request::TIME_OUT;
-				} else {
-					// when timeout is more than 10 secs, disconnect
-					if (datetime().now() - rq->last_access > _timeout) {
-						disconnect_client(rq);
-						continue;
-					}
-				}
-				back_to_queue(rq);
-				continue;
-			}
-			// update last access time counter
-			rq->cur_state = rq->last_state;
-			rq->last_access = datetime().now();
+void tcp_server::connection_wait(io_loop &l, request &rq,
+  socket::direction d) {
+	// the socket is not ready for the direction until the reactor says
+	if (d == socket::in) {
+		rq.can_read = false;
+		l._reactor->rearm(rq.connection->handle(), reactor::read);
+	} else {
+		rq.can_write = false;
+		l._reactor->rearm(rq.connection->handle(), reactor::write);
 	}
 }
-*/
 
-void tcp_server::working_process(thread_int&) {
+void tcp_server::working_process(io_loop &l) {
 	while (1) {
+		// wait for the connection is ready to process
+		l.ready.lock();
+		if (__atomic_load_n(&l.is_stopped, __ATOMIC_ACQUIRE))
+			break;
+		// take the connection from the ready-to-process
+		// connections pool
 		request *rq = NULL;
+		if (!l.reqs.pop(rq))
+			continue;
+		// the handler closes the connection, unlike the client closing
+		// its side only
+		bool closing = false;
 		try {
-			// take the connection from the ready-to-process
-			// connections pool
-			{
-				mutex_guard m(_lock);
-				while (reqs.empty() && !is_stopped)
-					_event.wait();
-				if (is_stopped)
-					break;
-				rq = reqs.front();
-				reqs.pop();
-			}
-            // process the connection
+			// process the connection
 			if (process_data_handler) {
 				if (!process_data_handler(*rq->connection,
 				  rq->read_buffer, rq->write_buffer)) {
+					closing = true;
 					rq->cur_state = request::CLOSING;
 				}
 			}
-			// return connection to the active connections list
-			{
-				mutex_guard m(_lock);
-				a_reqs.push_back(rq);
-			}
 		}
 		catch(dbp::exception &e) {
-			if (exception_handler)
-				exception_handler(e);
-			else
+			closing = true;
+			rq->cur_state = request::CLOSING;
+			if (!exception_handler) {
+				connection_done(l, rq);
 				throw;
+			}
+			exception_handler(e);
 		}
+		// the handler may ask to be called when the output is sent
+		long &resume = rq->write_buffer.iword(resume_flag);
+		rq->resume = resume != 0 && !closing;
+		resume = 0;
+		// or when the processing suspended is completed
+		if (rq->suspension && connection_park(l, rq, closing))
+			continue;
+		connection_done(l, rq);
 	}
 }
 
+void tcp_server::resume_on_drain(std::ostream &out) {
+	out.iword(resume_flag) = 1;
+}
+
+tcp_server::completion tcp_server::suspend(std::istream &in) {
+	request *rq = static_cast<request*>(in.pword(request_index));
+	if (!rq)
+		throw tcp_server_exception(_("the stream is not the connection one"));
+	if (!rq->suspension)
+		rq->suspension = new completion::state(rq);
+	return completion(rq->suspension);
+}
+
+void tcp_server::attach(std::istream &in, attachment *data) {
+	request *rq = static_cast<request*>(in.pword(request_index));
+	if (!rq) {
+		delete data;
+		throw tcp_server_exception(_("the stream is not the connection one"));
+	}
+	if (rq->data != data) {
+		delete rq->data;
+		rq->data = data;
+	}
+}
+
+tcp_server::attachment* tcp_server::attached(std::istream &in) {
+	request *rq = static_cast<request*>(in.pword(request_index));
+	return rq ? rq->data : NULL;
+}
+
+bool tcp_server::connection_park(io_loop &l, request *rq, bool closing) {
+	completion::state *s = rq->suspension;
+	s->lock.enter();
+	bool parked = s->status == completion::state::running && !closing;
+	if (parked) {
+		// the connection is kept busy, so the input/output thread does
+		// not process it, until the completion returns it
+		s->status = completion::state::parked;
+		s->loop = &l;
+		rq->read_buffer.compact();
+		rq->write_buffer.flush();
+	} else {
+		// completed while the handler was running, or closed
+		s->status = completion::state::done;
+		s->rq = NULL;
+		rq->suspension = NULL;
+		rq->resume = !closing;
+	}
+	s->lock.leave();
+	if (!parked)
+		s->unref();
+	return parked;
+}
+
+void tcp_server::connection_done(io_loop &l, request *rq) {
+	// discard the data consumed and pass the output to the socket
+	rq->read_buffer.compact();
+	rq->write_buffer.flush();
+	// return connection to the input/output thread
+	l.done_reqs.push(rq);
+	// wake it up unless it is busy or already woken by another thread
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&l.is_waiting, 0, __ATOMIC_SEQ_CST))
+		l._reactor->interrupt();
+}
+
 } // namespace
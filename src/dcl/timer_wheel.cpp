@@ -0,0 +1,178 @@
+/*
+ * timer_wheel.cpp
+ * This file is part of dbPager Classes Library (DCL)
+ *
+ * Copyright (c) 2009 Dennis Prochko <wolfsoft@mail.ru>
+ *
+ * DCL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3.
+ *
+ * DCL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DCL; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <dcl/timer_wheel.h>
+
+namespace dbp {
+
+using namespace std;
+
+timer::~timer() {
+	if (wheel)
+		wheel->cancel(*this);
+}
+
+timer_wheel::timer_wheel(unsigned int resolution):
+  resolution(resolution > 0 ? resolution : 1), tick(0), tick_time(now()),
+  count(0) {
+	for (int w = 0; w < wheels; w++) {
+		for (int i = 0; i < wheel_size; i++)
+			slots[w][i] = NULL;
+	}
+}
+
+timer_wheel::~timer_wheel() {
+	// detach the timers remaining
+	for (int w = 0; w < wheels; w++) {
+		for (int i = 0; i < wheel_size; i++) {
+			for (timer *t = slots[w][i]; t != NULL; t = t->next)
+				t->wheel = NULL;
+		}
+	}
+}
+
+uint64_t timer_wheel::now() {
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart * 1000 / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+void timer_wheel::arm(timer &t, unsigned int timeout) {
+	if (t.wheel)
+		t.wheel->cancel(t);
+	// count the ticks from the current time, the wheel may lag behind
+	uint64_t ticks = (timeout + resolution - 1) / resolution;
+	t.expires = tick + (now() - tick_time) / resolution +
+	  (ticks > 0 ? ticks : 1);
+	t.wheel = this;
+	link(t);
+	count++;
+}
+
+void timer_wheel::cancel(timer &t) {
+	if (t.wheel != this) {
+		if (t.wheel)
+			t.wheel->cancel(t);
+		return;
+	}
+	unlink(t);
+	t.wheel = NULL;
+	count--;
+}
+
+void timer_wheel::link(timer &t) {
+	// the wheel is selected by the distance to the expiration time
+	uint64_t delta = t.expires - tick;
+	const uint64_t max_delta = (uint64_t(1) << (wheel_bits * wheels)) - 1;
+	if (delta > max_delta) {
+		delta = max_delta;
+		t.expires = tick + delta;
+	}
+	int w = 0;
+	while (w < wheels - 1 && delta >= (uint64_t(1) << (wheel_bits * (w + 1))))
+		w++;
+	timer **head = &slots[w][(t.expires >> (wheel_bits * w)) & wheel_mask];
+	t.next = *head;
+	if (t.next)
+		t.next->pprev = &t.next;
+	t.pprev = head;
+	*head = &t;
+}
+
+void timer_wheel::unlink(timer &t) {
+	*t.pprev = t.next;
+	if (t.next)
+		t.next->pprev = t.pprev;
+	t.next = NULL;
+	t.pprev = NULL;
+}
+
+void timer_wheel::cascade(int wheel) {
+	// move the timers of the coarse wheel slot to the finer wheels
+	timer **head = &slots[wheel][(tick >> (wheel_bits * wheel)) & wheel_mask];
+	timer *t = *head;
+	*head = NULL;
+	while (t) {
+		timer *next = t->next;
+		link(*t);
+		t = next;
+	}
+}
+
+int timer_wheel::next_timeout() {
+	if (count == 0)
+		return -1;
+	// look for the nearest timer on the finest wheel, up to the moment
+	// the coarse wheel cascades
+	uint64_t ticks = 1;
+	while (ticks < wheel_size && !slots[0][(tick + ticks) & wheel_mask] &&
+	  ((tick + ticks) & wheel_mask) != 0)
+		ticks++;
+	uint64_t elapsed = now() - tick_time;
+	uint64_t timeout = ticks * resolution;
+	return timeout > elapsed ? int(timeout - elapsed) : 0;
+}
+
+void timer_wheel::expire(timers &expired) {
+	uint64_t ticks = (now() - tick_time) / resolution;
+	while (ticks > 0) {
+		// nothing to expire, just move the time forward
+		if (count == 0) {
+			tick += ticks;
+			tick_time += ticks * resolution;
+			return;
+		}
+		ticks--;
+		tick++;
+		tick_time += resolution;
+		for (int w = 1; w < wheels; w++) {
+			if ((tick >> (wheel_bits * (w - 1))) & wheel_mask)
+				break;
+			cascade(w);
+		}
+		// the timers of the current slot are expired
+		timer **head = &slots[0][tick & wheel_mask];
+		while (*head) {
+			timer *t = *head;
+			unlink(*t);
+			t->wheel = NULL;
+			count--;
+			expired.push_back(t);
+		}
+	}
+}
+
+} // namespace
@@ -0,0 +1,68 @@
+#include <cstdlib>
+#include <new>
+
+#include "allocations.h"
+
+namespace {
+
+size_t count = 0;
+
+void* allocate(size_t size) noexcept {
+	count++;
+	return malloc(size ? size : 1);
+}
+
+} // namespace
+
+size_t allocations() {
+	return count;
+}
+
+// All the forms are replaced, so the memory is always released by the
+// function matching the one allocated it
+
+void* operator new(size_t size) {
+	void *p = allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	void *p = allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept {
+	free(p);
+}
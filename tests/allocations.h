@@ -0,0 +1,11 @@
+#ifndef ALLOCATIONS_H_
+#define ALLOCATIONS_H_
+
+#include <cstddef>
+
+// The number of the memory allocations done by the test program; the
+// program counting them is linked with allocations.cpp, replacing the
+// global allocation functions
+size_t allocations();
+
+#endif /*ALLOCATIONS_H_*/
@@ -0,0 +1,76 @@
+#ifndef LOOPBACK_H_
+#define LOOPBACK_H_
+
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+
+#include <dcl/dclnet.h>
+
+// The port of the loopback interface, free at the moment
+inline int free_port() {
+	dbp::tcp_socket s;
+	s.bind(dbp::socket_address("127.0.0.1:0"));
+	return s.port();
+}
+
+// The client of the server tested over the loopback interface
+class loopback_client {
+public:
+	loopback_client(int port): closed(false) {
+		connected = s.connect("127.0.0.1", port);
+	}
+	bool is_connected() const {
+		return connected;
+	}
+	// Send all the data given
+	bool send(const std::string &data) {
+		size_t sent = 0;
+		while (connected && sent < data.size()) {
+			int size = s.write(data.size() - sent, data.data() + sent);
+			if (size <= 0)
+				return false;
+			sent += size;
+		}
+		return connected;
+	}
+	// Close the sending side of the connection, as the client having no
+	// more requests does
+	void close_output() {
+		::shutdown(s.handle(), SHUT_WR);
+	}
+	// Receive the data until the size given is received, the connection
+	// is closed by the server or nothing is received for the time given
+	// (in milliseconds)
+	std::string receive(size_t size = std::string::npos, int timeout = 5000) {
+		std::string rslt;
+		char buf[16384];
+		while (connected && rslt.size() < size && wait(timeout)) {
+			int n = s.read(sizeof(buf), buf);
+			if (n <= 0) {
+				closed = true;
+				break;
+			}
+			rslt.append(buf, n);
+		}
+		return rslt;
+	}
+	// Check for the connection is closed by the server within the time
+	// given (in milliseconds), discarding the data received
+	bool is_closed(int timeout = 5000) {
+		while (!closed && connected && wait(timeout))
+			receive(1, 0);
+		return closed;
+	}
+private:
+	dbp::tcp_socket s;
+	bool connected, closed;
+	bool wait(int timeout) {
+		struct pollfd p;
+		p.fd = s.handle();
+		p.events = POLLIN;
+		return ::poll(&p, 1, timeout) > 0;
+	}
+};
+
+#endif /*LOOPBACK_H_*/
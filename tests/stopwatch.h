@@ -0,0 +1,27 @@
+#ifndef STOPWATCH_H_
+#define STOPWATCH_H_
+
+#include <sys/time.h>
+
+// The time measured by the benchmarks; it is reported only, the checks
+// do not depend on it, as the machine running the tests may be loaded
+class stopwatch {
+public:
+	stopwatch() {
+		restart();
+	}
+	void restart() {
+		gettimeofday(&start, NULL);
+	}
+	// the time elapsed since the start (in milliseconds)
+	double elapsed() const {
+		timeval stop;
+		gettimeofday(&stop, NULL);
+		return (stop.tv_sec - start.tv_sec) * 1000.0 +
+		  (stop.tv_usec - start.tv_usec) / 1000.0;
+	}
+private:
+	timeval start;
+};
+
+#endif /*STOPWATCH_H_*/
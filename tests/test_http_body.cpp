@@ -0,0 +1,131 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+using namespace std;
+using namespace dbp;
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_inline()) {
+			cerr << "the body kept in the memory failed." << endl;
+			return -1;
+		}
+		if (!check_spooled("")) {
+			cerr << "the body spooled to the memory file failed." << endl;
+			return -1;
+		}
+		if (!check_spooled(filefs().get_temp_dir())) {
+			cerr << "the body spooled to the temporary file failed." << endl;
+			return -1;
+		}
+		if (!check_header()) {
+			cerr << "the content of the header failed." << endl;
+			return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	static bool same(const http_body &b, const string &expected) {
+		if (b.size() != expected.size() ||
+		  string(b.data(), b.size()) != expected || b.data()[b.size()] != 0)
+			return false;
+		// the body is read the same way wherever it is stored
+		string s;
+		char buf[1000];
+		int n;
+		while ((n = b.read(s.size(), sizeof(buf), buf)) > 0)
+			s.append(buf, n);
+		return n == 0 && s == expected;
+	}
+	bool check_inline() {
+		http_body b;
+		if (!b.empty() || string(b.data()) != "")
+			return false;
+		b.reserve(1ULL << 40);
+		b.append("abc", 3);
+		istringstream in("defgh");
+		if (b.append(in, 3) != 3 || !same(b, "abcdef") ||
+		  b.file().handle() >= 0)
+			return false;
+		b.assign("xyz", 3);
+		return same(b, "xyz");
+	}
+	bool check_spooled(const string &dir) {
+		http_body b;
+		b.spool_size(100).spool_dir(dir);
+		string expected;
+		for (int i = 0; i < 1000; i++) {
+			string s = to_string<int>(i) + ",";
+			b.append(s.data(), s.size());
+			expected += s;
+			// the data is mapped, then appended again
+			if (i == 50 && !same(b, expected))
+				return false;
+		}
+		istringstream in(string(100000, 'z'));
+		expected += string(100000, 'z');
+		if (b.append(in, 200000) != 100000 || b.file().handle() < 0 ||
+		  !same(b, expected))
+			return false;
+		// the copy shares the file until it is changed
+		http_body copy(b);
+		if (copy.file().handle() != b.file().handle())
+			return false;
+		copy.append("copy", 4);
+		b.append("source", 6);
+		if (copy.file().handle() == b.file().handle() ||
+		  !same(copy, expected + "copy") || !same(b, expected + "source"))
+			return false;
+		// the zero terminating the data of the copy is not written into
+		// the data of the source
+		http_body other;
+		other = b;
+		b.append("!", 1);
+		if (!same(other, expected + "source") ||
+		  !same(b, expected + "source!"))
+			return false;
+		copy = b;
+		b.clear();
+		return b.empty() && b.file().handle() < 0 &&
+		  same(copy, expected + "source!");
+	}
+	bool check_header() {
+		http_request req;
+		req.set_header("Content-Type: multipart/form-data; boundary=b");
+		req.get_body().spool_size(16);
+		string large(100000, 'x');
+		string content = "--b\r\nContent-Disposition: form-data; name=large\r\n"
+		  "\r\n" + large + "\r\n--b--\r\n";
+		istringstream in(content);
+		req.add_content(in);
+		if (req.get_content_size() != int(content.size()) ||
+		  req.get_header("Content-Length") != to_string<size_t>(content.size()) ||
+		  req.get_body().file().handle() < 0)
+			return false;
+		// the multipart content spooled is parsed by pieces
+		http_content_elements e = http_content_parser(req).parse();
+		if (e.size() != 1 || e[0].name != "large" ||
+		  e[0].value.size() + e[0].file.size() != large.size())
+			return false;
+		// the response spooled is sent from the file
+		http_response resp;
+		resp.get_body().spool_size(16);
+		resp.set_content(large);
+		io_buffer buf;
+		http_response_writer::write(buf, resp);
+		return resp.get_body().file().handle() >= 0 &&
+		  buf.size() > large.size();
+	}
+};
+
+IMPLEMENT_APP(test().app);
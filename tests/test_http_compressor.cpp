@@ -0,0 +1,227 @@
+#include <iostream>
+#include <string>
+#include <zlib.h>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+#include "stopwatch.h"
+
+using namespace std;
+using namespace dbp;
+
+#define RESPONSES 1000
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_negotiation()) {
+			cerr << "coding negotiation failed." << endl;
+			return -1;
+		}
+		if (!check_types()) {
+			cerr << "content type check failed." << endl;
+			return -1;
+		}
+		if (!check_memory()) {
+			cerr << "content compression failed." << endl;
+			return -1;
+		}
+		if (!check_stream()) {
+			cerr << "content compression by parts failed." << endl;
+			return -1;
+		}
+		benchmark();
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	size_t parts;
+	static string inflate(const string &data) {
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		// both the gzip and the zlib wrappers are detected
+		if (inflateInit2(&z, 47) != Z_OK)
+			return "";
+		string rslt;
+		char buf[16384];
+		z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+		z.avail_in = data.size();
+		int r;
+		do {
+			z.next_out = reinterpret_cast<Bytef*>(buf);
+			z.avail_out = sizeof(buf);
+			r = ::inflate(&z, Z_NO_FLUSH);
+			rslt.append(buf, sizeof(buf) - z.avail_out);
+		} while (r == Z_OK);
+		inflateEnd(&z);
+		return r == Z_STREAM_END ? rslt : "";
+	}
+	static string str(const io_buffer &buf) {
+		string rslt;
+		io_vector v[64];
+		int n = buf.segments(64, v);
+		for (int i = 0; i < n; i++)
+			rslt.append(v[i].data, v[i].size);
+		return rslt;
+	}
+	static string document(size_t size) {
+		string rslt;
+		for (size_t i = 0; rslt.size() < size; i++)
+			rslt += "{\"id\": " + to_string<size_t>(i) + ", \"name\": \"item\"},\n";
+		rslt.resize(size);
+		return rslt;
+	}
+	bool check_negotiation() {
+		return http_compressor::negotiate("gzip, deflate, br") ==
+		    http_compressor::gzip &&
+		  http_compressor::negotiate("deflate, gzip;q=0.5") ==
+		    http_compressor::deflate &&
+		  http_compressor::negotiate("gzip;q=0, deflate;q=0") ==
+		    http_compressor::identity &&
+		  http_compressor::negotiate("*") == http_compressor::gzip &&
+		  http_compressor::negotiate("*;q=0, deflate") ==
+		    http_compressor::deflate &&
+		  http_compressor::negotiate("GZIP ; Q=0.001") ==
+		    http_compressor::gzip &&
+		  http_compressor::negotiate("x-gzip") == http_compressor::gzip &&
+		  http_compressor::negotiate("br, identity") ==
+		    http_compressor::identity &&
+		  http_compressor::negotiate("") == http_compressor::identity;
+	}
+	bool check_types() {
+		http_compressor c;
+		c.register_compressed_type("application/x-custom");
+		return c.compressible("text/html; charset=utf-8") &&
+		  c.compressible("application/json") &&
+		  c.compressible("image/svg+xml") &&
+		  !c.compressible("image/png") &&
+		  !c.compressible("Application/ZIP") &&
+		  !c.compressible("video/mp4") &&
+		  !c.compressible("application/x-custom; q=1") &&
+		  !c.compressible("");
+	}
+	bool check_memory() {
+		http_compressor c;
+		http_request req;
+		req.set_header("Accept-Encoding", "gzip, deflate");
+		string content = document(10000);
+		http_response resp;
+		resp.set_content_type("application/json");
+		resp.set_header("ETag", "\"abc\"");
+		resp.set_content(content);
+		if (c.filter(req, resp) != NULL ||
+		  resp.get_header("Content-Encoding") != "gzip" ||
+		  resp.get_header("Vary") != "Accept-Encoding" ||
+		  resp.get_header("ETag") != "\"abc-gzip\"" ||
+		  resp.get_header("Content-Length") !=
+		    to_string<int>(resp.get_content_size()) ||
+		  resp.get_content_size() >= int(content.size()) / 4 ||
+		  inflate(string(resp.get_content(), resp.get_content_size())) !=
+		    content)
+			return false;
+		// the same content is found in the cache
+		http_response again;
+		again.set_content(content);
+		c.filter(req, again);
+		if (c.cache_hits() != 1 || again.get_content_size() !=
+		  resp.get_content_size())
+			return false;
+		// the responses not compressed
+		http_response small, image, error, encoded;
+		small.set_content("{}");
+		image.set_content_type("image/jpeg");
+		image.set_content(content);
+		error.set_status(http_error::not_found);
+		error.set_content(content);
+		encoded.set_header("Content-Encoding", "br");
+		encoded.set_content(content);
+		c.filter(req, small);
+		c.filter(req, image);
+		c.filter(req, error);
+		c.filter(req, encoded);
+		return small.get_header("Vary") == "Accept-Encoding" &&
+		  small.get_content_size() == 2 &&
+		  image.get_header("Content-Encoding").empty() &&
+		  error.get_header("Content-Encoding").empty() &&
+		  encoded.get_header("Content-Encoding") == "br";
+	}
+	bool produce(std::ostream &out) {
+		out << document(1000);
+		return ++parts < 5;
+	}
+	bool check_stream() {
+		http_compressor c;
+		http_request req;
+		req.set_header("Accept-Encoding", "deflate");
+		// the large file is compressed by parts
+		string content = document(3000000);
+		io_file file = io_file::temporary(filefs().get_temp_dir());
+		file.write(0, content.size(), content.data());
+		http_response resp;
+		resp.set_content_type("text/html");
+		resp.set_content(file);
+		http_compressor::stream *s = c.filter(req, resp);
+		if (!s || !resp.get_content_producer() ||
+		  resp.get_header("Content-Encoding") != "deflate" ||
+		  !resp.get_header("Content-Length").empty())
+			return false;
+		io_stream out;
+		size_t calls = 0;
+		while (resp.get_content_producer()(out))
+			calls++;
+		delete s;
+		if (calls < 2 || inflate(str(out.buffer())) != content)
+			return false;
+		// every part produced is flushed
+		http_response produced;
+		produced.set_content(http_response::content_producer(this,
+		  &test::produce));
+		parts = 0;
+		s = c.filter(req, produced);
+		if (!s)
+			return false;
+		string expected;
+		io_stream part;
+		bool more;
+		do {
+			more = produced.get_content_producer()(part);
+			expected += document(1000);
+			if (part.buffer().empty())
+				return false;
+		} while (more);
+		delete s;
+		return inflate(str(part.buffer())) == expected;
+	}
+	void benchmark() {
+		http_request req;
+		req.set_header("Accept-Encoding", "gzip");
+		string content = document(50000);
+		http_compressor cached, uncached(6, 0);
+		size_t compressed = 0;
+		stopwatch timing;
+		for (size_t i = 0; i < RESPONSES; i++) {
+			http_response resp;
+			resp.set_content(content);
+			cached.filter(req, resp);
+			compressed = resp.get_content_size();
+		}
+		double t1 = timing.elapsed();
+		timing.restart();
+		for (size_t i = 0; i < RESPONSES / 10; i++) {
+			http_response resp;
+			resp.set_content(content);
+			uncached.filter(req, resp);
+		}
+		double t2 = timing.elapsed() * 10;
+		cout << "compressed " << content.size() << " to " << compressed <<
+		  " bytes; " << RESPONSES << " responses: " << t1 <<
+		  " ms cached, " << t2 << " ms not cached" << endl;
+	}
+};
+
+IMPLEMENT_APP(test().app);
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <string>
+#include <string.h>
 
 #include <dcl/dclbase.h>
 #include <dcl/dclnet.h>
@@ -6,6 +8,48 @@
 using namespace std;
 using namespace dbp;
 
+static const char form_data[] =
+	"--AaB03x\n"
+	"Content-Disposition: form-data; name=\"submit-name\"\n"
+	"\n"
+	"Larry\n"
+	"--AaB03x\n"
+	"Content-Disposition: form-data; name=\"files\"\n"
+	"Content-Type: multipart/mixed; boundary=BbC04y\n"
+	"\n"
+	"--BbC04y\n"
+	"Content-Disposition: file; filename=\"file1.txt\"\n"
+	"Content-Type: text/plain\n"
+	"\n"
+	"... contents of file1.txt ...\n"
+	"--BbC04y\n"
+	"Content-Disposition: file; filename=\"file2.gif\"\n"
+	"Content-Type: image/gif\n"
+	"Content-Transfer-Encoding: binary\n"
+	"\n"
+	".\x00\x01\x02...other contents of file2.gif...\n"
+	"--BbC04y--\n"
+	"--AaB03x--\n";
+
+static const char upload[] =
+	"preamble\r\n"
+	"------boundary\r\n"
+	"Content-Disposition: form-data; name=\"title\"\r\n"
+	"\r\n"
+	"line\r\n--boundar\r\n"
+	"------boundary  \r\n"
+	"Content-Disposition: form-data; name=empty\r\n"
+	"\r\n"
+	"\r\n"
+	"------boundary\r\n"
+	"content-disposition: form-data; name=\"file\"; "
+	  "filename=\"a;\\\"b\\\".txt\"\r\n"
+	"Content-Type: text/plain\r\n"
+	"\r\n"
+	"\r\r\n\n\r\r\n"
+	"------boundary--\r\n"
+	"epilogue";
+
 class test {
 public:
 	test(): app(application::instance()) {
@@ -73,29 +117,7 @@ public:
 		{
 			http_header h;
 			h.set_header("Content-Type: multipart/form-data; boundary=AaB03x");
-			h.set_content(
-				"--AaB03x\n"
-				"Content-Disposition: form-data; name=\"submit-name\"\n"
-				"\n"
-				"Larry\n"
-				"--AaB03x\n"
-				"Content-Disposition: form-data; name=\"files\"\n"
-				"Content-Type: multipart/mixed; boundary=BbC04y\n"
-				"\n"
-				"--BbC04y\n"
-				"Content-Disposition: file; filename=\"file1.txt\"\n"
-				"Content-Type: text/plain\n"
-				"\n"
-				"... contents of file1.txt ...\n"
-				"--BbC04y\n"
-				"Content-Disposition: file; filename=\"file2.gif\"\n"
-				"Content-Type: image/gif\n"
-				"Content-Transfer-Encoding: binary\n"
-				"\n"
-				".\x00\x01\x02...other contents of file2.gif...\n"
-				"--BbC04y--\n"
-				"--AaB03x--\n"
-			);
+			h.set_content(sizeof(form_data) - 1, form_data);
 			http_content_elements e = http_content_parser(h).parse();
 			// check for elements count
 			rslt = rslt && e.size() == 3;
@@ -104,6 +126,31 @@ public:
 				"3 elements expected, " << e.size() << " found." << endl;
 				return -1;
 			}
+			// check for the nested files
+			rslt = rslt && e[0].name == "submit-name" && e[0].value == "Larry" &&
+			  e[1].name == "files" && e[1].filename == "file1.txt" &&
+			  e[1].content_type == "text/plain" &&
+			  e[1].value == "... contents of file1.txt ..." &&
+			  e[2].name == "files" && e[2].filename == "file2.gif" &&
+			  e[2].value == string(".\x00\x01\x02...other contents of file2.gif...",
+			    37);
+			if (!rslt) {
+				cerr << "multipart/form-data failed; " <<
+				"the values of the parts differ." << endl;
+				return -1;
+			}
+		}
+		if (!check_streaming()) {
+			cerr << "multipart/form-data streaming failed." << endl;
+			return -1;
+		}
+		if (!check_spooling()) {
+			cerr << "multipart/form-data spooling failed." << endl;
+			return -1;
+		}
+		if (!check_malformed()) {
+			cerr << "multipart/form-data malformed content accepted." << endl;
+			return -1;
 		}
 		return rslt ? 0 : -1;
 	};
@@ -114,6 +161,76 @@ public:
 private:
 	// the link to the console application class
 	application &app;
+	// the content fed by the pieces of any size is parsed the same way
+	bool check_streaming() {
+		for (size_t piece = 1; piece <= sizeof(upload); piece++) {
+			http_multipart_parser p("----boundary");
+			http_multipart_parser::result r = http_multipart_parser::incomplete;
+			for (size_t i = 0; i < sizeof(upload) - 1; i += piece)
+				r = p.parse(upload + i, min(piece, sizeof(upload) - 1 - i));
+			const http_content_elements &e = p.elements();
+			if (r != http_multipart_parser::complete || e.size() != 3 ||
+			  e[0].name != "title" || e[0].value != "line\r\n--boundar" ||
+			  e[1].name != "empty" || !e[1].value.empty() ||
+			  e[2].name != "file" || e[2].filename != "a;\"b\".txt" ||
+			  e[2].content_type != "text/plain" || e[2].value != "\r\r\n\n\r")
+				return false;
+		}
+		return true;
+	}
+	// the large parts are stored in the files, the parts delivered to the
+	// handler are not collected
+	bool check_spooling() {
+		const size_t size = 1000000;
+		string large(size, 'x');
+		for (size_t i = 0; i < size; i += 1000)
+			large[i] = '\n';
+		string content = "--b\r\nContent-Disposition: form-data; name=small\r\n"
+		  "\r\nsmall\r\n--b\r\nContent-Disposition: form-data; name=large; "
+		  "filename=large.bin\r\n\r\n" + large + "\r\n--b\r\n"
+		  "Content-Disposition: form-data; name=over\r\n\r\n" +
+		  string(100, 'y') + "\r\n--b--\r\n";
+		http_multipart_parser p("b", 65536, 64);
+		for (size_t i = 0; i < content.size(); i += 4096)
+			p.parse(content.data() + i, min(size_t(4096), content.size() - i));
+		const http_content_elements &e = p.elements();
+		// the last part does not fit into the memory left
+		if (e.size() != 3 || e[0].value != "small" || e[0].file.handle() >= 0 ||
+		  !e[1].value.empty() || e[1].file.size() != size ||
+		  !e[2].value.empty() || e[2].file.size() != 100)
+			return false;
+		string stored(size, 0);
+		if (e[1].file.read(0, size, &stored[0]) != int(size) || stored != large)
+			return false;
+		http_multipart_parser h("b", 65536, 64);
+		h.on_part(create_delegate(this, &test::on_part));
+		parts = 0;
+		if (h.parse(content.data(), content.size()) !=
+		  http_multipart_parser::complete || parts != 3 ||
+		  !h.elements().empty())
+			return false;
+		return true;
+	}
+	size_t parts;
+	void on_part(http_content_element &e) {
+		parts++;
+	}
+	bool check_malformed() {
+		const char *data[] = {
+			"--b\r\nno colon\r\n\r\nvalue\r\n--b--",
+			"--b\r\nContent-Type: text/plain\r\n\r\nvalue\r\n--bb",
+			"--bx\r\n\r\nvalue\r\n--b--"
+		};
+		for (size_t i = 0; i < sizeof(data) / sizeof(data[0]); i++) {
+			http_multipart_parser p("b");
+			if (p.parse(data[i], strlen(data[i])) != http_multipart_parser::error)
+				return false;
+		}
+		// the header line is limited
+		http_multipart_parser p("b");
+		string line = "--b\r\nX-Long: " + string(10000, 'z');
+		return p.parse(line.data(), line.size()) == http_multipart_parser::error;
+	}
 };
 
 IMPLEMENT_APP(test::get_instance());
@@ -0,0 +1,211 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+using namespace std;
+using namespace dbp;
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		dir = filefs().get_temp_dir() + "/test_http_file_handler." +
+		  to_string<int>(getpid());
+		mkdir(dir.c_str(), 0700);
+		mkdir((dir + "/www").c_str(), 0700);
+		mkdir((dir + "/www/sub").c_str(), 0700);
+		write("secret.txt", "secret");
+		write("www/index.html", "<html></html>");
+		write("www/sub/small file.txt", "abcdefghij");
+		write("www/large.bin", string(1000, 'x'));
+		write("www/page.html", "<html>" + string(80, ' ') + "</html>");
+		int rslt = run();
+		unlink((dir + "/secret.txt").c_str());
+		unlink((dir + "/www/index.html").c_str());
+		unlink((dir + "/www/sub/small file.txt").c_str());
+		unlink((dir + "/www/large.bin").c_str());
+		unlink((dir + "/www/page.html").c_str());
+		rmdir((dir + "/www/sub").c_str());
+		rmdir((dir + "/www").c_str());
+		rmdir(dir.c_str());
+		return rslt;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	string dir;
+	void write(const string &name, const string &content) {
+		ofstream out((dir + "/" + name).c_str(), ios::binary | ios::trunc);
+		out << content;
+	}
+	int run() {
+		http_file_handler files(dir + "/www", 16777216, 100);
+		files.check_interval(0);
+		if (!check_files(files)) {
+			cerr << "serving of the files failed." << endl;
+			return -1;
+		}
+		if (!check_conditional(files)) {
+			cerr << "conditional requests failed." << endl;
+			return -1;
+		}
+		if (!check_ranges(files)) {
+			cerr << "range requests failed." << endl;
+			return -1;
+		}
+		if (!check_changes(files)) {
+			cerr << "checking for the file changes failed." << endl;
+			return -1;
+		}
+		return 0;
+	}
+	static http_request request(const string &path,
+	  const string &header = "") {
+		http_request req;
+		req.set_method(http_method::get);
+		req.set_path_info(path);
+		if (!header.empty())
+			req.set_header(header);
+		return req;
+	}
+	static string content(const http_response &resp) {
+		return string(resp.get_content(), resp.get_content_size());
+	}
+	bool check_files(http_file_handler &files) {
+		http_response resp = files.handle(request("/sub/small%20file.txt"));
+		if (resp.get_status_code() != http_error::ok ||
+		  content(resp) != "abcdefghij" ||
+		  resp.get_content_type() != "text/plain" ||
+		  resp.get_header("ETag").size() != 18 ||
+		  resp.get_header("Last-Modified").empty() ||
+		  resp.get_header("Accept-Ranges") != "bytes")
+			return false;
+		// the second request is served from the cache
+		size_t hits = files.cache_hits();
+		if (content(files.handle(request("/sub/small%20file.txt"))) !=
+		  "abcdefghij" || files.cache_hits() != hits + 1)
+			return false;
+		// the large file is sent from the file
+		resp = files.handle(request("/large.bin"));
+		if (resp.get_content_file().handle() < 0 ||
+		  resp.get_header("Content-Length") != "1000")
+			return false;
+		// the index of the directory
+		if (content(files.handle(request("/"))) != "<html></html>")
+			return false;
+		// the files outside of the root are not served
+		if (files.handle(request("/../secret.txt")).get_status_code() !=
+		  http_error::not_found ||
+		  files.handle(request("/sub/%2e%2e/%2e%2e/secret.txt")).
+		  get_status_code() != http_error::not_found ||
+		  files.handle(request("/missing")).get_status_code() !=
+		  http_error::not_found)
+			return false;
+		// the content cached is shared by the response
+		resp = files.handle(request("/sub/small%20file.txt"));
+		if (resp.get_body().buffer().size() != 10)
+			return false;
+		// the response to HEAD is the response to GET, the server drops
+		// the content
+		http_request req = request("/sub/small%20file.txt");
+		req.set_method(http_method::head);
+		http_response head = files.handle(req);
+		if (head.get_header("Content-Length") != "10" ||
+		  head.get_header("ETag") != resp.get_header("ETag") ||
+		  head.get_header("Last-Modified") !=
+		  resp.get_header("Last-Modified"))
+			return false;
+		// so the response to HEAD is compressed as well
+		http_compressor compressor(6, 16777216, 1);
+		req = request("/page.html", "Accept-Encoding: gzip");
+		resp = files.handle(req);
+		delete compressor.filter(req, resp);
+		req.set_method(http_method::head);
+		head = files.handle(req);
+		delete compressor.filter(req, head);
+		if (resp.get_header("Content-Encoding") != "gzip" ||
+		  head.get_header("Content-Encoding") != "gzip" ||
+		  head.get_header("ETag") != resp.get_header("ETag") ||
+		  head.get_header("Content-Length") !=
+		  resp.get_header("Content-Length"))
+			return false;
+		req.set_method(http_method::post);
+		return files.handle(req).get_status_code() ==
+		  http_error::method_not_allowed;
+	}
+	bool check_conditional(http_file_handler &files) {
+		http_response resp = files.handle(request("/index.html"));
+		string etag = resp.get_header("ETag");
+		string modified = resp.get_header("Last-Modified");
+		string compressed = etag.substr(0, etag.size() - 1) + "-gzip\"";
+		return files.handle(request("/index.html", "If-None-Match: " +
+		    etag)).get_status_code() == http_error::not_modified &&
+		  files.handle(request("/index.html", "If-None-Match: \"x\", W/" +
+		    etag)).get_status_code() == http_error::not_modified &&
+		  files.handle(request("/index.html", "If-None-Match: " +
+		    compressed)).get_status_code() == http_error::not_modified &&
+		  files.handle(request("/index.html", "If-None-Match: *")).
+		    get_status_code() == http_error::not_modified &&
+		  files.handle(request("/index.html", "If-None-Match: \"x\"")).
+		    get_status_code() == http_error::ok &&
+		  files.handle(request("/index.html", "If-Modified-Since: " +
+		    modified)).get_status_code() == http_error::not_modified &&
+		  files.handle(request("/index.html",
+		    "If-Modified-Since: Sat, 01 Jan 2000 00:00:00 GMT")).
+		    get_status_code() == http_error::ok;
+	}
+	bool check_ranges(http_file_handler &files) {
+		const string path = "/sub/small%20file.txt";
+		http_response resp = files.handle(request(path, "Range: bytes=2-4"));
+		if (resp.get_status_code() != http_error::partial_content ||
+		  content(resp) != "cde" ||
+		  resp.get_header("Content-Range") != "bytes 2-4/10")
+			return false;
+		if (content(files.handle(request(path, "Range: bytes=-3"))) != "hij" ||
+		  content(files.handle(request(path, "Range: bytes=7-100"))) != "hij")
+			return false;
+		resp = files.handle(request(path, "Range: bytes=10-"));
+		if (resp.get_status_code() !=
+		  http_error::requested_range_not_satisfiable ||
+		  resp.get_header("Content-Range") != "bytes */10")
+			return false;
+		// the multiple ranges and the ranges of the other version of the
+		// file are not sent
+		http_request req = request(path, "Range: bytes=1-2,4-5");
+		if (files.handle(req).get_status_code() != http_error::ok)
+			return false;
+		req = request(path, "Range: bytes=0-0");
+		req.set_header("If-Range", "\"x\"");
+		if (content(files.handle(req)) != "abcdefghij")
+			return false;
+		req.set_header("If-Range", resp.get_header("ETag"));
+		if (content(files.handle(req)) != "a")
+			return false;
+		// the tag of the content compressed is not the tag of the file
+		string etag = resp.get_header("ETag");
+		req.set_header("If-Range", etag.substr(0, etag.size() - 1) +
+		  "-gzip\"");
+		if (content(files.handle(req)) != "abcdefghij")
+			return false;
+		resp = files.handle(request("/large.bin", "Range: bytes=100-199"));
+		return resp.get_status_code() == http_error::partial_content &&
+		  resp.get_content_file().handle() >= 0 &&
+		  resp.get_header("Content-Length") == "100";
+	}
+	bool check_changes(http_file_handler &files) {
+		string etag = files.handle(request("/index.html")).get_header("ETag");
+		write("www/index.html", "<html>changed</html>");
+		http_response resp = files.handle(request("/index.html"));
+		return content(resp) == "<html>changed</html>" &&
+		  resp.get_header("ETag") != etag;
+	}
+};
+
+IMPLEMENT_APP(test().app);
@@ -0,0 +1,208 @@
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+#include "allocations.h"
+#include "stopwatch.h"
+
+using namespace std;
+using namespace dbp;
+
+#define LOOKUPS 1000000
+
+// The map of the tokens built on every lookup to compare with, as the
+// conversion has been done before
+http_method::http_method map_lookup(const string &value) {
+	typedef pair<string, http_method::http_method> method_map;
+	const char *tokens[] = { "GET", "PUT", "POST", "DELETE", "CONNECT",
+	  "OPTIONS", "TRACE", "PATCH", "PROPFIND", "PROPPATCH", "MKCOL", "COPY",
+	  "MOVE", "LOCK", "UNLOCK", "VERSION_CONTROL", "CHECKOUT", "UNCHECKOUT",
+	  "CHECKIN", "UPDATE", "LABEL", "REPORT", "MKWORKSPACE", "MKACTIVITY",
+	  "BASELINE_CONTROL", "MERGE" };
+	map<string, http_method::http_method> m;
+	for (size_t i = 0; i < sizeof(tokens) / sizeof(tokens[0]); i++)
+		m.insert(method_map(tokens[i], http_method::http_method(i)));
+	m.insert(method_map("HEAD", http_method::head));
+	map<string, http_method::http_method>::const_iterator i = m.find(value);
+	return i == m.end() ? http_method::unknown : i->second;
+}
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_methods()) {
+			cerr << "method conversion failed." << endl;
+			return -1;
+		}
+		if (!check_statuses()) {
+			cerr << "status conversion failed." << endl;
+			return -1;
+		}
+		if (!check_fields()) {
+			cerr << "header fields failed." << endl;
+			return -1;
+		}
+		if (!check_allocations()) {
+			cerr << "header fields allocations failed." << endl;
+			return -1;
+		}
+		benchmark();
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	bool check_methods() {
+		for (int m = http_method::get; m <= http_method::head; m++) {
+			http_method::http_method method = http_method::http_method(m);
+			string_ref token = http_method::token(method);
+			if (method == http_method::unknown) {
+				if (!token.empty())
+					return false;
+				continue;
+			}
+			if (http_method::parse(token) != method ||
+			  map_lookup(token.str()) != method)
+				return false;
+		}
+		http_request req;
+		req.set_method("PROPPATCH");
+		if (req.get_method() != http_method::proppatch ||
+		  req.method() != "PROPPATCH")
+			return false;
+		http_response resp;
+		resp.set_allow(http_method::del);
+		return resp.get_allow() == http_method::del &&
+		  resp.get_header("Allow") == "DELETE" &&
+		  // the tokens are case sensitive
+		  http_method::parse("get") == http_method::unknown &&
+		  http_method::parse("GETS") == http_method::unknown &&
+		  http_method::parse("GE") == http_method::unknown &&
+		  http_method::parse("") == http_method::unknown &&
+		  http_method::parse("\xff\xff\xff") == http_method::unknown;
+	}
+	bool check_statuses() {
+		return string(http_error::reason(http_error::ok)) == "OK" &&
+		  string(http_error::reason(http_error::temporary_redirect)) ==
+		    "Temporary Redirect" &&
+		  string(http_error::reason(http_error::expectation_failed)) ==
+		    "Expectation Failed" &&
+		  string(http_error::reason(http_error::http_error(306))).empty() &&
+		  string(http_error::reason(http_error::http_error(420))).empty() &&
+		  string(http_error::reason(http_error::http_error(99))).empty() &&
+		  string(http_error::reason(http_error::http_error(600))).empty();
+	}
+	bool check_fields() {
+		http_fields f;
+		f["Content-Type"] = "text/html";
+		f["X-Custom"] = "1";
+		f["content-type"] = "text/plain";
+		if (f.size() != 2 || f.find("CONTENT-TYPE") == f.end() ||
+		  f.find("content-type")->second != "text/plain" ||
+		  f.find(http_fields::content_type) != f.begin() ||
+		  f.find("X-Custom")->id() != http_fields::other ||
+		  f.find("X-Missing") != f.end() ||
+		  http_fields::id("transfer-encoding") !=
+		    http_fields::transfer_encoding)
+			return false;
+		// the fields not fit into the object are moved, the order is kept
+		for (int i = 0; i < 40; i++)
+			f["X-Field-" + to_string<int>(i)] = to_string<int>(i);
+		if (f.erase("X-Custom") != 1 || f.erase("X-Custom") != 0)
+			return false;
+		http_fields copy(f);
+		if (copy.size() != 41 || copy.begin()->first != "Content-Type")
+			return false;
+		int n = 0;
+		for (http_fields::const_iterator i = copy.begin() + 1; i != copy.end();
+		  ++i, ++n) {
+			if (i->first != "X-Field-" + to_string<int>(n) ||
+			  copy.find(i->first)->second != to_string<int>(n))
+				return false;
+		}
+		// the fields are added after several moved are erased
+		http_fields g;
+		for (int i = 0; i < 17; i++)
+			g["X-Field-" + to_string<int>(i)] = to_string<int>(i);
+		for (int i = 0; i < 2; i++)
+			g.erase("X-Field-" + to_string<int>(i));
+		for (int i = 17; i < 20; i++)
+			g["X-Field-" + to_string<int>(i)] = to_string<int>(i);
+		if (g.size() != 18)
+			return false;
+		n = 2;
+		for (http_fields::const_iterator i = g.begin(); i != g.end();
+		  ++i, ++n) {
+			if (i->first != "X-Field-" + to_string<int>(n) ||
+			  i->second != to_string<int>(n) ||
+			  g.find(i->first)->second != to_string<int>(n))
+				return false;
+		}
+		copy.clear();
+		copy["Host"] = "localhost";
+		f = copy;
+		return f.size() == 1 && f.find(http_fields::host)->second == "localhost";
+	}
+	// the allocations done to store the headers of the typical request
+	bool check_allocations() {
+		http_request_parser p;
+		string data(request);
+		if (p.parse(data.data(), data.size()) != http_request_parser::complete)
+			return false;
+		map<string, string, http_header::ci_less> m;
+		size_t start = allocations();
+		for (size_t i = 0; i < p.headers_count(); i++)
+			m[p.header_name(i).str()] = p.header_value(i).str();
+		size_t map_allocations = allocations() - start;
+		http_request req;
+		start = allocations();
+		for (size_t i = 0; i < p.headers_count(); i++)
+			req.set_header(p.header_name(i), p.header_value(i));
+		size_t fields_allocations = allocations() - start;
+		cout << "allocations per request: map " << map_allocations <<
+		  ", http_fields " << fields_allocations << endl;
+		return req.get_header("user-agent") == m["User-Agent"] &&
+		  req.get_host() == "www.example.com" &&
+		  fields_allocations < map_allocations;
+	}
+	void benchmark() {
+		const char *tokens[] = { "GET", "POST", "HEAD", "PROPFIND", "BREW" };
+		const size_t n = sizeof(tokens) / sizeof(tokens[0]);
+		size_t found = 0;
+		stopwatch timing;
+		for (size_t i = 0; i < LOOKUPS; i++)
+			found += http_method::parse(tokens[i % n]) != http_method::unknown;
+		double t1 = timing.elapsed();
+		timing.restart();
+		for (size_t i = 0; i < LOOKUPS / 100; i++)
+			found += map_lookup(tokens[i % n]) != http_method::unknown;
+		double t2 = timing.elapsed() * 100;
+		cout << "method lookup: " << t1 << " ms, map built per lookup: " <<
+		  t2 << " ms (" << LOOKUPS << " lookups, " << found << " found)" <<
+		  endl;
+	}
+	static const char *request;
+};
+
+const char *test::request =
+  "GET /index.html HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
+    "Firefox/115.0\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+    "*/*;q=0.8\r\n"
+  "Accept-Language: en-US,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Connection: keep-alive\r\n"
+  "Upgrade-Insecure-Requests: 1\r\n"
+  "If-Modified-Since: Sat, 01 Jan 2000 00:00:00 GMT\r\n"
+  "Cache-Control: max-age=0\r\n"
+  "\r\n";
+
+IMPLEMENT_APP(test().app);
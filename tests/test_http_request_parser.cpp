@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+using namespace std;
+using namespace dbp;
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_request()) {
+			cerr << "request parsing failed." << endl;
+			return -1;
+		}
+		if (!check_partial()) {
+			cerr << "partial request parsing failed." << endl;
+			return -1;
+		}
+		if (!check_errors()) {
+			cerr << "malformed request parsing failed." << endl;
+			return -1;
+		}
+		if (!check_chunked()) {
+			cerr << "chunked body parsing failed." << endl;
+			return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	static const char *request;
+	bool check_parsed(const http_request_parser &p) {
+		return p.method() == "POST" && p.target() == "/path?q=1" &&
+		  p.version() == "HTTP/1.1" && p.version_minor() == 1 &&
+		  p.headers_count() == 3 && p.header_name(0) == "Host" &&
+		  p.header_value(0) == "localhost" &&
+		  p.get_header("content-length") == "4" &&
+		  p.get_header("X-Empty").empty() &&
+		  p.head_size() == string(request).find("body");
+	}
+	bool check_request() {
+		http_request_parser p;
+		string data(request);
+		if (p.parse(data.data(), data.size()) != http_request_parser::complete)
+			return false;
+		if (!check_parsed(p))
+			return false;
+		// the parser is reused for the next request
+		p.reset();
+		data = "\r\nGET / HTTP/1.0\n\n";
+		return p.parse(data.data(), data.size()) ==
+		  http_request_parser::complete && p.method() == "GET" &&
+		  p.version_minor() == 0 && p.head_size() == data.size();
+	}
+	bool check_partial() {
+		// the request is received by one character, and the data is
+		// moved on every call
+		http_request_parser p;
+		string data(request);
+		for (size_t i = 1; i < data.size(); i++) {
+			string part = data.substr(0, i);
+			http_request_parser::result rslt = p.parse(part.data(), part.size());
+			if (rslt == http_request_parser::complete) {
+				if (i != data.find("body"))
+					return false;
+				return check_parsed(p);
+			}
+			if (rslt != http_request_parser::incomplete)
+				return false;
+		}
+		return false;
+	}
+	bool check_error(const string &data, http_error::http_error code,
+	  size_t max_line = 8192) {
+		http_request_parser p(max_line, 256, 4);
+		return p.parse(data.data(), data.size()) == http_request_parser::error &&
+		  p.error_code() == code;
+	}
+	bool check_errors() {
+		return
+		  check_error("GET / HTTP/1.1\r\nBad Header: 1\r\n\r\n",
+		    http_error::bad_request) &&
+		  check_error("GET / HTTP/1.1\r\nHost: a\r\n folded\r\n\r\n",
+		    http_error::bad_request) &&
+		  check_error("GET /\x01 HTTP/1.1\r\n\r\n", http_error::bad_request) &&
+		  check_error("GET / HTTP/2.0\r\n\r\n",
+		    http_error::http_version_not_supported) &&
+		  check_error("GET /" + string(100, 'a') + " HTTP/1.1\r\n\r\n",
+		    http_error::request_uri_too_long, 64) &&
+		  check_error("GET / HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\nD: 4\r\n"
+		    "E: 5\r\n\r\n", http_error::request_header_fields_too_large) &&
+		  check_error("GET / HTTP/1.1\r\nA: " + string(300, 'a') + "\r\n\r\n",
+		    http_error::request_header_fields_too_large);
+	}
+	// decode the body received by the parts of the size given
+	bool decode(const string &body, size_t part, string &rslt) {
+		http_chunked_parser p;
+		string received;
+		rslt.clear();
+		for (size_t i = 0; i < body.size(); i += part) {
+			received += body.substr(i, part);
+			while (!received.empty()) {
+				size_t consumed;
+				string_ref chunk;
+				http_chunked_parser::result r = p.parse(received.data(),
+				  received.size(), consumed, chunk);
+				rslt += chunk.str();
+				received.erase(0, consumed);
+				if (r == http_chunked_parser::complete)
+					return received + body.substr(min(i + part, body.size())) ==
+					  "next";
+				if (r == http_chunked_parser::error)
+					return false;
+				if (consumed == 0)
+					break;
+			}
+		}
+		return false;
+	}
+	bool check_chunked() {
+		const string body = "4\r\nWiki\r\n"
+		  "7;ext=1\r\npedia i\r\n"
+		  "B\r\nn \r\nchunks.\r\n"
+		  "0\r\nTrailer: x\r\n\r\nnext";
+		for (size_t part = 1; part <= body.size(); part++) {
+			string rslt;
+			if (!decode(body, part, rslt) || rslt != "Wikipedia in \r\nchunks.")
+				return false;
+		}
+		string rslt;
+		return !decode("4\r\nWikiX\r\n0\r\n\r\n", 64, rslt) &&
+		  !decode("Z\r\n", 64, rslt) &&
+		  !decode("fffffffffffffffff\r\n", 64, rslt);
+	}
+};
+
+const char *test::request =
+  "POST /path?q=1 HTTP/1.1\r\n"
+  "Host: localhost\r\n"
+  "Content-Length:4  \r\n"
+  "X-Empty: \r\n"
+  "\r\n"
+  "body";
+
+IMPLEMENT_APP(test().app);
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+#include "stopwatch.h"
+
+using namespace std;
+using namespace dbp;
+
+#define RESPONSES 200000
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_status_lines()) {
+			cerr << "status lines failed." << endl;
+			return -1;
+		}
+		if (!check_response()) {
+			cerr << "response writing failed." << endl;
+			return -1;
+		}
+		benchmark();
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	static string str(io_stream &s) {
+		return string(istreambuf_iterator<char>(s), istreambuf_iterator<char>());
+	}
+	bool check_status_lines() {
+		return
+		  http_response_writer::status_line(http_error::ok) ==
+		    "HTTP/1.1 200 OK\r\n" &&
+		  http_response_writer::status_line(http_error::not_found, 0) ==
+		    "HTTP/1.0 404 Not Found\r\n" &&
+		  http_response_writer::status_line(
+		    http_error::request_header_fields_too_large) ==
+		    "HTTP/1.1 431 Request Header Fields Too Large\r\n" &&
+		  http_response_writer::status_line(
+		    http_error::http_version_not_supported) ==
+		    "HTTP/1.1 505 HTTP Version Not Supported\r\n" &&
+		  // the reason phrase of the unknown status is empty
+		  http_response_writer::status_line(http_error::http_error(299)) ==
+		    "HTTP/1.1 299 \r\n";
+	}
+	bool check_response() {
+		http_response resp;
+		resp.set_header("Connection", "keep-alive");
+		resp.set_header("X-Test", "1");
+		resp.set_content("body");
+		io_stream s;
+		http_response_writer::write(s.buffer(), resp, 1,
+		  http_response_writer::close);
+		string r = str(s);
+		// the Date header is IMF-fixdate
+		size_t date = r.find("\r\nDate: ");
+		if (r.find("HTTP/1.1 200 OK\r\n") != 0 || date == string::npos ||
+		  r.compare(date + 8 + 26, 5, "GMT\r\n") != 0 ||
+		  r.find("Connection: keep-alive") != string::npos ||
+		  r.find("\r\nConnection: close\r\n") == string::npos ||
+		  r.find("\r\nContent-Length: 4\r\n") == string::npos ||
+		  r.find("\r\nX-Test: 1\r\n") == string::npos ||
+		  r.compare(r.size() - 8, 8, "\r\n\r\nbody") != 0)
+			return false;
+		// the content is sent by chunks, the Date of the response is kept
+		resp.set_header("Date", "Sun, 06 Nov 1994 08:49:37 GMT");
+		s.reset();
+		http_response_writer::write(s.buffer(), resp, 1,
+		  http_response_writer::chunked);
+		r = str(s);
+		if (r.find("Content-Length") != string::npos ||
+		  r.find("\r\nConnection: keep-alive\r\n") == string::npos ||
+		  r.find("\r\nTransfer-Encoding: chunked\r\n") == string::npos ||
+		  r.find("Date: ") != r.rfind("Date: ") ||
+		  r.compare(r.size() - 4, 4, "\r\n\r\n") != 0)
+			return false;
+		// the response to HEAD keeps the length of the content
+		s.reset();
+		http_response_writer::write(s.buffer(), resp, 1,
+		  http_response_writer::no_content);
+		r = str(s);
+		if (r.find("\r\nContent-Length: 4\r\n") == string::npos ||
+		  r.compare(r.size() - 4, 4, "\r\n\r\n") != 0)
+			return false;
+		// the response having no content has no length
+		resp.set_status(http_error::no_content);
+		s.reset();
+		http_response_writer::write(s.buffer(), resp, 1,
+		  http_response_writer::no_content);
+		r = str(s);
+		return r.find("HTTP/1.1 204 No Content\r\n") == 0 &&
+		  r.find("Content-Length") == string::npos &&
+		  r.compare(r.size() - 4, 4, "\r\n\r\n") == 0;
+	}
+	// the response serialized by the stream operators, as the server
+	// did, and by the writer
+	void benchmark() {
+		http_response resp;
+		resp.set_header("Server", "dcl");
+		resp.set_content("Om namah shivaya");
+		io_stream s;
+		stopwatch timing;
+		for (int i = 0; i < RESPONSES; i++) {
+			resp.set_header("Connection", "keep-alive");
+			s << "HTTP/1.1 " << resp.get_status() << CRLF << resp << flush;
+			s.reset();
+		}
+		double t1 = timing.elapsed();
+		timing.restart();
+		for (int i = 0; i < RESPONSES; i++) {
+			http_response_writer::write(s.buffer(), resp, 1,
+			  http_response_writer::keep_alive);
+			s.reset();
+		}
+		double t2 = timing.elapsed();
+		cout << "stream operators: " << int(RESPONSES * 1000 / t1) <<
+		  " responses/s, writer: " << int(RESPONSES * 1000 / t2) <<
+		  " responses/s" << endl;
+	}
+};
+
+IMPLEMENT_APP(test().app);
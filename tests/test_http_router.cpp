@@ -0,0 +1,173 @@
+#include <iostream>
+#include <string>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+#include "allocations.h"
+#include "stopwatch.h"
+
+using namespace std;
+using namespace dbp;
+
+#define LOOKUPS 1000000
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_routes()) {
+			cerr << "routing failed." << endl;
+			return -1;
+		}
+		if (!check_patterns()) {
+			cerr << "pattern checks failed." << endl;
+			return -1;
+		}
+		if (!benchmark()) {
+			cerr << "route lookup failed or allocated the memory." << endl;
+			return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	http_response on_request(const http_request &req) {
+		http_response resp;
+		string s = req.method().str() + " " + req.get_path_info();
+		for (size_t i = 0; i < req.params_count(); i++)
+			s += " " + req.param_name(i).str() + "=" + req.param_value(i).str();
+		resp.set_content(s);
+		return resp;
+	}
+	http_response on_missing(const http_request&) {
+		http_response resp;
+		resp.set_status(http_error::not_found);
+		resp.set_content("missing");
+		return resp;
+	}
+	static http_request request(http_method::http_method method,
+	  const string &path) {
+		http_request req;
+		req.set_method(method);
+		req.set_path_info(path);
+		return req;
+	}
+	static string content(const http_response &resp) {
+		return string(resp.get_content(), resp.get_content_size());
+	}
+	bool check_routes() {
+		http_router r;
+		http_router::handler h = create_delegate(this, &test::on_request);
+		r.add(http_method::get, "/", h).
+		  add(http_method::get, "/users", h).
+		  add(http_method::post, "/users", h).
+		  add(http_method::get, "/users/new", h).
+		  add(http_method::get, "/users/:id", h).
+		  add(http_method::del, "/users/:id", h).
+		  add(http_method::get, "/users/:id/posts/:post", h).
+		  add(http_method::get, "/user", h).
+		  add(http_method::get, "/static/*file", h).
+		  add(http_method::get, "/files/:dir/*path", h);
+		http_request req = request(http_method::get, "/users/42?full=1");
+		if (content(r.route(req)) != "GET /users/42?full=1 id=42" ||
+		  req.get_param("id") != "42" || !req.get_param("name").empty())
+			return false;
+		// the static segment is preferred to the parameter
+		if (content(r.route(request(http_method::get, "/users/new"))) !=
+		  "GET /users/new" ||
+		  content(r.route(request(http_method::get, "/users/newer"))) !=
+		  "GET /users/newer id=newer" ||
+		  content(r.route(request(http_method::get, "/user"))) !=
+		  "GET /user" ||
+		  content(r.route(request(http_method::post, "/users"))) !=
+		  "POST /users" ||
+		  content(r.route(request(http_method::get, "/"))) != "GET /")
+			return false;
+		if (content(r.route(request(http_method::get,
+		  "/users/7/posts/hello"))) != "GET /users/7/posts/hello id=7 "
+		  "post=hello" ||
+		  content(r.route(request(http_method::get,
+		  "/static/css/site.css"))) != "GET /static/css/site.css "
+		  "file=css/site.css" ||
+		  content(r.route(request(http_method::get, "/static/"))) !=
+		  "GET /static/ file=" ||
+		  content(r.route(request(http_method::get, "/files/a/b/c"))) !=
+		  "GET /files/a/b/c dir=a path=b/c")
+			return false;
+		// the handler of GET handles HEAD
+		if (content(r.route(request(http_method::head, "/users/1"))) !=
+		  "HEAD /users/1 id=1")
+			return false;
+		http_response resp = r.route(request(http_method::put, "/users/1"));
+		if (resp.get_status_code() != http_error::method_not_allowed ||
+		  resp.get_header("Allow") != "GET, DELETE, HEAD")
+			return false;
+		if (r.route(request(http_method::get, "/users/1/posts")).
+		  get_status_code() != http_error::not_found ||
+		  r.route(request(http_method::get, "/users/")).get_status_code() !=
+		  http_error::not_found ||
+		  r.route(request(http_method::get, "/other")).get_status_code() !=
+		  http_error::not_found)
+			return false;
+		r.not_found(create_delegate(this, &test::on_missing));
+		return content(r.route(request(http_method::get, "/other"))) ==
+		  "missing";
+	}
+	bool check_patterns() {
+		http_router r;
+		http_router::handler h = create_delegate(this, &test::on_request);
+		const char *invalid[] = { "", "users", "/users/:", "/static/*file/x",
+		  "/users/:name", "/a/:1/:2/:3/:4/:5/:6/:7/:8/:9" };
+		r.add(http_method::get, "/users/:id", h);
+		for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+			try {
+				r.add(http_method::get, invalid[i], h);
+				return false;
+			}
+			catch (http_router_exception&) { }
+		}
+		return true;
+	}
+	// the time of the lookups done by the router of the routes given
+	double lookups(size_t routes, size_t &allocated) {
+		http_router r;
+		http_router::handler h = create_delegate(this, &test::on_request);
+		for (size_t i = 0; i < routes; i++) {
+			string res = "/api/v1/resource" + to_string<size_t>(i);
+			r.add(http_method::get, res, h);
+			r.add(http_method::get, res + "/:id", h);
+			r.add(http_method::put, res + "/:id", h);
+			r.add(http_method::get, res + "/:id/items/*rest", h);
+		}
+		http_request req[4];
+		for (size_t i = 0; i < 4; i++) {
+			req[i].set_method(http_method::get);
+			req[i].set_path_info("/api/v1/resource" +
+			  to_string<size_t>(routes * i / 4) + "/12345/items/a/b");
+		}
+		size_t start = allocations();
+		size_t found = 0;
+		stopwatch timing;
+		for (size_t i = 0; i < LOOKUPS; i++)
+			found += r.find(req[i % 4], h) == http_error::ok;
+		double rslt = timing.elapsed();
+		allocated = allocations() - start;
+		return found == LOOKUPS ? rslt : -1;
+	}
+	bool benchmark() {
+		size_t allocated_few, allocated_many;
+		double few = lookups(10, allocated_few);
+		double many = lookups(500, allocated_many);
+		cout << "route lookup: 40 routes " << few << " ms, 2000 routes " <<
+		  many << " ms (" << LOOKUPS << " lookups, " <<
+		  allocated_few + allocated_many << " allocations)" << endl;
+		return few >= 0 && many >= 0 && allocated_few == 0 &&
+		  allocated_many == 0;
+	}
+};
+
+IMPLEMENT_APP(test().app);
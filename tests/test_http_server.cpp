@@ -1,73 +1,411 @@
+#include <stdlib.h>
 #include <string>
 #include <iostream>
+#include <sched.h>
+#include <unistd.h>
+#include <vector>
 
 #include <dcl/dclbase.h>
 #include <dcl/dclnet.h>
 
-#ifdef _WIN32
-#include <windows.h>
-void sleep(int t) {
-	Sleep(t * 1000);
-}
-#endif
+#include "loopback.h"
 
 using namespace std;
 using namespace dbp;
 
+// The size of the response the client does not read at once
+#define BIG_SIZE 65536
+// The number of the requests pipelined
+#define PIPELINED 16
+
 class test {
 public:
-	test(): app(application::instance()) {
+	test(): app(application::instance()), completer(NULL), completing(0),
+	  parts(0) {
 		app.on_execute(create_delegate(this, &test::on_execute));
-		srv.on_request(create_delegate(this, &test::on_request));
-		srv.on_connect(create_delegate(this, &test::on_connect));
-		srv.on_disconnect(create_delegate(this, &test::on_disconnect));
+		router.add(http_method::get, "/hello", create_delegate(this,
+		  &test::on_hello));
+		router.add(http_method::get, "/empty", create_delegate(this,
+		  &test::on_empty));
+		router.add(http_method::get, "/big", create_delegate(this,
+		  &test::on_big));
+		router.add(http_method::post, "/echo", create_delegate(this,
+		  &test::on_echo));
+		router.add(http_method::get, "/stream", create_delegate(this,
+		  &test::on_stream));
+		srv.on_request(create_delegate(&router, &http_router::route));
 		srv.on_exception(create_delegate(this, &test::on_exception));
-		srv.on_create_io_handler(create_delegate(this,
-		  &test::on_create_io_handler));
 	}
 	// the link to the console application class
 	application &app;
 private:
+	http_router router;
 	http_server srv;
+	int port;
+	// the responses the deferred handler parked
+	mutex parked_lock;
+	vector<http_server::deferred_response> parked;
+	// the thread completing the responses while the connection is closed
+	thread *completer;
+	int completing;
+	// the number of the parts of the content left to produce
+	int parts;
 	int on_execute() {
-/*		srv.start(":8000;localhost:8443");
-		//TODO make the tests
-		sleep(500);
-		srv.stop();*/
-		return 0;
-	}
-	dbp::socket* on_create_io_handler(const dbp::socket &ls,
-	  const dbp::socket &ws) {
-		// is it SSL connection?
-		if (ls.port() == 8443) {
-			ssl_socket *s = new ssl_socket(ws);
-			s->load_certificates(
-			  nullstr,
-			  "/home/dennis/development/libdcl-0.1.0/examples/web_server/cert.pem",
-			  "/home/dennis/development/libdcl-0.1.0/examples/web_server/pkey.pem",
-			  nullstr);
-			return s;
-		}
-		// no, it's simple connection type
-		return new dbp::socket(ws);
+		port = free_port();
+		srv.start("127.0.0.1:" + to_string<int>(port));
+		int rslt = 0;
+		if (!check_head()) {
+			cerr << "HEAD request failed." << endl;
+			rslt = -1;
+		}
+		if (!check_no_content()) {
+			cerr << "no content response failed." << endl;
+			rslt = -1;
+		}
+		if (!check_chunked()) {
+			cerr << "chunked transfer coding failed." << endl;
+			rslt = -1;
+		}
+		if (!check_half_close()) {
+			cerr << "answering of the half-closed connection failed." << endl;
+			rslt = -1;
+		}
+		if (!check_split()) {
+			cerr << "receiving of the requests by parts failed." << endl;
+			rslt = -1;
+		}
+		srv.stop();
+		if (!check_timeouts()) {
+			cerr << "closing of the idle connections failed." << endl;
+			rslt = -1;
+		}
+		if (!check_admission()) {
+			cerr << "rejecting of the connections on overload failed." << endl;
+			rslt = -1;
+		}
+		if (!check_high_water()) {
+			cerr << "throttling of the pipelined requests failed." << endl;
+			rslt = -1;
+		}
+		if (!check_deferred()) {
+			cerr << "deferred response failed." << endl;
+			rslt = -1;
+		}
+		if (!check_stop_parked()) {
+			cerr << "stopping with the response parked failed." << endl;
+			rslt = -1;
+		}
+		return rslt;
 	}
 	void on_exception(const dbp::exception &e) {
 		cout << "exception: " << e.what() << endl;
 	}
-	void on_connect(const dbp::socket &s, std::istream&, std::ostream&) {
-		cout << "connecting from: " << s.address() << endl;
+	http_response on_hello(const http_request&) {
+		http_response resp;
+		resp.set_content("hello world");
+		return resp;
 	}
-	void on_disconnect(dbp::socket &s) {
-		cout << "disconnecting from: " << s.address() << endl;
+	http_response on_empty(const http_request&) {
+		http_response resp;
+		resp.set_status(http_error::no_content);
+		return resp;
+	}
+	http_response on_big(const http_request&) {
+		http_response resp;
+		resp.set_content(string(BIG_SIZE, 'x'));
+		return resp;
+	}
+	http_response on_echo(const http_request &req) {
+		http_response resp;
+		resp.set_content(req.get_content_size(), req.get_content());
+		return resp;
 	}
-	http_response on_request(const http_request &req) {
+	http_response on_stream(const http_request&) {
 		http_response resp;
-		resp.set_header("Server", "dbPager Classes Library");
-		resp.set_header("Connection", "close");
-		resp.set_content("Om namah shivaya");
+		parts = 3;
+		resp.set_content(http_response::content_producer(this,
+		  &test::produce));
 		return resp;
 	}
+	bool produce(std::ostream &out) {
+		out << "part" << parts;
+		return --parts > 0;
+	}
+	void on_deferred(const http_request&,
+	  http_server::deferred_response resp) {
+		mutex_guard g(parked_lock);
+		parked.push_back(resp);
+	}
+	// complete the responses parked, as the backend does
+	void on_complete(thread_int&) {
+		__atomic_store_n(&completing, 1, __ATOMIC_RELEASE);
+		vector<http_server::deferred_response> ready;
+		parked_lock.enter();
+		ready.swap(parked);
+		parked_lock.leave();
+		http_response resp;
+		resp.set_content("deferred");
+		for (size_t i = 0; i < ready.size(); i++)
+			ready[i].complete(resp);
+	}
+	// the connection parked is closed by the server stopped, while the
+	// response is completed
+	void on_disconnect(dbp::socket&) {
+		if (!completer)
+			return;
+		__atomic_store_n(&completing, 0, __ATOMIC_RELEASE);
+		completer->start();
+		while (!__atomic_load_n(&completing, __ATOMIC_ACQUIRE))
+			sched_yield();
+	}
+	// wait for the handler parks the response
+	bool wait_parked() {
+		for (int i = 0; i < 500; i++) {
+			parked_lock.enter();
+			bool rslt = !parked.empty();
+			parked_lock.leave();
+			if (rslt)
+				return true;
+			usleep(10000);
+		}
+		return false;
+	}
+	// start the server on the port of the loopback interface free
+	static int start(http_server &s) {
+		int p = free_port();
+		s.start("127.0.0.1:" + to_string<int>(p));
+		return p;
+	}
+	// the responses received up to the connection close
+	string exchange(const string &requests) {
+		loopback_client c(port);
+		if (!c.send(requests))
+			return string();
+		return c.receive();
+	}
+	// the head of the response starting at the position given
+	static string head(const string &s, size_t pos = 0) {
+		size_t end = s.find("\r\n\r\n", pos);
+		return end == string::npos ? string() :
+		  s.substr(pos, end + 4 - pos);
+	}
+	// the content of the chunked response starting at the position given
+	static bool dechunk(const string &s, size_t pos, string &rslt) {
+		while (pos < s.size()) {
+			size_t end = s.find("\r\n", pos);
+			if (end == string::npos)
+				return false;
+			size_t size = strtoul(s.substr(pos, end - pos).c_str(), NULL, 16);
+			pos = end + 2;
+			if (size == 0)
+				return s.compare(pos, string::npos, "\r\n") == 0;
+			rslt.append(s, pos, size);
+			pos += size + 2;
+		}
+		return false;
+	}
+	// the response to HEAD has the headers of the response to GET, but
+	// no content, so the pipelined response follows the head
+	bool check_head() {
+		string s = exchange(
+		  "HEAD /hello HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		  "GET /hello HTTP/1.1\r\nHost: localhost\r\n"
+		  "Connection: close\r\n\r\n");
+		string h1 = head(s);
+		string h2 = head(s, h1.size());
+		return !h1.empty() && h1.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  h1.find("\r\nContent-Length: 11\r\n") != string::npos &&
+		  h2.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  h2.find("\r\nContent-Length: 11\r\n") != string::npos &&
+		  s.size() == h1.size() + h2.size() + 11 &&
+		  s.compare(s.size() - 11, 11, "hello world") == 0;
+	}
+	// so does the response of the status having no content
+	bool check_no_content() {
+		string s = exchange(
+		  "GET /empty HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		  "GET /hello HTTP/1.1\r\nHost: localhost\r\n"
+		  "Connection: close\r\n\r\n");
+		string h1 = head(s);
+		string h2 = head(s, h1.size());
+		return h1.find("HTTP/1.1 204 No Content\r\n") == 0 &&
+		  h1.find("Content-Length") == string::npos &&
+		  h2.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  s.size() == h1.size() + h2.size() + 11;
+	}
+	// the request content is received by the chunks, the response
+	// produced by parts is sent by the chunks
+	bool check_chunked() {
+		string s = exchange(
+		  "POST /echo HTTP/1.1\r\nHost: localhost\r\n"
+		  "Transfer-Encoding: chunked\r\n\r\n"
+		  "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n"
+		  "GET /stream HTTP/1.1\r\nHost: localhost\r\n"
+		  "Connection: close\r\n\r\n");
+		string h1 = head(s);
+		string h2 = head(s, h1.size() + 11);
+		string content;
+		return h1.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  h1.find("\r\nContent-Length: 11\r\n") != string::npos &&
+		  s.compare(h1.size(), 11, "hello world") == 0 &&
+		  h2.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  h2.find("\r\nTransfer-Encoding: chunked\r\n") != string::npos &&
+		  dechunk(s, h1.size() + 11 + h2.size(), content) &&
+		  content == "part3part2part1";
+	}
+	// the requests received with the end of the input are answered
+	// before the connection is closed
+	bool check_half_close() {
+		loopback_client c(port);
+		c.send("GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		  "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n");
+		c.close_output();
+		string s = c.receive();
+		string h1 = head(s);
+		string h2 = head(s, h1.size() + 11);
+		return c.is_closed() && h1.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  h2.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  s.size() == h1.size() + h2.size() + 22 &&
+		  s.compare(s.size() - 11, 11, "hello world") == 0;
+	}
+	// the requests of the connections received by parts interleaved are
+	// parsed by the state of each connection
+	bool check_split() {
+		string r[2];
+		for (int i = 0; i < 2; i++) {
+			r[i] = "POST /echo HTTP/1.1\r\nHost: localhost\r\n"
+			  "Content-Length: 7\r\nConnection: close\r\n\r\nfrom ";
+			r[i] += char('a' + i);
+			r[i] += "!";
+		}
+		loopback_client a(port), b(port);
+		loopback_client *c[2] = { &a, &b };
+		for (size_t pos = 0; pos < r[0].size(); pos += 7) {
+			for (int i = 0; i < 2; i++) {
+				c[i]->send(r[i].substr(pos, 7));
+				usleep(10000);
+			}
+		}
+		for (int i = 0; i < 2; i++) {
+			string s = c[i]->receive();
+			string h = head(s);
+			if (h.find("HTTP/1.1 200 OK\r\n") != 0 ||
+			  s.substr(h.size()) != r[i].substr(r[i].size() - 7))
+				return false;
+		}
+		return true;
+	}
+	// the idle connection and the connection receiving the request too
+	// long are closed, the connection answered is kept until idle
+	bool check_timeouts() {
+		http_server d;
+		d.on_request(create_delegate(&router, &http_router::route));
+		d.timeout(1).read_timeout(1);
+		int p = start(d);
+		loopback_client idle(p), slow(p), active(p);
+		slow.send("GET /hello HTTP/1.1\r\nHost: local");
+		active.send("GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n");
+		string s = active.receive();
+		bool rslt = idle.is_closed() && slow.is_closed() &&
+		  active.is_closed() && s.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  s.compare(s.size() - 11, 11, "hello world") == 0;
+		d.stop();
+		return rslt;
+	}
+	// the connections over the queue size are answered by the overload
+	// response and closed, the ones admitted are served
+	bool check_admission() {
+		http_server d(1, 1);
+		d.on_request(create_delegate(&router, &http_router::route));
+		d.admission(tcp_server::reject_connections);
+		int p = start(d);
+		loopback_client c1(p), c2(p), c3(p);
+		string s = c3.receive();
+		bool rslt = s.find("HTTP/1.1 503 Service Unavailable\r\n") == 0 &&
+		  c3.is_closed();
+		c1.send("GET /hello HTTP/1.1\r\nHost: localhost\r\n"
+		  "Connection: close\r\n\r\n");
+		s = c1.receive();
+		rslt = rslt && s.find("HTTP/1.1 200 OK\r\n") == 0;
+		d.stop();
+		return rslt;
+	}
+	// the requests pipelined by the client not reading the responses are
+	// read when the output is sent, and all of them are answered
+	bool check_high_water() {
+		http_server d;
+		d.on_request(create_delegate(&router, &http_router::route));
+		d.write_high_water(4096);
+		int p = start(d);
+		loopback_client c(p);
+		string requests;
+		for (int i = 1; i < PIPELINED; i++)
+			requests += "GET /big HTTP/1.1\r\nHost: localhost\r\n\r\n";
+		requests += "GET /big HTTP/1.1\r\nHost: localhost\r\n"
+		  "Connection: close\r\n\r\n";
+		c.send(requests);
+		// the output is piled up, so the server stops reading
+		usleep(200000);
+		string s = c.receive();
+		d.stop();
+		size_t pos = 0;
+		int count = 0;
+		while (pos < s.size()) {
+			string h = head(s, pos);
+			if (h.find("HTTP/1.1 200 OK\r\n") != 0 ||
+			  h.find("\r\nContent-Length: " + to_string<int>(BIG_SIZE) +
+			  "\r\n") == string::npos)
+				return false;
+			pos += h.size() + BIG_SIZE;
+			count++;
+		}
+		return count == PIPELINED && pos == s.size();
+	}
+	// the response completed by the other thread is sent
+	bool check_deferred() {
+		http_server d;
+		d.on_deferred_request(create_delegate(this, &test::on_deferred));
+		int p = start(d);
+		loopback_client c(p);
+		// the client waits for the response with its side closed
+		c.send("GET /slow HTTP/1.1\r\nHost: localhost\r\n\r\n");
+		c.close_output();
+		bool rslt = wait_parked();
+		thread t;
+		t.on_execute(create_delegate(this, &test::on_complete));
+		t.start();
+		t.wait_for();
+		string s = c.receive();
+		d.stop();
+		return rslt && s.find("HTTP/1.1 200 OK\r\n") == 0 &&
+		  s.size() > 8 && s.compare(s.size() - 8, 8, "deferred") == 0;
+	}
+	// the server is stopped while the response parked is completed by
+	// the other thread, or is never completed
+	bool check_stop_parked() {
+		for (int i = 0; i < 20; i++) {
+			http_server d;
+			d.on_deferred_request(create_delegate(this, &test::on_deferred));
+			d.on_disconnect(create_delegate(this, &test::on_disconnect));
+			int p = start(d);
+			loopback_client c(p);
+			c.send("GET /slow HTTP/1.1\r\nHost: localhost\r\n\r\n");
+			if (!wait_parked())
+				return false;
+			thread t;
+			t.on_execute(create_delegate(this, &test::on_complete));
+			completer = i % 2 == 0 ? &t : NULL;
+			d.stop();
+			if (completer)
+				t.wait_for();
+			completer = NULL;
+			// the response completed after the stop is dropped
+			on_complete(t);
+			if (!c.is_closed())
+				return false;
+		}
+		return true;
+	}
 };
 
 IMPLEMENT_APP(test().app);
-
@@ -0,0 +1,152 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <stdio.h>
+
+#include <dcl/dclbase.h>
+
+using namespace std;
+using namespace dbp;
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_buffer()) {
+			cerr << "io_buffer test failed." << endl;
+			return -1;
+		}
+		if (!check_stream()) {
+			cerr << "io_stream test failed." << endl;
+			return -1;
+		}
+		if (!check_file()) {
+			cerr << "io_file test failed." << endl;
+			return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	string contents(const io_buffer &buf) {
+		string rslt;
+		io_vector v[64];
+		int n = buf.segments(64, v);
+		for (int i = 0; i < n; i++)
+			rslt.append(v[i].data, v[i].size);
+		return rslt;
+	}
+	bool check_buffer() {
+		io_buffer buf;
+		if (!buf.empty())
+			return false;
+		// the data spans several slabs
+		string data;
+		for (size_t i = 0; i < io_buffer::slab_size * 3; i++)
+			data += char('a' + i % 26);
+		buf.append(data.data(), data.size());
+		if (buf.size() != data.size() || contents(buf) != data)
+			return false;
+		// the copy shares the data, but is written independently
+		io_buffer copy(buf);
+		copy.append("tail", 4);
+		buf.consume(io_buffer::slab_size + 10);
+		if (contents(buf) != data.substr(io_buffer::slab_size + 10))
+			return false;
+		if (contents(copy) != data + "tail")
+			return false;
+		// the part spanning the slabs is shared as well
+		io_buffer part;
+		part.append(copy, io_buffer::slab_size - 5, io_buffer::slab_size + 10);
+		part.append("!", 1);
+		if (contents(part) != data.substr(io_buffer::slab_size - 5,
+		  io_buffer::slab_size + 10) + "!" || contents(copy) != data + "tail")
+			return false;
+		// the direct write into the free space
+		size_t size;
+		char *p = buf.prepare(size);
+		if (size == 0)
+			return false;
+		p[0] = '!';
+		buf.commit(1);
+		if (contents(buf) != data.substr(io_buffer::slab_size + 10) + "!")
+			return false;
+		// the data spanning the slabs is moved into the single block
+		buf.consume(buf.size());
+		buf.append(data.data(), data.size());
+		char *p1 = buf.pullup(10, io_buffer::slab_size);
+		if (!p1 || string(p1, io_buffer::slab_size) !=
+		  data.substr(10, io_buffer::slab_size) || contents(buf) != data)
+			return false;
+		buf.consume(buf.size());
+		return buf.empty() && contents(buf).empty();
+	}
+	bool check_stream() {
+		io_stream s;
+		s << "first line" << endl << "second";
+		// the partial line is returned back into the stream
+		string line;
+		getline(s, line);
+		if (line != "first line")
+			return false;
+		int pos = s.tellg();
+		getline(s, line);
+		if (!s.eof())
+			return false;
+		s.clear();
+		s.seekg(pos);
+		s.compact();
+		// the rest of the line is received
+		s.buffer().append(" line\n", 6);
+		getline(s, line);
+		if (line != "second line")
+			return false;
+		s.compact();
+		return s.buffer().empty();
+	}
+	bool check_file() {
+		string name = filefs().get_temp_dir() + "/test_io_buffer.tmp";
+		{
+			ofstream f(name.c_str());
+			f << "0123456789";
+		}
+		io_file file(name);
+		remove(name.c_str());
+		if (file.size() != 10)
+			return false;
+		// the file region is between the memory blocks
+		io_buffer buf;
+		buf.append("head", 4);
+		buf.append(file, 2, 6);
+		buf.append("tail", 4);
+		if (buf.size() != 14 || contents(buf) != "head")
+			return false;
+		io_file f;
+		uint64_t offset;
+		size_t size;
+		if (buf.file_region(f, offset, size))
+			return false;
+		buf.consume(6);
+		if (!buf.file_region(f, offset, size) || offset != 4 || size != 4)
+			return false;
+		char data[4];
+		if (f.read(offset, size, data) != 4 || string(data, 4) != "4567")
+			return false;
+		buf.consume(4);
+		if (buf.file_region(f, offset, size) || contents(buf) != "tail")
+			return false;
+		// the missing file is reported
+		try {
+			io_file missing(name);
+			return false;
+		}
+		catch (io_buffer_exception&) {
+		}
+		return true;
+	}
+};
+
+IMPLEMENT_APP(test().app);
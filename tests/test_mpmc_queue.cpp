@@ -0,0 +1,131 @@
+#include <iostream>
+#include <queue>
+#include <vector>
+#include <sched.h>
+
+#include <dcl/dclbase.h>
+
+#include "stopwatch.h"
+
+using namespace std;
+using namespace dbp;
+
+#define THREAD_COUNT 4
+#define ITEMS_PER_THREAD 200000
+#define QUEUE_SIZE 1024
+
+// The mutex protected queue to compare with
+class locked_queue {
+public:
+	bool push(size_t value) {
+		mutex_guard m(lock);
+		if (q.size() >= QUEUE_SIZE)
+			return false;
+		q.push(value);
+		return true;
+	}
+	bool pop(size_t &value) {
+		mutex_guard m(lock);
+		if (q.empty())
+			return false;
+		value = q.front();
+		q.pop();
+		return true;
+	}
+private:
+	mutex lock;
+	std::queue<size_t> q;
+};
+
+template <class Q>
+class contention {
+public:
+	contention(Q &queue): q(queue), sum(0), count(0) { }
+	// returns the time elapsed in milliseconds
+	double run() {
+		vector<thread*> threads;
+		stopwatch timing;
+		for (int i = 0; i < THREAD_COUNT * 2; i++) {
+			thread *t = new thread();
+			if (i % 2)
+				t->on_execute(create_delegate(this, &contention::producer));
+			else
+				t->on_execute(create_delegate(this, &contention::consumer));
+			threads.push_back(t);
+			t->start();
+		}
+		for (size_t i = 0; i < threads.size(); i++) {
+			threads[i]->wait_for();
+			delete threads[i];
+		}
+		return timing.elapsed();
+	}
+	bool check() {
+		size_t n = size_t(THREAD_COUNT) * ITEMS_PER_THREAD;
+		return count == n && sum == n * (n + 1) / 2;
+	}
+	void producer(thread_int&) {
+		for (size_t i = 0; i < ITEMS_PER_THREAD; i++) {
+			size_t value = __sync_add_and_fetch(&next, 1);
+			while (!q.push(value))
+				sched_yield();
+		}
+	}
+	void consumer(thread_int&) {
+		size_t value;
+		while (__sync_fetch_and_add(&count, 0) <
+		  size_t(THREAD_COUNT) * ITEMS_PER_THREAD) {
+			if (q.pop(value)) {
+				__sync_add_and_fetch(&sum, value);
+				__sync_add_and_fetch(&count, 1);
+			} else
+				sched_yield();
+		}
+	}
+private:
+	Q &q;
+	static size_t next;
+	size_t sum, count;
+};
+
+template <class Q> size_t contention<Q>::next = 0;
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		// single thread: FIFO order and bounds
+		mpmc_queue<int> q(3);
+		if (q.capacity() != 4 || !q.empty())
+			return -1;
+		for (int i = 0; i < 4; i++) {
+			if (!q.push(i))
+				return -1;
+		}
+		if (q.push(4))
+			return -1;
+		for (int i = 0; i < 4; i++) {
+			int value;
+			if (!q.pop(value) || value != i)
+				return -1;
+		}
+		if (!q.empty())
+			return -1;
+		// multiple producers and consumers
+		mpmc_queue<size_t> lockfree(QUEUE_SIZE);
+		contention<mpmc_queue<size_t> > c1(lockfree);
+		double t1 = c1.run();
+		locked_queue locked;
+		contention<locked_queue> c2(locked);
+		double t2 = c2.run();
+		cout << "lock-free queue: " << t1 << " ms, "
+		  "mutex protected queue: " << t2 << " ms" << endl;
+		return c1.check() && c2.check() ? 0 : -1;
+	};
+	// the link to the console application class
+	application &app;
+};
+
+IMPLEMENT_APP(test().app);
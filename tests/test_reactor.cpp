@@ -0,0 +1,74 @@
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+using namespace std;
+using namespace dbp;
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check(reactor::select_backend, "select"))
+			return -1;
+		if (!check(reactor::default_backend, "default"))
+			return -1;
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	bool check(reactor::backend type, const string &name) {
+		int fds[2];
+		if (::pipe(fds) < 0)
+			return false;
+		fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+		bool rslt = true;
+		{
+			reactor r(type);
+			reactor_events e;
+			r.add(fds[0], reactor::read, &fds[0]);
+			// 1. no events on the idle handle
+			r.wait(0, e);
+			rslt = rslt && e.empty();
+			// 2. the data is arrived
+			if (::write(fds[1], "abc", 3) != 3)
+				rslt = false;
+			r.wait(1000, e);
+			rslt = rslt && e.size() == 1 && e[0].data == &fds[0] &&
+			  (e[0].events & reactor::read);
+			if (!rslt)
+				cerr << name << ": read event expected." << endl;
+			// 3. drain the handle; no more events until new data arrives
+			char buf[16];
+			while (::read(fds[0], buf, sizeof(buf)) > 0) { }
+			r.rearm(fds[0], reactor::read);
+			r.wait(0, e);
+			rslt = rslt && e.empty();
+			if (!rslt)
+				cerr << name << ": no events expected on drained handle." << endl;
+			// 4. interrupt the waiting
+			r.interrupt();
+			r.wait(1000, e);
+			rslt = rslt && e.empty();
+			// 5. unregistered handle is not watched
+			r.remove(fds[0]);
+			if (::write(fds[1], "abc", 3) != 3)
+				rslt = false;
+			r.wait(0, e);
+			rslt = rslt && e.empty();
+			if (!rslt)
+				cerr << name << ": no events expected on removed handle." << endl;
+		}
+		::close(fds[0]);
+		::close(fds[1]);
+		return rslt;
+	}
+};
+
+IMPLEMENT_APP(test().app);
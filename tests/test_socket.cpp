@@ -0,0 +1,141 @@
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+using namespace std;
+using namespace dbp;
+
+// The socket of the descriptor given
+class fd_socket: public dbp::socket {
+public:
+	fd_socket(int fd) {
+		socket_fd = fd;
+	}
+};
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_vectors()) {
+			cerr << "scatter/gather input/output failed." << endl;
+			return -1;
+		}
+		if (!check_zerocopy()) {
+			cerr << "zero-copy output failed." << endl;
+			return -1;
+		}
+		if (!check_datagrams()) {
+			cerr << "batched datagrams failed." << endl;
+			return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	static io_vector vector(const char *data, size_t size) {
+		io_vector v;
+		v.data = const_cast<char*>(data);
+		v.size = size;
+		return v;
+	}
+	static void wait(const dbp::socket &s) {
+		struct pollfd p;
+		p.fd = s.handle();
+		p.events = POLLIN;
+		poll(&p, 1, 1000);
+	}
+	bool check_vectors() {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+			return false;
+		fd_socket a(fds[0]), b(fds[1]);
+		// the header and the body are written by the single call
+		io_vector out[] = { vector("HTTP/1.1 200 OK\r\n", 17),
+		  vector("\r\n", 2), vector("body", 4) };
+		if (a.writev(3, out) != 23)
+			return false;
+		// and read into the separate buffers
+		char head[19], body[10];
+		io_vector in[] = { vector(head, sizeof(head)),
+		  vector(body, sizeof(body)) };
+		return b.readv(2, in) == 23 &&
+		  string(head, sizeof(head)) == "HTTP/1.1 200 OK\r\n\r\n" &&
+		  string(body, 4) == "body";
+	}
+	bool check_zerocopy() {
+		tcp_socket l;
+		l.bind(socket_address("127.0.0.1:0"));
+		l.listen();
+		tcp_socket c;
+		if (!c.connect("127.0.0.1", l.port()))
+			return false;
+		wait(l);
+		dbp::socket s = l.accept();
+		// the zero-copy output may be not supported by the kernel
+		if (!c.zerocopy(true))
+			cout << "zero-copy output is not supported" << endl;
+		string data(65536, 'z');
+		io_vector v = vector(data.data(), data.size());
+		int written = c.writev_zerocopy(1, &v);
+		uint32_t sent = c.zerocopy_sent();
+		string received;
+		char buf[16384];
+		while (written > 0 && received.size() < size_t(written)) {
+			wait(s);
+			int size = s.read(sizeof(buf), buf);
+			if (size <= 0 && size != dbp::socket::data_not_ready)
+				return false;
+			if (size > 0)
+				received.append(buf, size);
+		}
+		if (written <= 0 || received != data.substr(0, written))
+			return false;
+		// the memory is released by the kernel
+		for (int i = 0; i < 100 && c.zerocopy_completed() != sent; i++)
+			usleep(10000);
+		cout << "zero-copy writes: " << sent << ", completed: " <<
+		  c.zerocopy_completed() << endl;
+		return c.zerocopy_completed() == sent;
+	}
+	bool check_datagrams() {
+		udp_socket a, b;
+		a.bind(socket_address("127.0.0.1:0"));
+		b.bind(socket_address("127.0.0.1:0"));
+		// the port of the socket connected is the port of the peer
+		int port_a = a.port(), port_b = b.port();
+		if (!a.connect("127.0.0.1", port_b) ||
+		  !b.connect("127.0.0.1", port_a))
+			return false;
+		io_vector out[] = { vector("one", 3), vector("two", 3),
+		  vector("three", 5) };
+		if (a.write_datagrams(3, out) != 3)
+			return false;
+		wait(b);
+		char bufs[8][16];
+		udp_socket::datagram in[8];
+		for (int i = 0; i < 8; i++)
+			in[i].data = vector(bufs[i], sizeof(bufs[i]));
+		int count = 0;
+		while (count < 3) {
+			int rslt = b.read_datagrams(8 - count, in + count);
+			if (rslt <= 0)
+				return false;
+			count += rslt;
+		}
+		return string(bufs[0], in[0].size) == "one" &&
+		  string(bufs[1], in[1].size) == "two" &&
+		  string(bufs[2], in[2].size) == "three" &&
+		  b.read_datagrams(8, in) == dbp::socket::data_not_ready;
+	}
+};
+
+IMPLEMENT_APP(test().app);
@@ -0,0 +1,166 @@
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+using namespace std;
+using namespace dbp;
+
+// The socket counting the system calls
+class counting_socket: public dbp::socket {
+public:
+	counting_socket(int fd): reads(0), writes(0) {
+		socket_fd = fd;
+	}
+	virtual int read(int bytes_to_read, char *buffer) {
+		reads++;
+		return socket::read(bytes_to_read, buffer);
+	}
+	virtual int write(int bytes_to_write, const char *buffer) {
+		writes++;
+		return socket::write(bytes_to_write, buffer);
+	}
+	virtual int writev(int count, const io_vector *vectors) {
+		writes++;
+		return socket::writev(count, vectors);
+	}
+	size_t reads, writes;
+};
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		if (!check_output()) {
+			cerr << "buffered output failed." << endl;
+			return -1;
+		}
+		if (!check_input()) {
+			cerr << "buffered input failed." << endl;
+			return -1;
+		}
+		if (!check_non_blocking()) {
+			cerr << "non-blocking socket stream failed." << endl;
+			return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	// receive the data of the size given from the peer
+	static string receive(int fd, size_t size) {
+		string rslt;
+		char buf[65536];
+		while (rslt.size() < size) {
+			ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+			if (n <= 0)
+				break;
+			rslt.append(buf, n);
+		}
+		return rslt;
+	}
+	bool check_output() {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+			return false;
+		counting_socket s(fds[0]);
+		string expected;
+		{
+			socket_stream buf(s);
+			ostream out(&buf);
+			// the small writes are sent by the single call
+			for (int i = 0; i < 100; i++) {
+				out << "line " << i << "\n";
+				expected += "line " + to_string<int>(i) + "\n";
+			}
+			out.flush();
+			if (s.writes != 1 || receive(fds[1], expected.size()) != expected)
+				return false;
+			// the large block is sent directly, with the data buffered
+			out << "head";
+			out << string(100000, 'x');
+			if (s.writes != 2 || !out)
+				return false;
+			if (receive(fds[1], 100004) != "head" + string(100000, 'x'))
+				return false;
+			// the data buffered is sent by the destructor
+			out << "tail";
+		}
+		bool rslt = s.writes == 3 && receive(fds[1], 4) == "tail";
+		close(fds[1]);
+		return rslt;
+	}
+	bool check_input() {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+			return false;
+		counting_socket s(fds[0]);
+		socket_stream buf(s);
+		std::iostream io(&buf);
+		string data = "hello\nworld\n" + string(50000, 'y');
+		::send(fds[1], data.data(), data.size(), 0);
+		string line;
+		getline(io, line);
+		if (line != "hello" || !getline(io, line) || line != "world")
+			return false;
+		// the large block is read directly
+		string block(50000, '\0');
+		size_t reads = s.reads;
+		io.read(&block[0], block.size());
+		if (!io || block != string(50000, 'y') || s.reads - reads > 5)
+			return false;
+		io.unget();
+		if (io.get() != 'y')
+			return false;
+		// the request is sent before the reply is waited for
+		::send(fds[1], "pong\n", 5, 0);
+		io << "ping";
+		if (!getline(io, line) || line != "pong" ||
+		  receive(fds[1], 4) != "ping")
+			return false;
+		// the client closes the connection
+		close(fds[1]);
+		return !getline(io, line) && io.eof();
+	}
+	bool check_non_blocking() {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+			return false;
+		const size_t size = 4 * 1024 * 1024;
+		pid_t pid = fork();
+		if (pid < 0)
+			return false;
+		if (pid == 0) {
+			// the peer receives the data and sends it back
+			close(fds[0]);
+			string data = receive(fds[1], size);
+			::send(fds[1], data.data(), data.size(), 0);
+			_exit(data.size() == size ? 0 : 1);
+		}
+		close(fds[1]);
+		fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+		counting_socket s(fds[0]);
+		socket_stream buf(s, 1500, 8, 0);
+		std::iostream io(&buf);
+		string data(size, 'z');
+		// the unbuffered stream sends the block directly
+		io.write(data.data(), data.size());
+		io.flush();
+		string back(size, '\0');
+		io.read(&back[0], back.size());
+		int status = 0;
+		waitpid(pid, &status, 0);
+		return io && back == data && WIFEXITED(status) &&
+		  WEXITSTATUS(status) == 0;
+	}
+};
+
+IMPLEMENT_APP(test().app);
@@ -0,0 +1,79 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <dcl/dclbase.h>
+#include <dcl/dclnet.h>
+
+using namespace std;
+using namespace dbp;
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		const char *srcdir = getenv("srcdir");
+		dir = string(srcdir ? srcdir : ".") + "/../examples/web_server";
+		if (!check_settings()) {
+			cerr << "session settings failed." << endl;
+			return -1;
+		}
+		if (!check_certificates()) {
+			cerr << "loading of the certificates failed." << endl;
+			return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+private:
+	string dir;
+	bool check_settings() {
+		ssl_context ctx;
+		if (ctx.session_cache_size() == 0 || ctx.session_timeout() <= 0 ||
+		  !ctx.session_tickets() || ctx.kernel_tls())
+			return false;
+		ctx.session_cache_size(100).session_timeout(60).session_tickets(false).
+		  kernel_tls(true);
+		return ctx.session_cache_size() == 100 &&
+		  ctx.session_timeout() == 60 && !ctx.session_tickets() &&
+		  ctx.kernel_tls();
+	}
+	bool check_certificates() {
+		ssl_context ctx;
+		dbp::socket s;
+		// no certificates are loaded yet
+		try {
+			ssl_socket ss(s, ctx);
+			return false;
+		}
+		catch (socket_exception&) { }
+		try {
+			ctx.load_certificates(nullstr, dir + "/missing.pem",
+			  dir + "/pkey.pem", nullstr);
+			return false;
+		}
+		catch (socket_exception&) { }
+		ctx.load_certificates(nullstr, dir + "/cert.pem", dir + "/pkey.pem",
+		  nullstr);
+		// the connection established keeps the certificates reloaded
+		ssl_socket *before = new ssl_socket(s, ctx);
+		ctx.reload();
+		ssl_socket after(s, ctx);
+		delete before;
+		// the certificates loaded are kept if the new can't be loaded
+		try {
+			ctx.load_certificates(nullstr, dir + "/pkey.pem",
+			  dir + "/pkey.pem", nullstr);
+			return false;
+		}
+		catch (socket_exception&) { }
+		ssl_socket kept(s, ctx);
+		// the kernel TLS is enabled by the handshake only
+		return !kept.is_established() && !kept.is_kernel_tls();
+	}
+};
+
+IMPLEMENT_APP(test().app);
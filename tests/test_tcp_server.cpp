@@ -4,6 +4,8 @@
 #include <dcl/dclbase.h>
 #include <dcl/dclnet.h>
 
+#include "loopback.h"
+
 #ifdef _WIN32
 #include <windows.h>
 void sleep(int t) {
@@ -14,9 +16,14 @@ void sleep(int t) {
 using namespace std;
 using namespace dbp;
 
+#define CLIENTS 16
+
+// The working thread has processed the data
+static __thread bool working = false;
+
 class test {
 public:
-	test(): app(application::instance()) {
+	test(): app(application::instance()), srv(2), workers(0) {
 		app.on_execute(create_delegate(this, &test::on_execute));
 		srv.on_connect(create_delegate(this, &test::on_connect));
 		srv.on_disconnect(create_delegate(this, &test::on_disconnect));
@@ -26,13 +33,39 @@ public:
 	application &app;
 private:
 	tcp_server srv;
+	// the number of the working threads processed the data
+	int workers;
 	int on_execute() {
-/*		srv.start(":7777");
-		//TODO make the tests
-		sleep(500);
-		srv.stop();*/
-		return 0;
+		// there are more loops asked for than the working threads
+		int port = free_port();
+		srv.io_threads(4).start("127.0.0.1:" + to_string<int>(port));
+		bool rslt = check_lines(port) && check_workers(port);
+		srv.stop();
+		if (!rslt)
+			cerr << "line processing failed." << endl;
+		return rslt ? 0 : -1;
 	};
+	bool check_lines(int port) {
+		loopback_client c(port);
+		return c.send("hello\nworld\nquit\n") && c.receive() ==
+		  "Om namah shivaya, hello\nOm namah shivaya, world\ngood bye!\n" &&
+		  c.is_closed();
+	}
+	// the server runs no more working threads than given
+	bool check_workers(int port) {
+		loopback_client *c[CLIENTS];
+		for (int i = 0; i < CLIENTS; i++)
+			c[i] = new loopback_client(port);
+		bool rslt = true;
+		for (int i = 0; i < CLIENTS; i++)
+			rslt = rslt && c[i]->send("client\n");
+		for (int i = 0; i < CLIENTS; i++) {
+			rslt = rslt && c[i]->receive(25) == "Om namah shivaya, client\n";
+			delete c[i];
+		}
+		cout << "working threads: " << workers << endl;
+		return rslt && workers <= 2;
+	}
 	void on_connect(const dbp::socket &s, std::istream&, std::ostream&) {
 		cout << "connected from " << s.address() << ":" << s.port() << endl;
 	}
@@ -40,28 +73,33 @@ private:
 		cout << s.address() << ":" << s.port() << " disconnected." << endl;
 	}
 	bool on_process_data(const dbp::socket&, std::istream &in, std::ostream &out) {
+		if (!working) {
+			working = true;
+			__sync_add_and_fetch(&workers, 1);
+		}
 		if (in.bad()) {
 			cout << "The reading error occured." << endl;
 			return false;
 		}
-		// read full line into the buffer
-		string buf;
-		int pos = in.tellg();
-		getline(in, buf);
-		if (in.eof()) {
-			in.seekg(pos);
-			return true;
-		}
-		// line readed
-		if (!buf.empty()) {
-            if (trim()(buf) == string("quit")) {
-                out << "good bye!" << endl;
-                return false;
-            }
-			cout << buf << endl;
-			out << "Om namah shivaya, " << buf << endl;
+		// process all the full lines received
+		while (1) {
+			string buf;
+			int pos = in.tellg();
+			getline(in, buf);
+			if (in.eof()) {
+				in.seekg(pos);
+				return true;
+			}
+			// line readed
+			if (!buf.empty()) {
+				if (trim()(buf) == string("quit")) {
+					out << "good bye!" << endl;
+					return false;
+				}
+				cout << buf << endl;
+				out << "Om namah shivaya, " << buf << endl;
+			}
 		}
-		return true;
 	}
 };
 
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <unistd.h>
+
+#include <dcl/dclbase.h>
+
+using namespace std;
+using namespace dbp;
+
+#define TIMERS 4
+
+class test {
+public:
+	test(): app(application::instance()) {
+		app.on_execute(create_delegate(this, &test::on_execute));
+	};
+	int on_execute() {
+		// the resolution of 1 ms lets the timers below to cross the
+		// finest wheel boundary (64 ticks)
+		timer_wheel w(1);
+		if (w.next_timeout() != -1)
+			return -1;
+		const unsigned int timeouts[TIMERS] = { 5, 30, 200, 100 };
+		uint64_t fired[TIMERS] = { 0 };
+		timer t[TIMERS];
+		uint64_t start = timer_wheel::now();
+		for (int i = 0; i < TIMERS; i++) {
+			t[i].data = &fired[i];
+			w.arm(t[i], timeouts[i]);
+		}
+		// the cancelled timer never fires
+		w.cancel(t[3]);
+		// the rearmed timer fires once at the new time
+		w.arm(t[1], 50);
+		if (w.size() != 3)
+			return -1;
+		while (w.size() > 0) {
+			int timeout = w.next_timeout();
+			if (timeout < 0 || timeout > 200)
+				return -1;
+			usleep(timeout * 1000);
+			timer_wheel::timers expired;
+			w.expire(expired);
+			for (size_t i = 0; i < expired.size(); i++) {
+				if (expired[i]->is_armed())
+					return -1;
+				*static_cast<uint64_t*>(expired[i]->data) =
+				  timer_wheel::now() - start;
+			}
+		}
+		const unsigned int expected[TIMERS] = { 5, 50, 200, 0 };
+		for (int i = 0; i < TIMERS; i++) {
+			cout << "timer " << i << " fired at " << fired[i] << " ms" << endl;
+			if (fired[i] + 1 < expected[i] || fired[i] > expected[i] + 100)
+				return -1;
+		}
+		return 0;
+	};
+	// the link to the console application class
+	application &app;
+};
+
+IMPLEMENT_APP(test().app);